@@ -0,0 +1,74 @@
+// LD_PRELOAD分配计数器，基准测试用
+// 编译: gcc -shared -fPIC -O2 -o alloc_count.so alloc_count.c
+// 进程退出时把分配次数写到环境变量ALLOC_COUNT_FILE指定的文件；
+// 运行中可以用dlsym(RTLD_DEFAULT, "alloc_count_get")读取当前次数(libplayer的帧缓冲池统计用它)
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// 直接调用glibc的实现，避免dlsym在初始化时递归分配
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static atomic_ulong alloc_count;
+static atomic_ulong alloc_bytes;
+
+static void count(size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, size, memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+    count(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    count(nmemb * size);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count(size);
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    count(size);
+    void *p = __libc_memalign(alignment, size);
+    if (!p)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count(size);
+    return __libc_memalign(alignment, size);
+}
+
+// 进程启动以来的分配次数
+unsigned long alloc_count_get(void) {
+    return atomic_load(&alloc_count);
+}
+
+__attribute__((destructor))
+static void alloc_count_report(void) {
+    const char *path = getenv("ALLOC_COUNT_FILE");
+    if (!path)
+        return;
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return;
+    fprintf(f, "%lu %lu\n", atomic_load(&alloc_count), atomic_load(&alloc_bytes));
+    fclose(f);
+}
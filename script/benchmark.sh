@@ -0,0 +1,177 @@
+#!/bin/bash
+
+# 基准测试：生成合成测试源，无窗口运行step01~04，输出JSON Lines结果
+#
+# 用法: ./benchmark.sh [结果文件]
+# 通过环境变量调整测试矩阵，例如:
+#   BENCH_SIZES="640x360 1920x1080" BENCH_CODECS=h264 BENCH_STEPS="01 04" ./benchmark.sh
+#
+# 每行结果包含: step, source, codec, size, gop, frames, wall_s, fps,
+# user_s, sys_s, cpu_s, peak_rss_kb, allocs, allocs_per_frame, exit
+
+cd "$(dirname "$0")" || exit 1
+SCRIPT_DIR=$(pwd)
+ROOT_DIR=$(cd .. && pwd)
+
+BENCH_SIZES=${BENCH_SIZES:-"176x144 640x360 1280x720 1920x1080 3840x2160"}
+BENCH_CODECS=${BENCH_CODECS:-"h264 hevc"}
+BENCH_GOPS=${BENCH_GOPS:-"12 250"}
+BENCH_DURATION=${BENCH_DURATION:-10}
+BENCH_RATE=${BENCH_RATE:-25}
+BENCH_PRESET=${BENCH_PRESET:-veryfast}
+BENCH_STEPS=${BENCH_STEPS:-"01 02 03 04"}
+BENCH_TIMEOUT=${BENCH_TIMEOUT:-300}
+BENCH_BUILD=${BENCH_BUILD:-cmake}          # cmake: Release构建; compile: 各步骤的compile.sh; none: 不编译
+BENCH_BUILD_DIR=${BENCH_BUILD_DIR:-"$ROOT_DIR/build/release"}
+STEP01_ARGS=${STEP01_ARGS:-"--all --every 10 --format ppm"}
+STEP04_ARGS=${STEP04_ARGS:-""}
+
+SOURCE_DIR=${BENCH_SOURCE_DIR:-"$ROOT_DIR/input/bench"}
+OUT_DIR=${BENCH_OUT_DIR:-"$ROOT_DIR/output/bench"}
+RESULTS=${1:-"$OUT_DIR/results.jsonl"}
+
+for tool in ffmpeg ffprobe /usr/bin/time; do
+    if ! command -v "$tool" > /dev/null; then
+        echo "错误：找不到 $tool" >&2
+        exit 1
+    fi
+done
+
+mkdir -p "$SOURCE_DIR" "$OUT_DIR"
+
+# 无窗口、无声卡运行SDL
+export SDL_VIDEODRIVER=dummy
+export SDL_AUDIODRIVER=dummy
+
+# 分配计数器
+ALLOC_SO="$OUT_DIR/alloc_count.so"
+if ! gcc -shared -fPIC -O2 -o "$ALLOC_SO" "$SCRIPT_DIR/alloc_count.c"; then
+    echo "警告：无法编译分配计数器，allocs记为-1" >&2
+    ALLOC_SO=""
+fi
+
+# 编译各步骤，默认使用优化过的Release构建
+if [ "$BENCH_BUILD" = "cmake" ]; then
+    echo "=== CMake Release构建 ==="
+    cmake -S "$ROOT_DIR" -B "$BENCH_BUILD_DIR" -DCMAKE_BUILD_TYPE=Release > /dev/null &&
+        cmake --build "$BENCH_BUILD_DIR" -j"$(nproc)" > /dev/null || {
+        echo "错误：CMake构建失败" >&2
+        exit 1
+    }
+elif [ "$BENCH_BUILD" = "compile" ]; then
+    for step in $BENCH_STEPS; do
+        dir=$(ls -d "$ROOT_DIR"/source/step${step}_* 2>/dev/null | head -1)
+        if [ -n "$dir" ]; then
+            echo "=== 编译 $(basename "$dir") ==="
+            (cd "$dir" && ./compile.sh > /dev/null) || echo "警告：$(basename "$dir") 编译失败" >&2
+        fi
+    done
+fi
+
+# 生成测试源: <codec>_<size>_g<gop>.mp4，已存在时跳过
+generate_source() {
+    local codec=$1 size=$2 gop=$3 file=$4
+    local vcodec
+
+    if [ -f "$file" ]; then
+        return 0
+    fi
+    case $codec in
+        h264) vcodec="-c:v libx264 -x264-params scenecut=0" ;;
+        hevc) vcodec="-c:v libx265 -x265-params scenecut=0:log-level=error -tag:v hvc1" ;;
+        *) echo "未知编码 $codec" >&2; return 1 ;;
+    esac
+
+    echo "生成测试源 $(basename "$file")"
+    ffmpeg -v error -y \
+        -f lavfi -i "testsrc=size=$size:rate=$BENCH_RATE:duration=$BENCH_DURATION" \
+        -f lavfi -i "sine=frequency=440:duration=$BENCH_DURATION" \
+        $vcodec -preset "$BENCH_PRESET" -g "$gop" -keyint_min "$gop" \
+        -pix_fmt yuv420p \
+        -c:a aac -b:a 128k \
+        -movflags +faststart \
+        "$file"
+}
+
+# 视频帧数
+count_frames() {
+    ffprobe -v error -select_streams v:0 -count_packets \
+        -show_entries stream=nb_read_packets -of csv=p=0 "$1"
+}
+
+# 运行一个步骤，追加一行JSON结果
+run_step() {
+    local step=$1 source=$2 codec=$3 size=$4 gop=$5 frames=$6
+    local dir bin name work timefile allocfile extra json_extra=""
+
+    dir=$(ls -d "$ROOT_DIR"/source/step${step}_* 2>/dev/null | head -1)
+    if [ "$BENCH_BUILD" = "compile" ]; then
+        bin="$dir/ffmpeg_demo01"
+    else
+        bin="$BENCH_BUILD_DIR/bin/$(basename "$dir")"
+    fi
+    if [ ! -x "$bin" ]; then
+        echo "跳过 step$step: 找不到 $bin" >&2
+        return
+    fi
+
+    name=$(basename "$source" .mp4)
+    work=$(mktemp -d "$OUT_DIR/step${step}_${name}.XXXXXX")
+    timefile="$work/time.txt"
+    allocfile="$work/allocs.txt"
+
+    case $step in
+        01) extra="$work $STEP01_ARGS" ;;
+        02|03) extra="$work" ;;
+        04)
+            extra="--autoexit --stats-json $OUT_DIR/step04_${name}_stats.json $STEP04_ARGS"
+            json_extra=", \"stats_json\": \"$OUT_DIR/step04_${name}_stats.json\""
+            ;;
+    esac
+
+    echo "运行 step$step $name"
+    # 分配计数器只加载到被测程序里：time和timeout也会继承LD_PRELOAD，
+    # 它们退出时会用自己的计数覆盖ALLOC_COUNT_FILE
+    (cd "$dir" && \
+        /usr/bin/time -f "%e %U %S %M" -o "$timefile" \
+        timeout "$BENCH_TIMEOUT" \
+        env ALLOC_COUNT_FILE="$allocfile" LD_PRELOAD="$ALLOC_SO" \
+        "$bin" "$source" $extra > "$work/log.txt" 2>&1)
+    local status=$?
+
+    local wall=0 user=0 sys=0 rss=0 allocs=-1
+    if [ -s "$timefile" ]; then
+        read -r wall user sys rss < <(tail -1 "$timefile")
+    fi
+    if [ -s "$allocfile" ]; then
+        read -r allocs _ < "$allocfile"
+    fi
+
+    awk -v step="step$step" -v src="$name" -v codec="$codec" -v size="$size" -v gop="$gop" \
+        -v frames="$frames" -v wall="$wall" -v user="$user" -v sys="$sys" -v rss="$rss" \
+        -v allocs="$allocs" -v status="$status" -v extra="$json_extra" 'BEGIN {
+        fps = wall > 0 ? frames / wall : 0
+        apf = (allocs >= 0 && frames > 0) ? allocs / frames : -1
+        printf "{\"step\": \"%s\", \"source\": \"%s\", \"codec\": \"%s\", \"size\": \"%s\", \"gop\": %d, ", step, src, codec, size, gop
+        printf "\"frames\": %d, \"wall_s\": %.3f, \"fps\": %.2f, \"user_s\": %.3f, \"sys_s\": %.3f, \"cpu_s\": %.3f, ", frames, wall, fps, user, sys, user + sys
+        printf "\"peak_rss_kb\": %d, \"allocs\": %.0f, \"allocs_per_frame\": %.1f, \"exit\": %d%s}\n", rss, allocs, apf, status, extra
+    }' >> "$RESULTS"
+
+    rm -rf "$work"
+}
+
+echo "结果写入 $RESULTS"
+for codec in $BENCH_CODECS; do
+    for size in $BENCH_SIZES; do
+        for gop in $BENCH_GOPS; do
+            source="$SOURCE_DIR/${codec}_${size}_g${gop}.mp4"
+            generate_source "$codec" "$size" "$gop" "$source" || continue
+            frames=$(count_frames "$source")
+            for step in $BENCH_STEPS; do
+                run_step "$step" "$source" "$codec" "$size" "$gop" "${frames:-0}"
+            done
+        done
+    done
+done
+
+echo "=== 基准测试完成 ==="
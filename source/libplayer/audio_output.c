@@ -0,0 +1,621 @@
+#include "audio_output.h"
+#include <inttypes.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/time.h>
+#include <math.h>
+#include <string.h>
+
+// 音频回调，只从PCM环形缓冲区拷贝，不解码也不加锁等待
+static void audio_callback(void *userdata, Uint8 *stream, int len) {
+    AudioOutput *ao = (AudioOutput *)userdata;
+    int64_t t0 = av_gettime_relative();
+    double callback_time = t0 / 1000000.0;
+    double pts, speed, prev_speed;
+    unsigned long long pos, speed_pos;
+
+    size_t got = pcm_ring_read(&ao->ring, stream, len);
+    if (ao->pcm_hist) {
+        stage_hist_add_at(ao->pcm_hist,
+                          (int64_t)pcm_ring_available(&ao->ring) * 1000 / ao->bytes_per_sec, t0);
+    }
+
+    SDL_AtomicLock(&ao->pos_lock);
+    pts = ao->write_pts;
+    pos = ao->write_pos;
+    speed = ao->write_speed;
+    prev_speed = ao->prev_speed;
+    speed_pos = ao->speed_pos;
+    SDL_AtomicUnlock(&ao->pos_lock);
+
+    if (got < (size_t)len) {
+        // 数据不足，剩余部分填充静音
+        memset(stream + got, ao->spec.silence, len - got);
+        if (!isnan(pts) && !atomic_load(&ao->eof)) {
+            atomic_fetch_add(&ao->underruns, 1);
+        }
+    }
+
+    if (ao->clock && !isnan(pts)) {
+        // 正在播放的位置 = 已写入数据的结束pts - 环形缓冲区和设备缓冲中尚未播放的部分，
+        // 变速时每字节对应speed倍的时长；切换速度之前写入的数据还按旧速度换算
+        unsigned long long rpos = atomic_load(&ao->ring.read_pos);
+        double old_bytes = speed_pos > rpos ? (double)(speed_pos - rpos) : 0;
+        double new_bytes = (double)(pos - rpos) - old_bytes;
+        double device_speed = old_bytes > 0 ? prev_speed : speed;
+        double buffered = (new_bytes * speed + old_bytes * prev_speed + 2.0 * ao->spec.size * device_speed) /
+                          ao->bytes_per_sec;
+        set_clock_at(ao->clock, pts - buffered, callback_time);
+    }
+
+    if (ao->fill_hist) {
+        stage_hist_add(ao->fill_hist, av_gettime_relative() - t0);
+    }
+}
+
+// SDL的多声道顺序(见SDL_audio.h)对应的声道布局，5声道是4.1而不是FFmpeg默认的5.0
+static int64_t sdl_channel_layout(int channels) {
+    switch (channels) {
+        case 1: return AV_CH_LAYOUT_MONO;
+        case 2: return AV_CH_LAYOUT_STEREO;
+        case 3: return AV_CH_LAYOUT_2POINT1;
+        case 4: return AV_CH_LAYOUT_QUAD;
+        case 5: return AV_CH_LAYOUT_QUAD | AV_CH_LOW_FREQUENCY;
+        case 6: return AV_CH_LAYOUT_5POINT1;
+        case 7: return AV_CH_LAYOUT_6POINT1;
+        case 8: return AV_CH_LAYOUT_7POINT1;
+        default: return av_get_default_channel_layout(channels);
+    }
+}
+
+// 本机字节序的SDL采样格式对应的交错格式，其他格式返回AV_SAMPLE_FMT_NONE
+static enum AVSampleFormat sdl_sample_fmt(SDL_AudioFormat format) {
+    switch (format) {
+        case AUDIO_F32SYS: return AV_SAMPLE_FMT_FLT;
+        case AUDIO_S32SYS: return AV_SAMPLE_FMT_S32;
+        case AUDIO_S16SYS: return AV_SAMPLE_FMT_S16;
+        case AUDIO_U8: return AV_SAMPLE_FMT_U8;
+        default: return AV_SAMPLE_FMT_NONE;
+    }
+}
+
+// 打开音频设备，按设备实际参数配置重采样和PCM环形缓冲区，设备保持暂停。
+// samples是设备缓冲的采样数，0表示AUDIO_OUTPUT_SAMPLES，会取整到2的幂
+int audio_output_open(AudioOutput *ao, AVCodecContext *ctx, AVStream *st, PacketQueue *queue, Clock *clock,
+                      int samples) {
+    SDL_AudioSpec wanted_spec;
+    int64_t in_layout;
+
+    memset(ao, 0, sizeof(AudioOutput));
+    ao->ctx = ctx;
+    ao->st = st;
+    ao->queue = queue;
+    ao->clock = clock;
+
+    if (samples <= 0) {
+        samples = AUDIO_OUTPUT_SAMPLES;
+    }
+    samples = 1 << av_log2(av_clip(samples, AUDIO_OUTPUT_SAMPLES_MIN, AUDIO_OUTPUT_SAMPLES_MAX));
+
+    // 请求float32和源的声道数、采样率，允许设备改成它原生支持的参数，避免SDL内部再转换一次
+    memset(&wanted_spec, 0, sizeof(wanted_spec));
+    wanted_spec.freq = ctx->sample_rate;
+    wanted_spec.format = AUDIO_F32SYS;
+    wanted_spec.channels = av_clip(ctx->channels, 1, 8);
+    wanted_spec.silence = 0;
+    wanted_spec.samples = samples;
+    wanted_spec.callback = audio_callback;
+    wanted_spec.userdata = ao;
+
+    ao->dev = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &ao->spec,
+                                  SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_FORMAT_CHANGE |
+                                  SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+    if (ao->dev != 0 && sdl_sample_fmt(ao->spec.format) == AV_SAMPLE_FMT_NONE) {
+        // 设备给出的格式没有对应的交错格式(大端、无符号16位等)，改由SDL转换到float32
+        SDL_CloseAudioDevice(ao->dev);
+        ao->dev = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &ao->spec,
+                                      SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+    }
+    if (ao->dev == 0) {
+        fprintf(stderr, "SDL_OpenAudioDevice: %s\n", SDL_GetError());
+        return -1;
+    }
+
+    ao->out_fmt = sdl_sample_fmt(ao->spec.format);
+    ao->out_layout = sdl_channel_layout(ao->spec.channels);
+    ao->bytes_per_sample = av_get_bytes_per_sample(ao->out_fmt) * ao->spec.channels;
+    ao->bytes_per_sec = ao->spec.freq * ao->bytes_per_sample;
+
+    // 重采样器只按打开时的参数配置一次；解码输出与设备只差平面/交错或完全相同时不经过它
+    in_layout = ctx->channel_layout ? (int64_t)ctx->channel_layout :
+                av_get_default_channel_layout(ctx->channels);
+    ao->in_fmt = ctx->sample_fmt;
+    ao->convert = AUDIO_CONVERT_SWR;
+    if (in_layout == ao->out_layout && ctx->sample_rate == ao->spec.freq) {
+        if (ctx->sample_fmt == ao->out_fmt) {
+            ao->convert = AUDIO_CONVERT_NONE;
+        } else if (av_get_packed_sample_fmt(ctx->sample_fmt) == ao->out_fmt) {
+            ao->convert = AUDIO_CONVERT_INTERLEAVE;
+        }
+    }
+    ao->swr = swr_alloc_set_opts(NULL,
+                                 ao->out_layout, ao->out_fmt, ao->spec.freq,
+                                 in_layout, ctx->sample_fmt, ctx->sample_rate,
+                                 0, NULL);
+    if (!ao->swr || swr_init(ao->swr) < 0) {
+        fprintf(stderr, "Could not initialize resampler\n");
+        swr_free(&ao->swr);
+        SDL_CloseAudioDevice(ao->dev);
+        ao->dev = 0;
+        return -1;
+    }
+
+    ao->tempo_frame = av_frame_alloc();
+    if (!ao->tempo_frame || pcm_ring_init(&ao->ring, (size_t)(ao->bytes_per_sec * AUDIO_OUTPUT_RING_SECONDS)) < 0) {
+        fprintf(stderr, "Could not allocate PCM ring buffer\n");
+        av_frame_free(&ao->tempo_frame);
+        swr_free(&ao->swr);
+        SDL_CloseAudioDevice(ao->dev);
+        ao->dev = 0;
+        return -1;
+    }
+    ao->write_pts = NAN;
+    ao->write_pos = 0;
+    ao->seek_target = NAN;
+    ao->seek_landed = 0;
+    ao->skip_until = NAN;
+    ao->buf_pts = NAN;
+    ao->batch_samples = ao->spec.samples;
+    ao->speed = 1.0;
+    ao->write_speed = 1.0;
+    ao->prev_speed = 1.0;
+    ao->tempo = 1.0;
+    atomic_init(&ao->underruns, 0);
+    atomic_init(&ao->eof, 0);
+    atomic_init(&ao->drained, 0);
+    return 0;
+}
+
+// 写入PCM环形缓冲区，end_pts是这段数据结束处的pts；退出时返回-1
+static int audio_output_write(AudioOutput *ao, const uint8_t *data, size_t size, double end_pts) {
+    if (pcm_ring_write(&ao->ring, data, size) < 0) {
+        return -1;
+    }
+
+    SDL_AtomicLock(&ao->pos_lock);
+    ao->write_pts = end_pts;
+    ao->write_pos = atomic_load(&ao->ring.write_pos);
+    SDL_AtomicUnlock(&ao->pos_lock);
+    return 0;
+}
+
+/**
+ * ! 时间伸缩
+ * 重采样后的数据送入abuffer -> atempo -> abuffersink，输出的数据写入环形缓冲区。
+ * atempo用WSOLA拼接波形，改变速度而不改变音调。
+ */
+static void tempo_close(AudioOutput *ao) {
+    avfilter_graph_free(&ao->tempo_graph);
+    ao->tempo_src = NULL;
+    ao->tempo_sink = NULL;
+    ao->tempo_in = 0;
+    ao->tempo_out = 0;
+}
+
+// 旧版本的atempo每级只支持0.5~2.0，超出时串联几级
+static void tempo_filter_desc(char *desc, size_t size, double speed) {
+    int len = 0;
+
+    while (speed > 2.0 || speed < 0.5) {
+        double step = speed > 2.0 ? 2.0 : 0.5;
+        len += snprintf(desc + len, size - len, "atempo=%g,", step);
+        speed /= step;
+    }
+    snprintf(desc + len, size - len, "atempo=%g", speed);
+}
+
+// 按速度建立滤镜图，速度为1时不建立；滤镜里缓存的数据被丢弃。
+// 失败时不再重试，这个速度下音频按原速输出
+static int tempo_open(AudioOutput *ao, double speed) {
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+    char args[256], desc[128];
+    int ret = 0;
+
+    tempo_close(ao);
+    ao->tempo = speed;
+    if (speed == 1.0) {
+        goto end;
+    }
+
+    ao->tempo_graph = avfilter_graph_alloc();
+    if (!ao->tempo_graph || !outputs || !inputs) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    ao->tempo_graph->nb_threads = 1;
+
+    snprintf(args, sizeof(args), "sample_rate=%d:sample_fmt=%s:channel_layout=0x%" PRIx64 ":time_base=1/%d",
+             ao->spec.freq, av_get_sample_fmt_name(ao->out_fmt), ao->out_layout, ao->spec.freq);
+    ret = avfilter_graph_create_filter(&ao->tempo_src, avfilter_get_by_name("abuffer"), "in",
+                                       args, NULL, ao->tempo_graph);
+    if (ret < 0) {
+        goto end;
+    }
+    ret = avfilter_graph_create_filter(&ao->tempo_sink, avfilter_get_by_name("abuffersink"), "out",
+                                       NULL, NULL, ao->tempo_graph);
+    if (ret < 0) {
+        goto end;
+    }
+
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = ao->tempo_src;
+    outputs->pad_idx = 0;
+    outputs->next = NULL;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = ao->tempo_sink;
+    inputs->pad_idx = 0;
+    inputs->next = NULL;
+    tempo_filter_desc(desc, sizeof(desc), speed);
+    if ((ret = avfilter_graph_parse_ptr(ao->tempo_graph, desc, &inputs, &outputs, NULL)) < 0 ||
+        (ret = avfilter_graph_config(ao->tempo_graph, NULL)) < 0) {
+        goto end;
+    }
+
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if (ret < 0) {
+        fprintf(stderr, "Could not create atempo filter for speed %.2f\n", speed);
+        tempo_close(ao);
+    }
+    return ret;
+}
+
+// 送入nb_samples个采样(data为NULL时冲刷滤镜)，把滤镜输出的数据写入环形缓冲区；退出时返回-1
+static int tempo_write(AudioOutput *ao, uint8_t *data, int nb_samples) {
+    AVFrame *frame = ao->tempo_frame;
+    int bytes_per_sample = ao->bytes_per_sample;
+    int ret;
+
+    if (data) {
+        // 不是引用计数帧，abuffer会拷贝一份
+        frame->format = ao->out_fmt;
+        frame->sample_rate = ao->spec.freq;
+        frame->channel_layout = ao->out_layout;
+        frame->channels = ao->spec.channels;
+        frame->nb_samples = nb_samples;
+        frame->data[0] = data;
+        frame->linesize[0] = nb_samples * bytes_per_sample;
+        frame->extended_data = frame->data;
+        frame->pts = ao->tempo_in;
+        ret = av_buffersrc_add_frame(ao->tempo_src, frame);
+        av_frame_unref(frame);
+        ao->tempo_in += nb_samples;
+    } else {
+        ret = av_buffersrc_add_frame(ao->tempo_src, NULL);
+    }
+    if (ret < 0) {
+        return 0;
+    }
+
+    while (av_buffersink_get_frame(ao->tempo_sink, frame) >= 0) {
+        // 滤镜里还缓存着(送入 - 取出 × 速度)个输入采样，写入部分的结束pts要减去它们
+        ao->tempo_out += frame->nb_samples;
+        double pending = FFMAX(0, ao->tempo_in - ao->tempo_out * ao->tempo) / ao->spec.freq;
+        ret = audio_output_write(ao, frame->data[0], (size_t)frame->nb_samples * bytes_per_sample,
+                                 ao->tempo_pts - pending);
+        av_frame_unref(frame);
+        if (ret < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 速度变化：冲刷旧滤镜，按新速度重建，并记下环形缓冲区里新旧速度数据的分界
+static void tempo_set(AudioOutput *ao, double speed) {
+    if (ao->tempo_graph) {
+        tempo_write(ao, NULL, 0);
+    }
+    tempo_open(ao, speed);
+
+    SDL_AtomicLock(&ao->pos_lock);
+    ao->prev_speed = ao->write_speed;
+    ao->write_speed = ao->tempo_graph ? ao->tempo : 1.0;
+    ao->speed_pos = atomic_load(&ao->ring.write_pos);
+    SDL_AtomicUnlock(&ao->pos_lock);
+}
+
+// 平面格式交错成设备格式；立体声float是最常见的情况(AAC、Opus、MP3解码输出fltp)，单独展开
+static void audio_interleave(uint8_t *dst, uint8_t **src, int channels, int nb_samples, int sample_size) {
+    if (sample_size == 4 && channels == 2) {
+        const float *l = (const float *)src[0];
+        const float *r = (const float *)src[1];
+        float *out = (float *)dst;
+        for (int i = 0; i < nb_samples; i++) {
+            out[2 * i] = l[i];
+            out[2 * i + 1] = r[i];
+        }
+        return;
+    }
+    for (int i = 0; i < nb_samples; i++) {
+        for (int c = 0; c < channels; c++) {
+            memcpy(dst, src[c] + (size_t)i * sample_size, sample_size);
+            dst += sample_size;
+        }
+    }
+}
+
+// 帧参数与打开时一致、重采样器里也没有缓存的数据时不经过重采样器
+static int audio_output_direct(AudioOutput *ao, AVFrame *frame) {
+    return ao->convert != AUDIO_CONVERT_SWR && frame->format == ao->in_fmt &&
+           frame->sample_rate == ao->spec.freq && frame->channels == ao->spec.channels &&
+           swr_get_delay(ao->swr, frame->sample_rate) == 0;
+}
+
+// 保证ao->buf在已攒的数据之后还能放下samples个采样，已攒的数据保留；返回写入位置
+static uint8_t *audio_output_reserve(AudioOutput *ao, int samples) {
+    uint8_t *buf = av_fast_realloc(ao->buf, &ao->buf_size,
+                                   (size_t)(ao->buf_samples + samples) * ao->bytes_per_sample);
+    if (!buf) {
+        return NULL;
+    }
+    ao->buf = buf;
+    return buf + (size_t)ao->buf_samples * ao->bytes_per_sample;
+}
+
+// 把一帧转换成设备格式追加到ao->buf；返回追加的采样数，失败时返回负数
+static int audio_output_convert(AudioOutput *ao, AVFrame *frame) {
+    int direct = audio_output_direct(ao, frame);
+    // 重采样器给出的上限已经包括它内部缓存的延迟采样
+    int out_samples = direct ? frame->nb_samples : swr_get_out_samples(ao->swr, frame->nb_samples);
+    if (out_samples < 0) {
+        return out_samples;
+    }
+
+    uint8_t *dst = audio_output_reserve(ao, out_samples);
+    if (!dst) {
+        return AVERROR(ENOMEM);
+    }
+
+    if (direct) {
+        if (ao->convert == AUDIO_CONVERT_NONE) {
+            memcpy(dst, frame->extended_data[0], (size_t)frame->nb_samples * ao->bytes_per_sample);
+        } else {
+            audio_interleave(dst, frame->extended_data, ao->spec.channels, frame->nb_samples,
+                             av_get_bytes_per_sample(ao->out_fmt));
+        }
+        return frame->nb_samples;
+    }
+
+    // 重采样转换
+    return swr_convert(ao->swr, &dst, out_samples,
+                       (const uint8_t **)frame->extended_data, frame->nb_samples);
+}
+
+// 把ao->buf里攒下的数据写出(变速时经过atempo)，退出时返回-1
+static int audio_output_emit(AudioOutput *ao) {
+    int n = ao->buf_samples;
+
+    if (n == 0) {
+        return 0;
+    }
+    ao->buf_samples = 0;
+    if (ao->tempo_graph) {
+        ao->tempo_pts = ao->buf_pts;
+        return tempo_write(ao, ao->buf, n);
+    }
+    return audio_output_write(ao, ao->buf, (size_t)n * ao->bytes_per_sample, ao->buf_pts);
+}
+
+// 文件结尾：取出重采样器里缓存的采样，连同攒下的数据一起写出
+static int audio_output_drain(AudioOutput *ao) {
+    int out_samples = swr_get_out_samples(ao->swr, 0);
+
+    if (out_samples > 0) {
+        uint8_t *dst = audio_output_reserve(ao, out_samples);
+        if (!dst) {
+            return -1;
+        }
+        // 这些采样对应的输入已经计入buf_pts
+        int n = swr_convert(ao->swr, &dst, out_samples, NULL, 0);
+        if (n > 0) {
+            ao->buf_samples += n;
+        }
+    }
+    return audio_output_emit(ao);
+}
+
+// 转换一帧，攒够一个设备缓冲的数据后写入PCM环形缓冲区；退出时返回-1
+static int audio_output_frame(AudioOutput *ao, AVFrame *frame) {
+    double pts, speed;
+
+    SDL_AtomicLock(&ao->pos_lock);
+    speed = ao->speed;
+    SDL_AtomicUnlock(&ao->pos_lock);
+    if (speed != ao->tempo) {
+        // 攒下的数据还按旧速度写出
+        if (audio_output_emit(ao) < 0) {
+            return -1;
+        }
+        tempo_set(ao, speed);
+    }
+
+    // 帧的起始pts，没有时间戳时接着上一帧
+    if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+        pts = frame->best_effort_timestamp * av_q2d(ao->st->time_base);
+    } else {
+        pts = isnan(ao->buf_pts) ? ao->seek_landed : ao->buf_pts;
+    }
+
+    // seek后目标位置之前的音频不输出，也不用转换
+    if (!isnan(ao->skip_until)) {
+        if (pts + (double)frame->nb_samples / frame->sample_rate <= ao->skip_until) {
+            return 0;
+        }
+        ao->skip_until = NAN;
+    }
+
+    // 格式相同、没有攒下的数据并且帧够大时不拷贝，直接写出
+    if (ao->convert == AUDIO_CONVERT_NONE && ao->buf_samples == 0 && !ao->tempo_graph &&
+        frame->nb_samples >= ao->batch_samples && audio_output_direct(ao, frame)) {
+        ao->buf_pts = pts + (double)frame->nb_samples / frame->sample_rate;
+        return audio_output_write(ao, frame->extended_data[0],
+                                  (size_t)frame->nb_samples * ao->bytes_per_sample, ao->buf_pts);
+    }
+
+    int n = audio_output_convert(ao, frame);
+    if (n == AVERROR(ENOMEM)) {
+        return -1;
+    }
+    if (n < 0) {
+        fprintf(stderr, "Error while converting\n");
+        return 0;
+    }
+    ao->buf_samples += n;
+    ao->buf_pts = pts + (double)frame->nb_samples / frame->sample_rate;
+
+    if (ao->buf_samples < ao->batch_samples) {
+        return 0;
+    }
+    return audio_output_emit(ao);
+}
+
+// seek之后：冲刷解码器和重采样器，丢弃环形缓冲区里旧位置的数据
+static void audio_output_flush(AudioOutput *ao) {
+    avcodec_flush_buffers(ao->ctx);
+    swr_init(ao->swr);
+    ao->buf_samples = 0;
+    ao->buf_pts = NAN;
+    // 重建滤镜图，丢掉旧位置的缓存数据
+    tempo_open(ao, ao->tempo);
+    SDL_LockAudioDevice(ao->dev);
+    pcm_ring_flush(&ao->ring);
+    SDL_AtomicLock(&ao->pos_lock);
+    ao->write_pts = NAN;
+    ao->prev_speed = ao->write_speed;
+    SDL_AtomicUnlock(&ao->pos_lock);
+    if (ao->clock) {
+        set_clock(ao->clock, NAN);
+    }
+    SDL_UnlockAudioDevice(ao->dev);
+    ao->skip_until = ao->seek_target;
+    atomic_store(&ao->drained, 0);
+}
+
+// 音频解码线程：从包队列取包，解码、重采样后写入PCM环形缓冲区
+static int audio_thread(void *arg) {
+    AudioOutput *ao = (AudioOutput *)arg;
+    AVPacket pkt1, *packet = &pkt1;
+    AVFrame *frame;
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        fprintf(stderr, "Could not allocate audio frame\n");
+        return -1;
+    }
+    // CPU紧张时优先保证音频解码，视频解码线程落后由降级策略处理；没有权限时忽略
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    while (packet_queue_get(ao->queue, packet, 1) > 0) {
+        if (packet_queue_is_flush(packet)) {
+            av_packet_unref(packet);
+            audio_output_flush(ao);
+            continue;
+        }
+
+        // 空包表示文件结尾，冲刷解码器
+        int draining = packet_queue_is_eof(packet);
+        int ret = avcodec_send_packet(ao->ctx, draining ? NULL : packet);
+        av_packet_unref(packet);
+        if (ret < 0) {
+            if (!draining) {
+                fprintf(stderr, "Error sending audio packet for decoding\n");
+            }
+            continue;
+        }
+
+        // 接收解码后的帧
+        while ((ret = avcodec_receive_frame(ao->ctx, frame)) >= 0) {
+            ret = audio_output_frame(ao, frame);
+            av_frame_unref(frame);
+            if (ret < 0) {
+                goto out;
+            }
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            fprintf(stderr, "Error during audio decoding\n");
+        }
+        if (draining) {
+            // 冲刷重采样器、攒下的数据和atempo里缓存的数据
+            if (audio_output_drain(ao) < 0 || (ao->tempo_graph && tempo_write(ao, NULL, 0) < 0)) {
+                goto out;
+            }
+            atomic_store(&ao->drained, 1);
+        }
+    }
+
+out:
+    av_frame_free(&frame);
+    return 0;
+}
+
+// 启动音频解码线程，然后开始播放
+int audio_output_start(AudioOutput *ao) {
+    ao->tid = SDL_CreateThread(audio_thread, "audio_thread", ao);
+    if (!ao->tid) {
+        fprintf(stderr, "Could not create audio thread\n");
+        return -1;
+    }
+    SDL_PauseAudioDevice(ao->dev, 0);
+    return 0;
+}
+
+void audio_output_pause(AudioOutput *ao, int paused) {
+    SDL_PauseAudioDevice(ao->dev, paused);
+}
+
+// 记录seek的目标和落点，必须在往包队列放flush标记之前调用
+void audio_output_set_seek(AudioOutput *ao, double target, double landed) {
+    ao->seek_target = target;
+    ao->seek_landed = landed;
+}
+
+void audio_output_set_eof(AudioOutput *ao, int eof) {
+    atomic_store(&ao->eof, eof);
+}
+
+// 设置播放速度，音频线程处理下一帧时生效；环形缓冲区里已有的数据仍按原速度播放
+void audio_output_set_speed(AudioOutput *ao, double speed) {
+    SDL_AtomicLock(&ao->pos_lock);
+    ao->speed = av_clipd(speed, AUDIO_OUTPUT_SPEED_MIN, AUDIO_OUTPUT_SPEED_MAX);
+    SDL_AtomicUnlock(&ao->pos_lock);
+}
+
+// 环形缓冲区中还没播放的字节数
+size_t audio_output_buffered(AudioOutput *ao) {
+    return pcm_ring_available(&ao->ring);
+}
+
+// 停止音频线程并关闭设备，关闭后回调不再访问环形缓冲区
+void audio_output_close(AudioOutput *ao) {
+    if (!ao->dev) {
+        return;
+    }
+    packet_queue_quit(ao->queue);
+    pcm_ring_quit(&ao->ring);
+    if (ao->tid) {
+        SDL_WaitThread(ao->tid, NULL);
+        ao->tid = NULL;
+    }
+    SDL_CloseAudioDevice(ao->dev);
+    ao->dev = 0;
+    pcm_ring_destroy(&ao->ring);
+    swr_free(&ao->swr);
+    tempo_close(ao);
+    av_frame_free(&ao->tempo_frame);
+    av_freep(&ao->buf);
+    ao->buf_size = 0;
+    ao->buf_samples = 0;
+}
@@ -0,0 +1,103 @@
+#ifndef AUDIO_OUTPUT_H
+#define AUDIO_OUTPUT_H
+
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include "packet_queue.h"
+#include "pcm_ring.h"
+#include "stage_stats.h"
+#include "sync_clock.h"
+
+#define AUDIO_OUTPUT_SAMPLES 1024       // 音频设备缓冲(采样数)的默认值
+#define AUDIO_OUTPUT_SAMPLES_MIN 64     // 设备缓冲的可调范围，越小延迟越低、回调越频繁
+#define AUDIO_OUTPUT_SAMPLES_MAX 8192
+#define AUDIO_OUTPUT_RING_SECONDS 0.5   // PCM环形缓冲区的时长
+#define AUDIO_OUTPUT_SPEED_MIN 0.25     // 变速播放的范围
+#define AUDIO_OUTPUT_SPEED_MAX 4.0
+
+// 解码输出到设备格式的转换方式
+enum {
+    AUDIO_CONVERT_SWR,          // 重采样器
+    AUDIO_CONVERT_NONE,         // 格式、声道和采样率都相同，直接写入
+    AUDIO_CONVERT_INTERLEAVE,   // 只差平面/交错，逐采样交错
+};
+
+/**
+ * ! 音频输出
+ *
+ * 音频线程从包队列取包、解码、重采样到设备格式后写入PCM环形缓冲区；
+ * 设备格式优先用float32，声道数和采样率按源请求，以设备实际给出的参数为准。
+ * 解码输出已经是设备格式时直接写入，只差平面/交错时只做交错，都不经过重采样器。
+ * 转换结果先攒在可增长的缓冲里，够一个设备缓冲再写出，文件结尾时冲刷重采样器。
+ * SDL音频回调只从环形缓冲区拷贝，并按已写入数据的pts更新音频时钟。
+ * 包队列和解码器由调用者创建，audio_output只负责解码线程和设备。
+ * 队列里的flush标记(seek)会冲刷解码器、重采样器和环形缓冲区，
+ * 空包表示文件结尾，冲刷出解码器里剩余的帧。
+ * 变速播放时重采样后的数据再经过atempo滤镜做时间伸缩(不变调)，音频时钟按速度换算。
+ */
+typedef struct AudioOutput {
+    AVCodecContext *ctx;        // 已打开的解码器
+    AVStream *st;
+    PacketQueue *queue;
+    SDL_AudioDeviceID dev;
+    SDL_AudioSpec spec;         // 设备实际使用的参数
+    SwrContext *swr;            // 重采样到设备格式，打开时按设备参数配置一次
+    enum AVSampleFormat out_fmt; // 设备的采样格式和声道布局
+    int64_t out_layout;
+    int bytes_per_sample;       // 设备格式下一个采样(所有声道)的字节数
+    enum AVSampleFormat in_fmt; // 解码器的输出格式，帧与它和设备参数一致时不经过重采样器
+    int convert;                // AUDIO_CONVERT_*
+    uint8_t *buf;               // 转换输出缓冲，按需增长并复用；攒够batch_samples个采样才写出
+    unsigned int buf_size;
+    int buf_samples;            // buf里还没写出的采样数
+    double buf_pts;             // 最近转换的一帧的结束pts(秒)，只由音频线程访问
+    int batch_samples;          // 每次写出的最少采样数，等于设备缓冲
+    int bytes_per_sec;
+    PcmRing ring;
+    SDL_SpinLock pos_lock;
+    double write_pts;           // 已写入环形缓冲区的数据的结束pts(秒)
+    unsigned long long write_pos; // 写到write_pts时的写入字节总数
+    double speed;               // 请求的播放速度，由audio_output_set_speed设置
+    double write_speed;         // 环形缓冲区里speed_pos之后的数据的速度
+    double prev_speed;          // speed_pos之前的数据的速度
+    unsigned long long speed_pos; // 最近一次切换速度时的写入字节总数
+    atomic_int underruns;       // 回调时数据不足的次数
+    atomic_int eof;             // 不会再有新数据，数据不足不算欠载
+    atomic_int drained;         // 解码器已冲刷完
+    Clock *clock;               // 音频时钟，可为NULL
+    double seek_target;         // 最近一次seek的目标和落点(秒)，在放flush标记之前设置
+    double seek_landed;
+    double skip_until;          // seek后丢弃结束时间早于此的帧，只由音频线程访问
+    SDL_Thread *tid;
+
+    // 时间伸缩，只由音频线程访问；速度为1时没有滤镜图
+    double tempo;               // 当前滤镜图的速度
+    AVFilterGraph *tempo_graph;
+    AVFilterContext *tempo_src;
+    AVFilterContext *tempo_sink;
+    AVFrame *tempo_frame;       // 从滤镜图取出的帧
+    int64_t tempo_in;           // 送入和取出的采样数，差值是滤镜里缓存的数据
+    int64_t tempo_out;
+    double tempo_pts;           // 已送入滤镜的数据的结束pts(秒)
+
+    // 可选的统计，为NULL时不记录
+    StageHist *fill_hist;       // 回调耗时(微秒)
+    StageHist *pcm_hist;        // 回调时环形缓冲区里的数据(毫秒)
+} AudioOutput;
+
+int audio_output_open(AudioOutput *ao, AVCodecContext *ctx, AVStream *st, PacketQueue *queue, Clock *clock,
+                      int samples);
+int audio_output_start(AudioOutput *ao);
+void audio_output_pause(AudioOutput *ao, int paused);
+void audio_output_set_seek(AudioOutput *ao, double target, double landed);
+void audio_output_set_eof(AudioOutput *ao, int eof);
+void audio_output_set_speed(AudioOutput *ao, double speed);
+size_t audio_output_buffered(AudioOutput *ao);
+void audio_output_close(AudioOutput *ao);
+
+#endif
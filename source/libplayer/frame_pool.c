@@ -0,0 +1,215 @@
+#define _GNU_SOURCE     // dlsym的RTLD_DEFAULT
+#include "frame_pool.h"
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <string.h>
+
+// 与libavcodec默认分配一致的尾部余量：解码器可能越过平面末尾读写
+#define FRAME_POOL_PADDING (16 + 64 - 1)
+#define FRAME_POOL_ALIGN 64             // frame_pool_get_frame的行宽对齐，满足AVX-512和swscale
+
+// AVBufferPool需要新缓冲区时调用，池里有空闲缓冲区时不会走到这里
+static AVBufferRef *frame_pool_alloc(void *opaque, int size) {
+    FramePool *fp = (FramePool *)opaque;
+    AVBufferRef *buf = av_buffer_alloc(size);
+
+    if (buf) {
+        atomic_fetch_add(&fp->allocs, 1);
+        atomic_fetch_add(&fp->alloc_bytes, size);
+        atomic_store(&fp->last_alloc_get, atomic_load(&fp->gets));
+        if (fp->heap_count) {
+            atomic_store(&fp->heap_base, (long long)fp->heap_count());
+        }
+    }
+    return buf;
+}
+
+// 按大小找到对应的池，没有时新建；调用者持有mutex
+static AVBufferPool *frame_pool_lookup(FramePool *fp, int size) {
+    for (int i = 0; i < fp->nb_entries; i++) {
+        if (fp->entries[i].size == size) {
+            return fp->entries[i].pool;
+        }
+    }
+
+    // 淘汰最早建立的池，已经借出的缓冲区归还后它才真正释放
+    if (fp->nb_entries == FRAME_POOL_MAX_SIZES) {
+        av_buffer_pool_uninit(&fp->entries[0].pool);
+        memmove(&fp->entries[0], &fp->entries[1], (FRAME_POOL_MAX_SIZES - 1) * sizeof(FramePoolEntry));
+        fp->nb_entries--;
+    }
+
+    AVBufferPool *pool = av_buffer_pool_init2(size, fp, frame_pool_alloc, NULL);
+    if (pool) {
+        fp->entries[fp->nb_entries].size = size;
+        fp->entries[fp->nb_entries].pool = pool;
+        fp->nb_entries++;
+    }
+    return pool;
+}
+
+// 按行宽和高度计算各平面大小，每个平面从对应大小的池里取一块缓冲区
+static int frame_pool_fill(FramePool *fp, AVFrame *frame, int h, const int linesize[4]) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int planes = av_pix_fmt_count_planes(frame->format);
+    int size[4] = {0};
+    int i;
+
+    // 平面1、2是色度，高度按log2_chroma_h缩小，与av_image_fill_pointers的计算一致。
+    // 不能用NULL基址调av_image_fill_pointers取偏移：FFmpeg 4.4起基址为NULL时所有指针都是NULL
+    if (!desc || planes <= 0 || planes > 4) {
+        return AVERROR(EINVAL);
+    }
+    for (i = 0; i < planes; i++) {
+        int plane_h = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(h, desc->log2_chroma_h) : h;
+        if (linesize[i] <= 0 || (int64_t)linesize[i] * plane_h > INT_MAX - FRAME_POOL_PADDING) {
+            return AVERROR(EINVAL);
+        }
+        size[i] = linesize[i] * plane_h;
+    }
+
+    memset(frame->buf, 0, sizeof(frame->buf));
+    memset(frame->data, 0, sizeof(frame->data));
+    memset(frame->linesize, 0, sizeof(frame->linesize));
+
+    atomic_fetch_add(&fp->gets, 1);
+    SDL_LockMutex(fp->mutex);
+    for (i = 0; i < 4 && size[i] > 0; i++) {
+        AVBufferPool *pool = frame_pool_lookup(fp, size[i] + FRAME_POOL_PADDING);
+        frame->buf[i] = pool ? av_buffer_pool_get(pool) : NULL;
+        if (!frame->buf[i]) {
+            SDL_UnlockMutex(fp->mutex);
+            goto fail;
+        }
+        frame->data[i] = frame->buf[i]->data;
+        frame->linesize[i] = linesize[i];
+    }
+    SDL_UnlockMutex(fp->mutex);
+    frame->extended_data = frame->data;
+    return 0;
+
+fail:
+    for (i = 0; i < 4; i++) {
+        av_buffer_unref(&frame->buf[i]);
+    }
+    return AVERROR(ENOMEM);
+}
+
+// 解码器的get_buffer2：平面布局和对齐按libavcodec的默认实现计算
+static int frame_pool_get_buffer2(AVCodecContext *s, AVFrame *frame, int flags) {
+    FramePool *fp = (FramePool *)s->opaque;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int linesize[4];
+    int w = frame->width, h = frame->height;
+    int ret, unaligned, i;
+
+    if (s->codec_type != AVMEDIA_TYPE_VIDEO || !desc || s->hw_frames_ctx ||
+        (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) ||
+        !(s->codec->capabilities & AV_CODEC_CAP_DR1)) {
+        atomic_fetch_add(&fp->fallbacks, 1);
+        return avcodec_default_get_buffer2(s, frame, flags);
+    }
+
+    // 对齐宽高，再增大宽度直到每个平面的行宽都满足SIMD对齐
+    avcodec_align_dimensions2(s, &w, &h, linesize_align);
+    do {
+        ret = av_image_fill_linesizes(linesize, frame->format, w);
+        if (ret < 0) {
+            return ret;
+        }
+        w += w & ~(w - 1);
+        unaligned = 0;
+        for (i = 0; i < 4; i++) {
+            unaligned |= linesize[i] % linesize_align[i];
+        }
+    } while (unaligned);
+
+    return frame_pool_fill(fp, frame, h, linesize);
+}
+
+// 不经过解码器从池里取一帧：按frame->format/width/height分配，用于缩放等后处理的输出
+int frame_pool_get_frame(FramePool *fp, AVFrame *frame) {
+    int linesize[4];
+    int ret = av_image_fill_linesizes(linesize, frame->format, FFALIGN(frame->width, FRAME_POOL_ALIGN));
+    if (ret < 0) {
+        return ret;
+    }
+    for (int i = 0; i < 4; i++) {
+        linesize[i] = FFALIGN(linesize[i], FRAME_POOL_ALIGN);
+    }
+    return frame_pool_fill(fp, frame, FFALIGN(frame->height, 2), linesize);
+}
+
+int frame_pool_init(FramePool *fp) {
+    memset(fp, 0, sizeof(FramePool));
+    fp->mutex = SDL_CreateMutex();
+    if (!fp->mutex) {
+        return -1;
+    }
+    atomic_init(&fp->allocs, 0);
+    atomic_init(&fp->alloc_bytes, 0);
+    atomic_init(&fp->gets, 0);
+    atomic_init(&fp->last_alloc_get, 0);
+    atomic_init(&fp->fallbacks, 0);
+    // 基准测试LD_PRELOAD了alloc_count.so时用它的计数验证稳定阶段的堆分配，平时找不到这个符号
+    fp->heap_count = (unsigned long (*)(void))dlsym(RTLD_DEFAULT, "alloc_count_get");
+    atomic_init(&fp->heap_base, fp->heap_count ? (long long)fp->heap_count() : 0);
+    return 0;
+}
+
+// 释放所有池；已借出的缓冲区仍然有效，归还时释放。必须在解码器关闭之后调用
+void frame_pool_destroy(FramePool *fp) {
+    for (int i = 0; i < fp->nb_entries; i++) {
+        av_buffer_pool_uninit(&fp->entries[i].pool);
+    }
+    fp->nb_entries = 0;
+    if (fp->mutex) {
+        SDL_DestroyMutex(fp->mutex);
+        fp->mutex = NULL;
+    }
+}
+
+// 让解码器从池里取帧缓冲区，在avcodec_open2之前调用
+void frame_pool_attach(FramePool *fp, AVCodecContext *ctx) {
+    ctx->opaque = fp;
+    ctx->get_buffer2 = frame_pool_get_buffer2;
+#if LIBAVCODEC_VERSION_MAJOR < 60
+    // 帧级多线程时允许在工作线程上直接调用get_buffer2，否则会被串行化到解码线程
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    ctx->thread_safe_callbacks = 1;
+#pragma GCC diagnostic pop
+#endif
+}
+
+void frame_pool_get_stats(FramePool *fp, FramePoolStats *stats) {
+    stats->allocs = atomic_load(&fp->allocs);
+    stats->alloc_bytes = atomic_load(&fp->alloc_bytes);
+    stats->gets = atomic_load(&fp->gets);
+    stats->last_alloc_get = atomic_load(&fp->last_alloc_get);
+    stats->fallbacks = atomic_load(&fp->fallbacks);
+    stats->steady_heap_allocs = fp->heap_count ? (int64_t)fp->heap_count() - atomic_load(&fp->heap_base) : -1;
+}
+
+// 一行统计：最后一次新分配之后的帧都复用了池里的像素缓冲区；
+// 只统计像素缓冲区，每帧的AVBufferRef等小块头部仍由av_buffer_pool_get分配。
+// 加载了alloc_count.so时再给出这段时间整个进程(解复用、音频等所有线程)实际的堆分配次数
+void frame_pool_print(FramePool *fp, FILE *f) {
+    FramePoolStats stats;
+    int64_t steady;
+
+    frame_pool_get_stats(fp, &stats);
+    steady = stats.gets - stats.last_alloc_get;
+    fprintf(f, "frame pool: %lld frames, %lld pixel buffers allocated (%.1f MB), last allocation at frame %lld, "
+               "%lld frames since without new pixel buffers (AVBufferRef headers are still allocated per frame), "
+               "%lld fallback frames\n",
+            (long long)stats.gets, (long long)stats.allocs, stats.alloc_bytes / (1024.0 * 1024.0),
+            (long long)stats.last_alloc_get, (long long)steady, (long long)stats.fallbacks);
+    if (stats.steady_heap_allocs >= 0 && steady > 0) {
+        fprintf(f, "frame pool: %lld heap allocations in the whole process over those %lld frames (%.1f per frame)\n",
+                (long long)stats.steady_heap_allocs, (long long)steady, (double)stats.steady_heap_allocs / steady);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+
+// 同时保留的不同缓冲区大小(分辨率/像素格式)，超过时淘汰最早建立的
+#define FRAME_POOL_MAX_SIZES 8
+
+typedef struct FramePoolEntry {
+    int size;                   // 每块缓冲区的字节数
+    AVBufferPool *pool;
+} FramePoolEntry;
+
+/**
+ * ! 解码帧缓冲池
+ *
+ * 作为解码器的get_buffer2，按平面大小从AVBufferPool取缓冲区。
+ * 帧的引用随图像队列传递，显示端av_frame_unref后缓冲区回到池里，
+ * 稳定播放时不再为像素分配内存(每帧的AVBufferRef头部仍会分配)。分辨率变化时按新的大小建新池，
+ * 被淘汰的池在最后一个缓冲区归还后释放。
+ * 不支持直接渲染(DR1)的解码器、硬件帧和调色板格式使用默认分配。
+ * 进程LD_PRELOAD了script/alloc_count.so时，同时记录稳定阶段整个进程的堆分配次数。
+ */
+typedef struct FramePool {
+    FramePoolEntry entries[FRAME_POOL_MAX_SIZES];
+    int nb_entries;
+    SDL_mutex *mutex;           // get_buffer2可能在多个解码线程上同时调用
+
+    // 计数
+    atomic_llong allocs;        // 新分配的缓冲区数
+    atomic_llong alloc_bytes;
+    atomic_llong gets;          // 交给解码器的缓冲区数
+    atomic_llong last_alloc_get; // 最后一次新分配发生在第几次get
+    atomic_llong fallbacks;     // 走默认分配的帧数
+    unsigned long (*heap_count)(void); // alloc_count.so的计数函数，没有加载时为NULL
+    atomic_llong heap_base;     // 最后一次新分配时进程的堆分配次数
+} FramePool;
+
+typedef struct FramePoolStats {
+    int64_t allocs;
+    int64_t alloc_bytes;
+    int64_t gets;
+    int64_t last_alloc_get;
+    int64_t fallbacks;
+    int64_t steady_heap_allocs; // 最后一次新分配之后整个进程的堆分配次数，没有计数器时为-1
+} FramePoolStats;
+
+int frame_pool_init(FramePool *fp);
+void frame_pool_destroy(FramePool *fp);
+void frame_pool_attach(FramePool *fp, AVCodecContext *ctx);
+int frame_pool_get_frame(FramePool *fp, AVFrame *frame);
+void frame_pool_get_stats(FramePool *fp, FramePoolStats *stats);
+void frame_pool_print(FramePool *fp, FILE *f);
+
+#endif
@@ -0,0 +1,297 @@
+#include "frame_writer.h"
+#include <libavutil/imgutils.h>
+#include <stdio.h>
+#include <string.h>
+
+// 每个写线程自己的输出缓冲和PNG编码器
+struct WriterThread {
+    FrameWriter *writer;
+    pthread_t tid;
+    uint8_t *out_buf;           // 组装好的整个文件内容
+    unsigned int out_size;
+    AVCodecContext *png_ctx;
+    AVFrame *png_frame;
+    AVPacket *pkt;
+};
+
+const char *frame_format_ext(int format) {
+    return format == FRAME_FORMAT_PNG ? "png" : "ppm";
+}
+
+// 一次写出整个文件，不经过stdio缓冲
+static int write_file(const char *path, const uint8_t *data, size_t size) {
+    FILE *pFile = fopen(path, "wb");
+    if (pFile == NULL) {
+        return -1;
+    }
+    setvbuf(pFile, NULL, _IONBF, 0);
+    size_t n = fwrite(data, 1, size, pFile);
+    int ret = fclose(pFile);
+    return (n == size && ret == 0) ? 0 : -1;
+}
+
+// 把PPM文件头和去掉行对齐的RGB数据组装到线程缓冲区
+static int encode_ppm(WriterThread *t, WriteJob *job, const uint8_t **out, size_t *out_size) {
+    char header[32];
+    int header_len = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", job->width, job->height);
+    size_t row = (size_t)job->width * 3;
+    size_t size = header_len + row * job->height;
+
+    av_fast_malloc(&t->out_buf, &t->out_size, size);
+    if (!t->out_buf) {
+        return -1;
+    }
+
+    memcpy(t->out_buf, header, header_len);
+    uint8_t *dst = t->out_buf + header_len;
+    for (int y = 0; y < job->height; y++) {
+        memcpy(dst, job->data[0] + y * job->linesize[0], row);
+        dst += row;
+    }
+
+    *out = t->out_buf;
+    *out_size = size;
+    return 0;
+}
+
+// 用libavcodec的PNG编码器编码，尺寸变化时重建编码器
+static int encode_png(WriterThread *t, WriteJob *job, const uint8_t **out, size_t *out_size) {
+    if (!t->png_ctx || t->png_ctx->width != job->width || t->png_ctx->height != job->height) {
+        avcodec_free_context(&t->png_ctx);
+
+        AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+        if (!codec) {
+            return -1;
+        }
+        t->png_ctx = avcodec_alloc_context3(codec);
+        if (!t->png_ctx) {
+            return -1;
+        }
+        t->png_ctx->width = job->width;
+        t->png_ctx->height = job->height;
+        t->png_ctx->pix_fmt = AV_PIX_FMT_RGB24;
+        t->png_ctx->time_base = (AVRational){1, 25};
+        // 多个写线程已经并行，编码器本身不再开线程
+        t->png_ctx->thread_count = 1;
+        if (avcodec_open2(t->png_ctx, codec, NULL) < 0) {
+            avcodec_free_context(&t->png_ctx);
+            return -1;
+        }
+    }
+
+    AVFrame *frame = t->png_frame;
+    memcpy(frame->data, job->data, sizeof(job->data));
+    memcpy(frame->linesize, job->linesize, sizeof(job->linesize));
+    frame->width = job->width;
+    frame->height = job->height;
+    frame->format = AV_PIX_FMT_RGB24;
+    frame->pts = job->index;
+
+    av_packet_unref(t->pkt);
+    if (avcodec_send_frame(t->png_ctx, frame) < 0 ||
+        avcodec_receive_packet(t->png_ctx, t->pkt) < 0) {
+        return -1;
+    }
+
+    *out = t->pkt->data;
+    *out_size = t->pkt->size;
+    return 0;
+}
+
+static int write_job(WriterThread *t, WriteJob *job) {
+    FrameWriter *w = t->writer;
+    char szFilename[1024];
+    const uint8_t *data;
+    size_t size;
+    int ret;
+
+    // 构建完整的文件路径
+    #ifdef _WIN32
+        snprintf(szFilename, sizeof(szFilename), "%s\\frame%d.%s", w->outdir, job->index, frame_format_ext(w->format));
+    #else
+        snprintf(szFilename, sizeof(szFilename), "%s/frame%d.%s", w->outdir, job->index, frame_format_ext(w->format));
+    #endif
+
+    if (w->format == FRAME_FORMAT_PNG) {
+        ret = encode_png(t, job, &data, &size);
+    } else {
+        ret = encode_ppm(t, job, &data, &size);
+    }
+    if (ret < 0) {
+        printf("错误：无法编码帧 %d\n", job->index);
+        return -1;
+    }
+
+    if (write_file(szFilename, data, size) < 0) {
+        printf("错误：无法写入文件 '%s'\n", szFilename);
+        return -1;
+    }
+    return (int)FFMIN(size, (size_t)INT32_MAX);
+}
+
+static void *writer_thread(void *arg) {
+    WriterThread *t = (WriterThread *)arg;
+    FrameWriter *w = t->writer;
+
+    for (;;) {
+        pthread_mutex_lock(&w->mutex);
+        while (w->count == 0 && !w->closing) {
+            pthread_cond_wait(&w->job_ready, &w->mutex);
+        }
+        if (w->count == 0) {
+            // 正在关闭且队列已空
+            pthread_mutex_unlock(&w->mutex);
+            break;
+        }
+        WriteJob *job = w->queue[w->rindex];
+        w->rindex = (w->rindex + 1) % w->nb_jobs;
+        w->count--;
+        pthread_mutex_unlock(&w->mutex);
+
+        int written = write_job(t, job);
+
+        pthread_mutex_lock(&w->mutex);
+        if (written < 0) {
+            w->errors++;
+        } else {
+            w->written++;
+            w->bytes += written;
+        }
+        w->free_jobs[w->nb_free++] = job;
+        pthread_cond_signal(&w->job_free);
+        pthread_mutex_unlock(&w->mutex);
+    }
+    return NULL;
+}
+
+FrameWriter *frame_writer_create(const char *outdir, int format, int nb_threads, int nb_jobs) {
+    FrameWriter *w = av_mallocz(sizeof(FrameWriter));
+    if (!w) {
+        return NULL;
+    }
+
+    snprintf(w->outdir, sizeof(w->outdir), "%s", outdir);
+    w->format = format;
+    w->nb_jobs = FFMAX(nb_jobs, nb_threads + 1);
+    w->jobs = av_mallocz(w->nb_jobs * sizeof(WriteJob));
+    w->free_jobs = av_mallocz(w->nb_jobs * sizeof(WriteJob *));
+    w->queue = av_mallocz(w->nb_jobs * sizeof(WriteJob *));
+    w->threads = av_mallocz(nb_threads * sizeof(WriterThread));
+    if (!w->jobs || !w->free_jobs || !w->queue || !w->threads) {
+        av_free(w->jobs);
+        av_free(w->free_jobs);
+        av_free(w->queue);
+        av_free(w->threads);
+        av_free(w);
+        return NULL;
+    }
+    for (int i = 0; i < w->nb_jobs; i++) {
+        w->free_jobs[w->nb_free++] = &w->jobs[i];
+    }
+
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->job_ready, NULL);
+    pthread_cond_init(&w->job_free, NULL);
+
+    for (int i = 0; i < nb_threads; i++) {
+        WriterThread *t = &w->threads[i];
+        t->writer = w;
+        t->png_frame = av_frame_alloc();
+        t->pkt = av_packet_alloc();
+        if (!t->png_frame || !t->pkt || pthread_create(&t->tid, NULL, writer_thread, t) != 0) {
+            av_frame_free(&t->png_frame);
+            av_packet_free(&t->pkt);
+            printf("无法创建写线程\n");
+            break;
+        }
+        w->nb_threads++;
+    }
+    if (w->nb_threads == 0) {
+        frame_writer_close(w, NULL, NULL);
+        return NULL;
+    }
+    return w;
+}
+
+// 取一个空闲任务并按尺寸准备好对齐的RGB缓冲区，所有任务都在写时阻塞
+WriteJob *frame_writer_acquire(FrameWriter *w, int width, int height) {
+    WriteJob *job;
+
+    pthread_mutex_lock(&w->mutex);
+    while (w->nb_free == 0) {
+        pthread_cond_wait(&w->job_free, &w->mutex);
+    }
+    job = w->free_jobs[--w->nb_free];
+    pthread_mutex_unlock(&w->mutex);
+
+    int size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, width, height, RGB_ALIGN);
+    if (size < 0) {
+        frame_writer_release(w, job);
+        return NULL;
+    }
+    av_fast_malloc(&job->buffer, &job->buffer_size, size);
+    if (!job->buffer) {
+        frame_writer_release(w, job);
+        return NULL;
+    }
+    av_image_fill_arrays(job->data, job->linesize, job->buffer, AV_PIX_FMT_RGB24, width, height, RGB_ALIGN);
+    job->width = width;
+    job->height = height;
+    return job;
+}
+
+void frame_writer_submit(FrameWriter *w, WriteJob *job, int index) {
+    job->index = index;
+
+    pthread_mutex_lock(&w->mutex);
+    w->queue[w->windex] = job;
+    w->windex = (w->windex + 1) % w->nb_jobs;
+    w->count++;
+    pthread_cond_signal(&w->job_ready);
+    pthread_mutex_unlock(&w->mutex);
+}
+
+// 不写出，直接归还任务
+void frame_writer_release(FrameWriter *w, WriteJob *job) {
+    pthread_mutex_lock(&w->mutex);
+    w->free_jobs[w->nb_free++] = job;
+    pthread_cond_signal(&w->job_free);
+    pthread_mutex_unlock(&w->mutex);
+}
+
+// 等待所有任务写完，结束线程并释放资源，返回写失败的帧数
+int frame_writer_close(FrameWriter *w, int64_t *written, int64_t *bytes) {
+    pthread_mutex_lock(&w->mutex);
+    w->closing = 1;
+    pthread_cond_broadcast(&w->job_ready);
+    pthread_mutex_unlock(&w->mutex);
+
+    for (int i = 0; i < w->nb_threads; i++) {
+        WriterThread *t = &w->threads[i];
+        pthread_join(t->tid, NULL);
+        av_free(t->out_buf);
+        avcodec_free_context(&t->png_ctx);
+        av_frame_free(&t->png_frame);
+        av_packet_free(&t->pkt);
+    }
+
+    int errors = w->errors;
+    if (written) {
+        *written = w->written;
+    }
+    if (bytes) {
+        *bytes = w->bytes;
+    }
+    for (int i = 0; i < w->nb_jobs; i++) {
+        av_free(w->jobs[i].buffer);
+    }
+    pthread_mutex_destroy(&w->mutex);
+    pthread_cond_destroy(&w->job_ready);
+    pthread_cond_destroy(&w->job_free);
+    av_free(w->jobs);
+    av_free(w->free_jobs);
+    av_free(w->queue);
+    av_free(w->threads);
+    av_free(w);
+    return errors;
+}
@@ -0,0 +1,66 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <libavcodec/avcodec.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// RGB缓冲区行对齐，满足swscale SIMD路径(SSE/AVX/AVX-512)的要求
+#define RGB_ALIGN 64
+
+// 输出格式
+enum {
+    FRAME_FORMAT_PPM,
+    FRAME_FORMAT_PNG,
+};
+
+// 一帧待写出的RGB24图像，缓冲区在任务之间复用
+typedef struct WriteJob {
+    uint8_t *data[4];
+    int linesize[4];
+    uint8_t *buffer;
+    unsigned int buffer_size;
+    int width, height;
+    int index;                  // 输出文件编号
+} WriteJob;
+
+typedef struct WriterThread WriterThread;
+
+/**
+ * ! 并行帧写出器
+ * 解码循环用frame_writer_acquire取一个空闲任务，把RGB直接转换进任务缓冲区，
+ * 再用frame_writer_submit交给写线程。任务数有上限，写盘跟不上时acquire阻塞。
+ */
+typedef struct FrameWriter {
+    char outdir[512];
+    int format;
+
+    WriterThread *threads;
+    int nb_threads;
+
+    WriteJob *jobs;             // 所有任务
+    int nb_jobs;
+    WriteJob **free_jobs;       // 空闲任务栈
+    int nb_free;
+    WriteJob **queue;           // 待写任务环形队列
+    int rindex, windex, count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t job_ready;   // 有待写任务
+    pthread_cond_t job_free;    // 有空闲任务
+    int closing;
+
+    // 统计
+    int64_t written;
+    int64_t bytes;
+    int errors;
+} FrameWriter;
+
+FrameWriter *frame_writer_create(const char *outdir, int format, int nb_threads, int nb_jobs);
+WriteJob *frame_writer_acquire(FrameWriter *w, int width, int height);
+void frame_writer_submit(FrameWriter *w, WriteJob *job, int index);
+void frame_writer_release(FrameWriter *w, WriteJob *job);
+int frame_writer_close(FrameWriter *w, int64_t *written, int64_t *bytes);
+const char *frame_format_ext(int format);
+
+#endif
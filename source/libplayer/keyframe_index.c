@@ -0,0 +1,272 @@
+#include "keyframe_index.h"
+#include <libavutil/time.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define KEYFRAME_INDEX_MAGIC "KFIX"
+#define KEYFRAME_INDEX_VERSION 1
+
+// 索引文件头，按本机字节序直接写入，只作为本机缓存使用
+typedef struct KeyframeIndexHeader {
+    char magic[4];
+    int32_t version;
+    int32_t stream_index;
+    int32_t tb_num, tb_den;
+    int32_t reserved;
+    int64_t file_size;          // 输入文件的大小和修改时间，不一致时索引作废
+    int64_t file_mtime;
+    int64_t nb_entries;
+} KeyframeIndexHeader;
+
+static void sidecar_path(const KeyframeIndex *idx, char *path, size_t size) {
+    snprintf(path, size, "%s%s", idx->filename, KEYFRAME_INDEX_SUFFIX);
+}
+
+// 追加一个关键帧，时间戳必须递增
+static int index_add(KeyframeIndex *idx, int64_t ts, int64_t pos) {
+    int ret = 0;
+
+    SDL_LockMutex(idx->mutex);
+    if (idx->nb_entries > 0 && ts <= idx->entries[idx->nb_entries - 1].ts) {
+        SDL_UnlockMutex(idx->mutex);
+        return 0;
+    }
+    if (idx->nb_entries >= idx->capacity) {
+        int capacity = idx->capacity ? idx->capacity * 2 : 256;
+        KeyframeEntry *entries = av_realloc_array(idx->entries, capacity, sizeof(KeyframeEntry));
+        if (!entries) {
+            ret = -1;
+        } else {
+            idx->entries = entries;
+            idx->capacity = capacity;
+        }
+    }
+    if (ret == 0) {
+        idx->entries[idx->nb_entries].ts = ts;
+        idx->entries[idx->nb_entries].pos = pos;
+        idx->nb_entries++;
+    }
+    SDL_UnlockMutex(idx->mutex);
+    return ret;
+}
+
+// 读取索引文件，输入文件被修改过或格式不对时返回-1
+static int index_load(KeyframeIndex *idx) {
+    KeyframeIndexHeader header;
+    struct stat st;
+    char path[1100];
+    FILE *file;
+
+    if (stat(idx->filename, &st) != 0) {
+        return -1;
+    }
+    sidecar_path(idx, path, sizeof(path));
+    file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, KEYFRAME_INDEX_MAGIC, 4) != 0 ||
+        header.version != KEYFRAME_INDEX_VERSION ||
+        header.stream_index != idx->stream_index ||
+        header.file_size != (int64_t)st.st_size ||
+        header.file_mtime != (int64_t)st.st_mtime ||
+        header.tb_den <= 0 || header.nb_entries <= 0 || header.nb_entries > INT_MAX) {
+        fclose(file);
+        return -1;
+    }
+
+    idx->entries = av_malloc_array(header.nb_entries, sizeof(KeyframeEntry));
+    if (!idx->entries ||
+        fread(idx->entries, sizeof(KeyframeEntry), header.nb_entries, file) != (size_t)header.nb_entries) {
+        av_freep(&idx->entries);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    idx->nb_entries = idx->capacity = (int)header.nb_entries;
+    idx->time_base = (AVRational){header.tb_num, header.tb_den};
+    atomic_store(&idx->complete, 1);
+    return 0;
+}
+
+// 写回索引文件，失败(例如目录只读)时只打印提示
+static void index_save(KeyframeIndex *idx) {
+    KeyframeIndexHeader header;
+    struct stat st;
+    char path[1100];
+    FILE *file;
+
+    if (stat(idx->filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KEYFRAME_INDEX_MAGIC, 4);
+    header.version = KEYFRAME_INDEX_VERSION;
+    header.stream_index = idx->stream_index;
+    header.tb_num = idx->time_base.num;
+    header.tb_den = idx->time_base.den;
+    header.file_size = st.st_size;
+    header.file_mtime = st.st_mtime;
+    header.nb_entries = idx->nb_entries;
+
+    sidecar_path(idx, path, sizeof(path));
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "keyframe index: could not write %s\n", path);
+        return;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(idx->entries, sizeof(KeyframeEntry), idx->nb_entries, file) != (size_t)idx->nb_entries) {
+        fprintf(stderr, "keyframe index: could not write %s\n", path);
+        fclose(file);
+        remove(path);
+        return;
+    }
+    fclose(file);
+}
+
+static int index_interrupt_cb(void *opaque) {
+    KeyframeIndex *idx = (KeyframeIndex *)opaque;
+    return atomic_load(&idx->abort);
+}
+
+// 后台扫描线程：只读包不解码，记录目标流的关键帧
+static int index_build_thread(void *arg) {
+    KeyframeIndex *idx = (KeyframeIndex *)arg;
+    AVFormatContext *ic;
+    AVPacket packet;
+    int64_t start = av_gettime_relative();
+    int ret;
+
+    ic = avformat_alloc_context();
+    if (!ic) {
+        return -1;
+    }
+    ic->interrupt_callback.callback = index_interrupt_cb;
+    ic->interrupt_callback.opaque = idx;
+    if (avformat_open_input(&ic, idx->filename, NULL, NULL) != 0) {
+        fprintf(stderr, "keyframe index: could not open %s\n", idx->filename);
+        return -1;
+    }
+    if ((unsigned int)idx->stream_index >= ic->nb_streams) {
+        avformat_close_input(&ic);
+        return -1;
+    }
+
+    // 其它流的包直接丢弃
+    for (unsigned int i = 0; i < ic->nb_streams; i++) {
+        if ((int)i != idx->stream_index) {
+            ic->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    SDL_LockMutex(idx->mutex);
+    idx->time_base = ic->streams[idx->stream_index]->time_base;
+    SDL_UnlockMutex(idx->mutex);
+
+    av_init_packet(&packet);
+    while ((ret = av_read_frame(ic, &packet)) >= 0) {
+        if (packet.stream_index == idx->stream_index && (packet.flags & AV_PKT_FLAG_KEY)) {
+            int64_t ts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            if (ts != AV_NOPTS_VALUE && index_add(idx, ts, packet.pos) < 0) {
+                av_packet_unref(&packet);
+                break;
+            }
+        }
+        av_packet_unref(&packet);
+    }
+    avformat_close_input(&ic);
+
+    if (ret != AVERROR_EOF || atomic_load(&idx->abort)) {
+        return 0;
+    }
+
+    idx->build_time = (av_gettime_relative() - start) / 1000000.0;
+    atomic_store(&idx->complete, 1);
+    fprintf(stderr, "keyframe index: %d keyframes in %.2f s\n", idx->nb_entries, idx->build_time);
+    if (idx->nb_entries > 0) {
+        index_save(idx);
+    }
+    return 0;
+}
+
+// 打开关键帧索引：读取索引文件，没有时启动后台扫描
+int keyframe_index_open(KeyframeIndex *idx, const char *filename, int stream_index, AVRational time_base) {
+    memset(idx, 0, sizeof(KeyframeIndex));
+    strncpy(idx->filename, filename, sizeof(idx->filename) - 1);
+    idx->stream_index = stream_index;
+    idx->time_base = time_base;
+    atomic_init(&idx->complete, 0);
+    atomic_init(&idx->abort, 0);
+
+    idx->mutex = SDL_CreateMutex();
+    if (!idx->mutex) {
+        return -1;
+    }
+
+    if (index_load(idx) == 0) {
+        fprintf(stderr, "keyframe index: loaded %d keyframes from %s%s\n",
+                idx->nb_entries, filename, KEYFRAME_INDEX_SUFFIX);
+        return 0;
+    }
+
+    idx->tid = SDL_CreateThread(index_build_thread, "index_thread", idx);
+    if (!idx->tid) {
+        fprintf(stderr, "keyframe index: could not create thread\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 查找ts之前(含)最近的关键帧，ts和返回的entry->ts都使用time_base
+// 目标超出已扫描的范围时返回-1，由调用者退回到解复用器自己的seek
+int keyframe_index_lookup(KeyframeIndex *idx, int64_t ts, AVRational time_base, KeyframeEntry *entry) {
+    int lo, hi, ret = -1;
+
+    if (!idx->mutex) {
+        return -1;
+    }
+
+    SDL_LockMutex(idx->mutex);
+    if (idx->nb_entries > 0 && idx->time_base.den > 0) {
+        int64_t target = av_rescale_q(ts, time_base, idx->time_base);
+
+        if (target <= idx->entries[idx->nb_entries - 1].ts || atomic_load(&idx->complete)) {
+            // 二分查找最后一个ts <= target的关键帧
+            lo = 0;
+            hi = idx->nb_entries - 1;
+            while (lo < hi) {
+                int mid = (lo + hi + 1) / 2;
+                if (idx->entries[mid].ts <= target) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+            entry->ts = av_rescale_q(idx->entries[lo].ts, idx->time_base, time_base);
+            entry->pos = idx->entries[lo].pos;
+            ret = 0;
+        }
+    }
+    SDL_UnlockMutex(idx->mutex);
+    return ret;
+}
+
+// 停止后台扫描并释放索引
+void keyframe_index_close(KeyframeIndex *idx) {
+    atomic_store(&idx->abort, 1);
+    if (idx->tid) {
+        SDL_WaitThread(idx->tid, NULL);
+        idx->tid = NULL;
+    }
+    if (idx->mutex) {
+        SDL_DestroyMutex(idx->mutex);
+        idx->mutex = NULL;
+    }
+    av_freep(&idx->entries);
+    idx->nb_entries = idx->capacity = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef KEYFRAME_INDEX_H
+#define KEYFRAME_INDEX_H
+
+#include <libavformat/avformat.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+
+// 索引文件后缀，保存在输入文件旁边
+#define KEYFRAME_INDEX_SUFFIX ".kfidx"
+
+// 一个关键帧的位置
+typedef struct KeyframeEntry {
+    int64_t ts;                 // 时间戳(索引的time_base)
+    int64_t pos;                // 包在文件中的字节位置，未知时为-1
+} KeyframeEntry;
+
+/**
+ * ! 关键帧索引
+ *
+ * 打开时先尝试读取旁边的索引文件(文件大小和修改时间一致才使用)，
+ * 否则用独立的AVFormatContext在后台线程只解复用不解码地扫描一遍，
+ * 扫描完成后写回索引文件。扫描过程中已经建立的部分也可以查询。
+ */
+typedef struct KeyframeIndex {
+    KeyframeEntry *entries;     // 按ts递增
+    int nb_entries;
+    int capacity;
+    AVRational time_base;       // entries中ts的时间基
+    int stream_index;
+    atomic_int complete;        // 已覆盖整个文件
+    atomic_int abort;           // 通知后台线程退出
+    SDL_mutex *mutex;           // 保护entries，后台线程追加、seek时查询
+    SDL_Thread *tid;            // 后台扫描线程
+    char filename[1024];
+    double build_time;          // 扫描耗时(秒)
+} KeyframeIndex;
+
+int keyframe_index_open(KeyframeIndex *idx, const char *filename, int stream_index, AVRational time_base);
+int keyframe_index_lookup(KeyframeIndex *idx, int64_t ts, AVRational time_base, KeyframeEntry *entry);
+void keyframe_index_close(KeyframeIndex *idx);
+
+#endif
@@ -0,0 +1,275 @@
+#include "packet_queue.h"
+#include <string.h>
+
+// flush标记包的data指向这里，size为0，不持有缓冲区
+static uint8_t flush_data;
+
+int packet_signal_init(PacketQueueSignal *s) {
+    s->mutex = SDL_CreateMutex();
+    s->cond = SDL_CreateCond();
+    atomic_init(&s->waiters, 0);
+    atomic_init(&s->size, 0);
+    s->max_size = 0;
+    return (s->mutex && s->cond) ? 0 : -1;
+}
+
+void packet_signal_destroy(PacketQueueSignal *s) {
+    if (s->mutex) {
+        SDL_DestroyMutex(s->mutex);
+        s->mutex = NULL;
+    }
+    if (s->cond) {
+        SDL_DestroyCond(s->cond);
+        s->cond = NULL;
+    }
+}
+
+// 等待方先增加waiters再检查条件，这里先修改队列状态再读waiters
+void packet_signal_wake(PacketQueueSignal *s) {
+    if (atomic_load(&s->waiters) > 0) {
+        SDL_LockMutex(s->mutex);
+        SDL_CondBroadcast(s->cond);
+        SDL_UnlockMutex(s->mutex);
+    }
+}
+
+// 共享这个信号的队列合计的字节数是否超过上限
+int packet_signal_full(PacketQueueSignal *s) {
+    return s->max_size > 0 && atomic_load(&s->size) > s->max_size;
+}
+
+// 取包的时间戳(微秒)，优先用单调递增的dts
+static int64_t packet_queue_ts(PacketQueue *q, const AVPacket *pkt) {
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (ts == AV_NOPTS_VALUE || q->time_base.den == 0)
+        return AV_NOPTS_VALUE;
+    return av_rescale_q(ts, q->time_base, AV_TIME_BASE_Q);
+}
+
+// 唤醒慢路径上等待的线程
+static void packet_queue_wake(PacketQueue *q) {
+    // 与packet_queue_wait中的waiters/索引读写构成顺序一致的配对，
+    // 保证要么等待方看到新的索引，要么这里看到waiters > 0
+    if (atomic_load(&q->waiters) > 0) {
+        SDL_LockMutex(q->mutex);
+        SDL_CondBroadcast(q->cond);
+        SDL_UnlockMutex(q->mutex);
+    }
+}
+
+// 队列为空(want_data)或已满时睡眠，直到状态改变或退出
+static void packet_queue_wait(PacketQueue *q, int want_data) {
+    SDL_LockMutex(q->mutex);
+    atomic_fetch_add(&q->waiters, 1);
+    for (;;) {
+        if (atomic_load(&q->quit))
+            break;
+        unsigned int head = atomic_load(&q->head);
+        unsigned int tail = atomic_load(&q->tail);
+        if (want_data ? (tail != head) : (tail - head < q->capacity))
+            break;
+        // 每次移动读写位置和退出都会唤醒，不需要超时
+        SDL_CondWait(q->cond, q->mutex);
+    }
+    atomic_fetch_sub(&q->waiters, 1);
+    SDL_UnlockMutex(q->mutex);
+}
+
+// 包队列初始化
+int packet_queue_init(PacketQueue *q) {
+    memset(q, 0, sizeof(PacketQueue));
+    q->capacity = PACKET_QUEUE_CAPACITY;
+    q->mask = q->capacity - 1;
+
+    q->ring = av_mallocz(q->capacity * sizeof(AVPacket *));
+    if (!q->ring)
+        return -1;
+    for (unsigned int i = 0; i < q->capacity; i++) {
+        q->ring[i] = av_packet_alloc();
+        if (!q->ring[i]) {
+            packet_queue_destroy(q);
+            return -1;
+        }
+    }
+
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->nb_packets, 0);
+    atomic_init(&q->size, 0);
+    atomic_init(&q->quit, 0);
+    atomic_init(&q->waiters, 0);
+    atomic_init(&q->flush_pending, 0);
+    atomic_init(&q->in_ts, AV_NOPTS_VALUE);
+    atomic_init(&q->out_ts, AV_NOPTS_VALUE);
+    q->time_base = (AVRational){0, 1};
+    q->min_duration = AV_TIME_BASE;
+    q->space = NULL;
+    q->mutex = SDL_CreateMutex();
+    q->cond = SDL_CreateCond();
+    return 0;
+}
+
+// 释放队列中剩余的包和槽位
+void packet_queue_destroy(PacketQueue *q) {
+    if (q->ring) {
+        for (unsigned int i = 0; i < q->capacity; i++) {
+            av_packet_free(&q->ring[i]);
+        }
+        av_freep(&q->ring);
+    }
+    if (q->mutex) {
+        SDL_DestroyMutex(q->mutex);
+        q->mutex = NULL;
+    }
+    if (q->cond) {
+        SDL_DestroyCond(q->cond);
+        q->cond = NULL;
+    }
+}
+
+// 包队列放入，接管pkt的引用；队列满时阻塞，退出时返回-1
+int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    for (;;) {
+        if (atomic_load(&q->quit)) {
+            av_packet_unref(pkt);
+            return -1;
+        }
+        unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail - head < q->capacity)
+            break;
+        packet_queue_wait(q, 0);
+    }
+
+    int pkt_size = pkt->size;
+    int64_t ts = packet_queue_ts(q, pkt);
+    av_packet_move_ref(q->ring[tail & q->mask], pkt);
+    atomic_fetch_add(&q->nb_packets, 1);
+    atomic_fetch_add(&q->size, pkt_size);
+    if (q->space)
+        atomic_fetch_add(&q->space->size, pkt_size);
+    if (ts != AV_NOPTS_VALUE) {
+        long long none = AV_NOPTS_VALUE;
+        atomic_store(&q->in_ts, ts);
+        // 还没有出过包时以第一个入队包为起点
+        atomic_compare_exchange_strong(&q->out_ts, &none, ts);
+    }
+    atomic_store(&q->tail, tail + 1);
+
+    packet_queue_wake(q);
+    return 0;
+}
+
+// 包队列取出
+// 有未取到的flush标记时，丢弃标记之前的包，把标记本身返回给调用者
+int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block) {
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    for (;;) {
+        if (atomic_load(&q->quit))
+            return -1;
+        unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (tail == head) {
+            if (!block)
+                return 0;
+            packet_queue_wait(q, 1);
+            continue;
+        }
+
+        AVPacket *slot = q->ring[head & q->mask];
+        int flush = packet_queue_is_flush(slot);
+        int64_t ts = flush ? AV_NOPTS_VALUE : packet_queue_ts(q, slot);
+        atomic_fetch_sub(&q->nb_packets, 1);
+        atomic_fetch_sub(&q->size, slot->size);
+        int64_t space_size = q->space ? atomic_fetch_sub(&q->space->size, slot->size) : 0;
+        if (flush) {
+            atomic_fetch_sub(&q->flush_pending, 1);
+            atomic_store(&q->out_ts, AV_NOPTS_VALUE);
+        } else if (ts != AV_NOPTS_VALUE) {
+            atomic_store(&q->out_ts, ts);
+        }
+        av_packet_move_ref(pkt, slot);
+        atomic_store(&q->head, ++head);
+
+        packet_queue_wake(q);
+        // 读包线程等待的条件(超过字节数上限，或者所有队列都足够)可能不再成立：
+        // 总字节数刚降到上限以内，或者在上限以内而这个队列不再足够
+        if (q->space && !packet_signal_full(q->space) &&
+            (!packet_queue_has_enough(q) || (q->space->max_size > 0 && space_size > q->space->max_size)))
+            packet_signal_wake(q->space);
+
+        if (!flush && atomic_load(&q->flush_pending) > 0) {
+            // flush之前读到的旧包
+            av_packet_unref(pkt);
+            continue;
+        }
+        return 1;
+    }
+}
+
+// 生产者调用：让消费者丢弃队列里已有的包，并在取到flush标记时冲刷解码器
+// 满足单生产者约束，不直接修改读位置
+int packet_queue_flush(PacketQueue *q) {
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt)
+        return -1;
+    pkt->data = &flush_data;
+    pkt->size = 0;
+    atomic_fetch_add(&q->flush_pending, 1);
+    atomic_store(&q->in_ts, AV_NOPTS_VALUE);
+    int ret = packet_queue_put(q, pkt);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+// 是否是packet_queue_flush放入的标记包
+int packet_queue_is_flush(const AVPacket *pkt) {
+    return pkt->data == &flush_data;
+}
+
+// 生产者调用：放入一个空包表示流结束，消费者取到后冲刷解码器中剩余的帧
+int packet_queue_put_eof(PacketQueue *q) {
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt)
+        return -1;
+    int ret = packet_queue_put(q, pkt);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+// 是否是packet_queue_put_eof放入的空包
+int packet_queue_is_eof(const AVPacket *pkt) {
+    return !pkt->data && !pkt->size && !pkt->side_data_elems;
+}
+
+// 设置队列退出标志并唤醒所有等待者
+void packet_queue_quit(PacketQueue *q) {
+    atomic_store(&q->quit, 1);
+    SDL_LockMutex(q->mutex);
+    SDL_CondBroadcast(q->cond);
+    SDL_UnlockMutex(q->mutex);
+    if (q->space)
+        packet_signal_wake(q->space);
+}
+
+// 队列中包的时间跨度(微秒)，时间戳未知时返回-1
+int64_t packet_queue_duration(PacketQueue *q) {
+    int64_t in = atomic_load(&q->in_ts);
+    int64_t out = atomic_load(&q->out_ts);
+    if (in == AV_NOPTS_VALUE || out == AV_NOPTS_VALUE || in < out)
+        return -1;
+    return in - out;
+}
+
+// 队列缓冲是否已经足够，读包线程据此决定是否继续读
+int packet_queue_has_enough(PacketQueue *q) {
+    if (atomic_load(&q->quit))
+        return 1;
+    if (atomic_load(&q->tail) - atomic_load(&q->head) >= q->capacity)
+        return 1;
+    int64_t duration = packet_queue_duration(q);
+    if (duration < 0)
+        return atomic_load(&q->nb_packets) > PACKET_QUEUE_MIN_PACKETS;
+    return atomic_load(&q->nb_packets) > 0 && duration >= q->min_duration;
+}
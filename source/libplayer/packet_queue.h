@@ -0,0 +1,75 @@
+#ifndef PACKET_QUEUE_H
+#define PACKET_QUEUE_H
+
+#include <libavcodec/avcodec.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+
+// 环形队列容量（必须是2的幂）
+#define PACKET_QUEUE_CAPACITY 1024
+// 时间戳未知时，按包数判断队列是否足够
+#define PACKET_QUEUE_MIN_PACKETS 25
+
+/**
+ * ! 队列腾出空间时唤醒读包线程的条件
+ * 可以被多个队列共享，同时统计这些队列的总字节数。读包线程在总字节数超过max_size、
+ * 或者每个队列都"足够"时等待；消费者取包后总字节数刚降到上限以内，
+ * 或者总字节数在上限以内而这个队列不再"足够"时发信号
+ */
+typedef struct PacketQueueSignal {
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    atomic_int waiters;         // 正在等待的线程数
+    atomic_llong size;          // 共享这个信号的队列里的字节数之和
+    int64_t max_size;           // size的上限，0表示不限；在队列开始使用之前设置
+} PacketQueueSignal;
+
+/**
+ * ! 单生产者/单消费者无锁包队列
+ *
+ * 生产者(decode_thread)只写tail，消费者(video_thread/音频)只写head，
+ * 两端都通过原子变量同步，快路径上不加锁也不分配内存。
+ * 槽位里的AVPacket在初始化时一次性分配，入队/出队只做av_packet_move_ref。
+ * 只有队列为空(消费者)或已满(生产者)时才在mutex/cond上睡眠。
+ */
+typedef struct PacketQueue {
+    AVPacket **ring;            // 预分配的包槽位
+    unsigned int capacity;      // 槽位数
+    unsigned int mask;          // capacity - 1
+    atomic_uint head;           // 读位置，只有消费者修改
+    atomic_uint tail;           // 写位置，只有生产者修改
+    atomic_int nb_packets;      // 队列中的包数
+    atomic_int size;            // 队列中的字节数
+    atomic_int quit;            // 退出标志
+    atomic_int waiters;         // 正在慢路径上睡眠的线程数
+    atomic_int flush_pending;   // 已入队但消费者还没取到的flush标记数
+    SDL_mutex *mutex;           // 仅用于睡眠/唤醒
+    SDL_cond *cond;
+
+    // 按时长的背压
+    AVRational time_base;       // 包时间戳的时间基
+    atomic_llong in_ts;         // 最后入队包的时间戳(微秒)
+    atomic_llong out_ts;        // 最后出队包的时间戳(微秒)
+    int64_t min_duration;       // 队列"足够"的时长(微秒)
+    PacketQueueSignal *space;   // 有空间时通知的条件，可为NULL
+} PacketQueue;
+
+int packet_signal_init(PacketQueueSignal *s);
+void packet_signal_destroy(PacketQueueSignal *s);
+void packet_signal_wake(PacketQueueSignal *s);
+int packet_signal_full(PacketQueueSignal *s);
+
+int packet_queue_init(PacketQueue *q);
+void packet_queue_destroy(PacketQueue *q);
+int packet_queue_put(PacketQueue *q, AVPacket *pkt);
+int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block);
+void packet_queue_quit(PacketQueue *q);
+int64_t packet_queue_duration(PacketQueue *q);
+int packet_queue_has_enough(PacketQueue *q);
+int packet_queue_flush(PacketQueue *q);
+int packet_queue_is_flush(const AVPacket *pkt);
+int packet_queue_put_eof(PacketQueue *q);
+int packet_queue_is_eof(const AVPacket *pkt);
+
+#endif
@@ -0,0 +1,116 @@
+#include "pcm_ring.h"
+#include <libavutil/mem.h>
+#include <string.h>
+
+int pcm_ring_init(PcmRing *r, size_t min_capacity) {
+    memset(r, 0, sizeof(PcmRing));
+
+    r->capacity = 4096;
+    while (r->capacity < min_capacity) {
+        r->capacity <<= 1;
+    }
+    r->mask = r->capacity - 1;
+    r->buf = av_malloc(r->capacity);
+    if (!r->buf) {
+        return -1;
+    }
+
+    atomic_init(&r->read_pos, 0);
+    atomic_init(&r->write_pos, 0);
+    atomic_init(&r->quit, 0);
+    atomic_init(&r->waiters, 0);
+    r->mutex = SDL_CreateMutex();
+    r->cond = SDL_CreateCond();
+    return (r->mutex && r->cond) ? 0 : -1;
+}
+
+void pcm_ring_destroy(PcmRing *r) {
+    av_freep(&r->buf);
+    if (r->mutex) {
+        SDL_DestroyMutex(r->mutex);
+        r->mutex = NULL;
+    }
+    if (r->cond) {
+        SDL_DestroyCond(r->cond);
+        r->cond = NULL;
+    }
+}
+
+// 写入全部数据，空间不足时等待读端；退出时返回-1
+int pcm_ring_write(PcmRing *r, const uint8_t *data, size_t len) {
+    unsigned long long wpos = atomic_load_explicit(&r->write_pos, memory_order_relaxed);
+
+    while (len > 0) {
+        if (atomic_load(&r->quit)) {
+            return -1;
+        }
+
+        unsigned long long rpos = atomic_load_explicit(&r->read_pos, memory_order_acquire);
+        size_t space = r->capacity - (size_t)(wpos - rpos);
+        if (space == 0) {
+            // 先登记等待再复查，和读端的"先移动read_pos再看waiters"配对
+            SDL_LockMutex(r->mutex);
+            atomic_fetch_add(&r->waiters, 1);
+            while (!atomic_load(&r->quit) &&
+                   wpos - atomic_load(&r->read_pos) >= r->capacity) {
+                // 读端读走数据和退出时唤醒；暂停时回调不运行，这里不占CPU
+                SDL_CondWait(r->cond, r->mutex);
+            }
+            atomic_fetch_sub(&r->waiters, 1);
+            SDL_UnlockMutex(r->mutex);
+            continue;
+        }
+
+        size_t n = len < space ? len : space;
+        size_t off = (size_t)wpos & r->mask;
+        size_t first = r->capacity - off < n ? r->capacity - off : n;
+        memcpy(r->buf + off, data, first);
+        memcpy(r->buf, data + first, n - first);
+
+        wpos += n;
+        data += n;
+        len -= n;
+        atomic_store(&r->write_pos, wpos);
+    }
+    return 0;
+}
+
+// 读出最多len字节，不阻塞，返回实际读到的字节数
+size_t pcm_ring_read(PcmRing *r, uint8_t *dst, size_t len) {
+    unsigned long long rpos = atomic_load_explicit(&r->read_pos, memory_order_relaxed);
+    unsigned long long wpos = atomic_load_explicit(&r->write_pos, memory_order_acquire);
+    size_t avail = (size_t)(wpos - rpos);
+    size_t n = len < avail ? len : avail;
+
+    if (n > 0) {
+        size_t off = (size_t)rpos & r->mask;
+        size_t first = r->capacity - off < n ? r->capacity - off : n;
+        memcpy(dst, r->buf + off, first);
+        memcpy(dst + first, r->buf, n - first);
+        atomic_store(&r->read_pos, rpos + n);
+
+        if (atomic_load(&r->waiters) > 0) {
+            SDL_LockMutex(r->mutex);
+            SDL_CondSignal(r->cond);
+            SDL_UnlockMutex(r->mutex);
+        }
+    }
+    return n;
+}
+
+size_t pcm_ring_available(PcmRing *r) {
+    return (size_t)(atomic_load(&r->write_pos) - atomic_load(&r->read_pos));
+}
+
+// 丢弃所有未读数据，由写端调用
+// 调用者须保证读端此时不在运行(例如持有SDL_LockAudioDevice)
+void pcm_ring_flush(PcmRing *r) {
+    atomic_store(&r->read_pos, atomic_load(&r->write_pos));
+}
+
+void pcm_ring_quit(PcmRing *r) {
+    atomic_store(&r->quit, 1);
+    SDL_LockMutex(r->mutex);
+    SDL_CondBroadcast(r->cond);
+    SDL_UnlockMutex(r->mutex);
+}
@@ -0,0 +1,37 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+
+/**
+ * ! 单生产者/单消费者PCM环形缓冲区
+ *
+ * 音频解码线程写入重采样后的PCM，SDL音频回调只从这里拷贝数据。
+ * 读端(回调)永不阻塞；写端在空间不足时睡眠，直到回调读走数据或退出。
+ * read_pos/write_pos是单调递增的字节总数，可用来换算音频时钟。
+ */
+typedef struct PcmRing {
+    uint8_t *buf;
+    size_t capacity;            // 2的幂
+    size_t mask;
+    atomic_ullong read_pos;     // 已读字节总数，只有读端修改
+    atomic_ullong write_pos;    // 已写字节总数，只有写端修改
+    atomic_int quit;
+    atomic_int waiters;         // 等待空间的写端
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+} PcmRing;
+
+int pcm_ring_init(PcmRing *r, size_t min_capacity);
+void pcm_ring_destroy(PcmRing *r);
+int pcm_ring_write(PcmRing *r, const uint8_t *data, size_t len);
+size_t pcm_ring_read(PcmRing *r, uint8_t *dst, size_t len);
+size_t pcm_ring_available(PcmRing *r);
+void pcm_ring_flush(PcmRing *r);
+void pcm_ring_quit(PcmRing *r);
+
+#endif
@@ -0,0 +1,1585 @@
+#include "player.h"
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include "audio_output.h"
+#include "frame_pool.h"
+#include "keyframe_index.h"
+#include "packet_queue.h"
+#include "sync_clock.h"
+
+#define VIDEO_PICTURE_QUEUE_SIZE 10
+#define MAX_QUEUE_SIZE (15 * 1024 * 1024)     // 所有包队列字节数硬上限的默认值
+#define MIN_QUEUE_DURATION (1 * AV_TIME_BASE) // 每个包队列缓冲的时长(微秒)
+#define READ_RETRY_MIN_DELAY 5                // 读包失败后重试的等待(毫秒)
+#define READ_RETRY_MAX_DELAY 100
+#define DOWNSCALE_MIN_RATIO 2                 // 视频宽高都达到显示区域的这么多倍时在视频线程上缩小
+#define FAST_START_PROBESIZE (512 * 1024)     // 快速启动时探测流信息的字节数上限
+#define FAST_START_ANALYZEDURATION (AV_TIME_BASE / 2) // 快速启动时探测流信息的时长上限(微秒)
+#define MEMORY_CAP_MIN_PACKETS (1024 * 1024)  // memory_cap下包队列至少保留的字节数
+
+// 视频跟不上时的降级策略
+#define DEGRADE_WINDOW 30                     // 每隔多少帧评估一次
+#define DEGRADE_ESCALATE_RATIO 0.2            // 窗口内迟到帧比例超过此值时升级
+#define DEGRADE_ESCALATE_HOLD 0.5             // 两次升级的最小间隔(秒)
+#define DEGRADE_RELAX_HOLD 2.0                // 升级后至少保持多久才降级(秒)
+#define DEGRADE_RELAX_AHEAD 0.05              // 窗口内所有帧都提前这么多(秒)才降级
+#define DEGRADE_KEYFRAME_LATE 0.5             // 落后超过此值(秒)时只解码关键帧
+
+// 图像队列结构体
+// 只持有解码帧的引用，显示(纹理上传)由前端在回调里完成
+typedef struct VideoPicture {
+    AVFrame *frame;        // 引用计数帧，槽位复用，出队时av_frame_unref
+    int width, height;
+    double pts;            // 显示时间戳(秒)
+    double duration;       // 按帧率估计的帧时长(秒)
+    int serial;            // 解码时的seek序号，与当前序号不同的帧直接丢弃
+} VideoPicture;
+
+// 视频解码耗时统计
+typedef struct DecodeStats {
+    int64_t frames;        // 解码出的帧数
+    int64_t total_us;      // send/receive调用累计耗时(微秒)
+    int64_t max_us;        // 单帧最大耗时
+    int64_t pending_us;    // 上一帧之后累计的耗时，出帧时记到这一帧
+    int64_t start_time;    // 第一次解码的时间
+    int64_t end_time;      // 最后一帧的时间
+} DecodeStats;
+
+// 降级级别，逐级减少解码工作量
+enum {
+    DEGRADE_NONE,               // 正常解码
+    DEGRADE_LOOP_FILTER,        // 非参考帧跳过环路滤波
+    DEGRADE_NONREF,             // 所有帧跳过环路滤波，不解码非参考帧
+    DEGRADE_KEYFRAMES,          // 只解码关键帧，远远落后时追上音频
+    DEGRADE_NB
+};
+
+struct Player {
+    PlayerOptions opt;
+    AVFormatContext *pFormatCtx;
+    ReadAhead *read_ahead;      // 自定义I/O，为NULL时使用FFmpeg默认的file协议
+    int videoStream, audioStream;
+    char filename[1024];
+
+    // 音频
+    AVStream *audio_st;
+    AVCodecContext *audio_ctx;
+    PacketQueue audioq;
+    AudioOutput audio;          // 音频解码线程和设备
+    int audio_opened;
+    int audio_subsystem;        // 由player初始化了SDL音频子系统
+
+    // 视频
+    AVStream *video_st;
+    AVCodecContext *video_ctx;
+    FramePool frame_pool;       // 视频解码器的帧缓冲池，图像队列里的帧引用它的缓冲区
+    PacketQueue videoq;
+    PacketQueueSignal continue_read; // 包队列有空间时唤醒decode_thread
+    VideoPicture pictq[VIDEO_PICTURE_QUEUE_SIZE];
+    // video_thread写好槽位后才递增pictq_size，渲染线程不加锁原子读取，读到的槽位一定是完整的；
+    // rindex只由渲染线程、windex只由video_thread访问
+    atomic_int pictq_size;
+    int pictq_rindex, pictq_windex;
+    int pictq_max;              // 图像队列最多放几帧，memory_cap时按帧大小减少
+    int64_t pictq_frame_bytes;  // memory_cap按此估计每帧的大小
+    SDL_mutex *pictq_mutex;
+    SDL_cond *pictq_cond;
+    SDL_Thread *parse_tid;
+    SDL_Thread *video_tid;
+
+    // 状态
+    atomic_int quit;
+    atomic_int started;
+    atomic_int paused;
+    int step;                   // 单帧步进：显示下一帧后重新暂停，只在调用player_refresh的线程上访问
+    double speed;               // 播放速度，同上
+    atomic_int eof;             // 已读到文件结尾
+    atomic_int video_drained;   // 视频解码器已冲刷完
+    atomic_int stopped;         // 帧回调要求停止
+    SDL_mutex *state_mutex;     // player_wait在state_cond上等待状态变化
+    SDL_cond *state_cond;
+
+    // seek
+    KeyframeIndex kf_index;     // 视频流的关键帧索引
+    atomic_int seek_req;        // 前端请求，decode_thread执行后清零
+    double seek_pos;            // 请求的目标位置(秒)
+    atomic_int seek_serial;     // 每次seek成功加1，解码线程和显示端据此丢弃旧数据
+    double seek_target;         // 最近一次seek的目标位置(秒)
+    double seek_landed;         // 实际落到的关键帧位置(秒)
+    double seek_start_time;     // 执行seek的系统时间，用于统计首帧耗时
+    int frame_serial;           // 上一次显示的帧的序号
+
+    // 音视频同步
+    Clock audclk;               // 音频时钟，由音频输出更新
+    Clock vidclk;               // 视频时钟，显示帧时更新
+    Clock extclk;               // 外部(系统)时钟
+    double video_clock;         // 下一帧的预测pts，帧没有时间戳时使用
+    double frame_timer;         // 当前帧应当显示的系统时间
+    double frame_last_pts;      // 上一帧的pts
+    double frame_last_delay;    // 上一帧的时长
+    double present_lead;        // 帧从交给回调到真正显示的预计时间(秒)，例如等待垂直同步
+    atomic_int display_width;   // 前端显示区域的像素尺寸，0表示不缩小
+    atomic_int display_height;
+    struct SwsContext *scale_ctx; // 缩小用，只有video_thread使用
+    AVFrame *scale_frame;       // 缩小的输出，缓冲区从帧池取，缩小后引用移给原帧
+    int frame_drops_late;       // 因为迟到而丢弃的帧数
+    int64_t frames_shown;       // 交给回调的帧数
+
+    // 降级策略，只有video_thread修改
+    atomic_int degrade_level;   // DEGRADE_NONE ... DEGRADE_KEYFRAMES
+    double degrade_changed;     // 上一次调整级别的时间
+    int window_frames;          // 当前评估窗口内的帧数
+    int window_late;            // 其中迟到的帧数
+    double window_min_late;     // 窗口内最小和最大的迟到量(秒)
+    double window_max_late;
+    atomic_llong frames_dropped_early; // 解码后、入队前丢弃的迟到帧
+    atomic_llong skip_packets;  // 解码器跳帧期间送入的包数
+    atomic_llong skip_frames;   // 跳帧期间解码出的帧数
+    atomic_int degrade_changes; // 调整级别的次数
+
+    // 插桩统计
+    DecodeStats video_stats;
+    int64_t open_start;         // 调用player_open的时间(av_gettime_relative)
+    int64_t probe_us;           // 以下都是相对open_start的微秒数，0表示还没到达
+    int64_t open_us;
+    atomic_llong first_decoded_us; // 视频线程写
+    atomic_llong first_frame_us;   // 实时模式下由调用player_refresh的线程写，无头模式下由视频线程写
+    StageHist stage[PLAYER_STAGE_NB];
+    StageHist depth[PLAYER_DEPTH_NB];
+};
+
+static int get_master_sync_type(Player *p);
+static double get_master_clock(Player *p);
+
+void player_default_options(PlayerOptions *opt) {
+    memset(opt, 0, sizeof(PlayerOptions));
+    opt->sync_type = AV_SYNC_AUDIO_MASTER;
+    opt->decode_threads = 0;
+    opt->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    opt->skip_frame = AVDISCARD_DEFAULT;
+    opt->audio = 1;
+    opt->realtime = 1;
+    opt->keyframe_index = 1;
+    opt->verbose = 1;
+    opt->framedrop = 1;
+}
+
+// 阻塞的网络/文件读取在退出时立即返回
+static int decode_interrupt_cb(void *ctx) {
+    Player *p = (Player *)ctx;
+    return atomic_load(&p->quit);
+}
+
+// 唤醒player_wait
+static void player_signal_state(Player *p) {
+    SDL_LockMutex(p->state_mutex);
+    SDL_CondBroadcast(p->state_cond);
+    SDL_UnlockMutex(p->state_mutex);
+}
+
+// 初始化各阶段的直方图
+static void stats_init(Player *p) {
+    static const char *stage_names[PLAYER_STAGE_NB] = {
+        "read", "send", "receive", "scale", "queue_wait", "upload", "present", "present_jitter", "audio_fill"
+    };
+    static const char *depth_names[PLAYER_DEPTH_NB] = {
+        "videoq", "audioq", "pictq", "pcm"
+    };
+    static const char *depth_units[PLAYER_DEPTH_NB] = {
+        "pkts", "pkts", "frames", "ms"
+    };
+
+    for (int i = 0; i < PLAYER_STAGE_NB; i++) {
+        stage_hist_init(&p->stage[i], stage_names[i], "us");
+    }
+    for (int i = 0; i < PLAYER_DEPTH_NB; i++) {
+        stage_hist_init(&p->depth[i], depth_names[i], depth_units[i]);
+    }
+}
+
+/**
+ * ! 打开流
+ */
+static int stream_component_open(Player *p, int stream_index) {
+    AVFormatContext *pFormatCtx = p->pFormatCtx;
+    AVCodecContext *codecCtx;
+    AVCodec *codec;
+
+    if (stream_index < 0 || stream_index >= pFormatCtx->nb_streams) {
+        return -1;
+    }
+    codecCtx = avcodec_alloc_context3(NULL);
+    if (!codecCtx) {
+        return -1;
+    }
+    if (avcodec_parameters_to_context(codecCtx, pFormatCtx->streams[stream_index]->codecpar) < 0) {
+        avcodec_free_context(&codecCtx);
+        return -1;
+    }
+
+    codecCtx->pkt_timebase = pFormatCtx->streams[stream_index]->time_base;
+    if (p->opt.streaming) {
+        // 不为B帧重排序多缓存帧，流里没有B帧时第一帧立即输出
+        codecCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+    if (codecCtx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        // 帧级/片级多线程解码，thread_count为0时由libavcodec按核数选择
+        codecCtx->thread_count = p->opt.decode_threads;
+        codecCtx->thread_type = p->opt.thread_type;
+        codecCtx->skip_frame = p->opt.skip_frame;
+        // 帧缓冲区从池里取，显示后av_frame_unref归还，稳定播放时不再分配
+        frame_pool_attach(&p->frame_pool, codecCtx);
+    }
+
+    codec = avcodec_find_decoder(codecCtx->codec_id);
+    if (!codec || avcodec_open2(codecCtx, codec, NULL) < 0) {
+        fprintf(stderr, "Unsupported codec!\n");
+        avcodec_free_context(&codecCtx);
+        return -1;
+    }
+
+    switch (codecCtx->codec_type) {
+        case AVMEDIA_TYPE_AUDIO:
+            p->audioStream = stream_index;
+            p->audio_st = pFormatCtx->streams[stream_index];
+            p->audioq.time_base = p->audio_st->time_base;
+            p->audioq.min_duration = MIN_QUEUE_DURATION;
+            p->audioq.space = &p->continue_read;
+            // 打开音频设备，设备暂停直到音频线程启动
+            if (audio_output_open(&p->audio, codecCtx, p->audio_st, &p->audioq, &p->audclk,
+                                  p->opt.audio_samples) < 0) {
+                avcodec_free_context(&codecCtx);
+                p->audioStream = -1;
+                p->audio_st = NULL;
+                return -1;
+            }
+            p->audio.fill_hist = &p->stage[PLAYER_STAGE_AUDIO_FILL];
+            p->audio.pcm_hist = &p->depth[PLAYER_DEPTH_PCM];
+            p->audio_ctx = codecCtx;
+            p->audio_opened = 1;
+            break;
+        case AVMEDIA_TYPE_VIDEO:
+            p->videoStream = stream_index;
+            p->video_st = pFormatCtx->streams[stream_index];
+            p->video_ctx = codecCtx;
+            p->videoq.time_base = p->video_st->time_base;
+            p->videoq.min_duration = MIN_QUEUE_DURATION;
+            p->videoq.space = &p->continue_read;
+            p->frame_timer = clock_now();
+            p->frame_last_delay = 40e-3;
+            p->frame_last_pts = NAN;
+            p->video_clock = 0;
+            break;
+        default:
+            avcodec_free_context(&codecCtx);
+            break;
+    }
+
+    return 0;
+}
+
+// 音频流在单独的线程里打开，与视频解码器的打开重叠
+typedef struct StreamOpenArgs {
+    Player *p;
+    int stream_index;
+    int ret;
+} StreamOpenArgs;
+
+static int stream_open_thread(void *arg) {
+    StreamOpenArgs *args = (StreamOpenArgs *)arg;
+    args->ret = stream_component_open(args->p, args->stream_index);
+    return 0;
+}
+
+// 记录启动阶段的耗时
+static int64_t startup_elapsed(Player *p) {
+    return FFMAX(1, av_gettime_relative() - p->open_start);
+}
+
+static void mark_first(atomic_llong *mark, Player *p) {
+    if (!atomic_load(mark)) {
+        atomic_store(mark, startup_elapsed(p));
+    }
+}
+
+// 按memory_cap分配各缓冲区：先扣掉大小固定的PCM环形缓冲区和预读缓冲区，
+// 剩下的一半给图像队列(按解码输出的帧大小估计，至少2帧)，其余作为包队列的上限
+static void apply_memory_cap(Player *p) {
+    int64_t budget = (int64_t)p->opt.memory_cap;
+
+    if (!budget) {
+        return;
+    }
+    if (p->audio_opened) {
+        budget -= p->audio.ring.capacity;
+    }
+    if (p->read_ahead) {
+        ReadAheadStats stats;
+        read_ahead_get_stats(p->read_ahead, &stats);
+        budget -= stats.size;
+    }
+    if (p->video_ctx) {
+        p->pictq_frame_bytes = av_image_get_buffer_size(p->video_ctx->pix_fmt, p->video_ctx->width,
+                                                        p->video_ctx->height, 1);
+        if (p->pictq_frame_bytes > 0) {
+            p->pictq_max = av_clip(budget / 2 / p->pictq_frame_bytes, 2, VIDEO_PICTURE_QUEUE_SIZE);
+            budget -= p->pictq_max * p->pictq_frame_bytes;
+        }
+    }
+    p->opt.max_queue_size = FFMIN(p->opt.max_queue_size, (size_t)FFMAX(budget, MEMORY_CAP_MIN_PACKETS));
+}
+
+// 打开文件、查找并打开音视频流；返回时只有音频打开线程已经结束，不留下任何线程
+Player *player_open(const char *filename, const PlayerOptions *opt) {
+    Player *p = (Player *)av_mallocz(sizeof(Player));
+    if (!p) {
+        fprintf(stderr, "Could not allocate player\n");
+        return NULL;
+    }
+
+    p->open_start = av_gettime_relative();
+    p->opt = *opt;
+    if (!p->opt.max_queue_size) {
+        p->opt.max_queue_size = MAX_QUEUE_SIZE;
+    }
+    if (p->opt.streaming) {
+        // 流式输入只能顺序读：交给I/O线程，解复用器等数据时能被中断；关键帧索引要重读文件，不建立。
+        // 低延迟：按快速启动探测，片级多线程(帧级多线程每个线程多延迟一帧)
+        p->opt.io_mode = READ_AHEAD_STREAM;
+        p->opt.keyframe_index = 0;
+        p->opt.fast_start = 1;
+        p->opt.thread_type = FF_THREAD_SLICE;
+    }
+    if (p->opt.memory_cap && !p->opt.io_buffer_size) {
+        p->opt.io_buffer_size = p->opt.memory_cap / 8;
+    }
+    if (p->opt.fast_start) {
+        if (!p->opt.probesize) {
+            p->opt.probesize = FAST_START_PROBESIZE;
+        }
+        if (!p->opt.analyzeduration) {
+            p->opt.analyzeduration = FAST_START_ANALYZEDURATION;
+        }
+    }
+    strncpy(p->filename, filename, sizeof(p->filename) - 1);
+    p->videoStream = -1;
+    p->audioStream = -1;
+    p->seek_target = NAN;
+    p->frame_serial = -1;   // 第一帧和seek后的第一帧一样，解码出来就显示
+    p->pictq_max = VIDEO_PICTURE_QUEUE_SIZE;
+    atomic_init(&p->pictq_size, 0);
+    p->speed = 1.0;
+    stats_init(p);
+    init_clock(&p->audclk);
+    init_clock(&p->vidclk);
+    init_clock(&p->extclk);
+
+    p->pictq_mutex = SDL_CreateMutex();
+    p->pictq_cond = SDL_CreateCond();
+    p->state_mutex = SDL_CreateMutex();
+    p->state_cond = SDL_CreateCond();
+    if (!p->pictq_mutex || !p->pictq_cond || !p->state_mutex || !p->state_cond) {
+        fprintf(stderr, "Could not create player locks\n");
+        goto fail;
+    }
+
+    // 图像队列的帧槽位一次性分配，之后只移动引用
+    for (int i = 0; i < VIDEO_PICTURE_QUEUE_SIZE; i++) {
+        p->pictq[i].frame = av_frame_alloc();
+        if (!p->pictq[i].frame) {
+            fprintf(stderr, "Could not allocate picture queue frame\n");
+            goto fail;
+        }
+    }
+
+    if (packet_queue_init(&p->videoq) < 0 || packet_queue_init(&p->audioq) < 0 ||
+        packet_signal_init(&p->continue_read) < 0) {
+        fprintf(stderr, "Could not allocate packet queues\n");
+        goto fail;
+    }
+    if (frame_pool_init(&p->frame_pool) < 0) {
+        fprintf(stderr, "Could not create frame pool\n");
+        goto fail;
+    }
+
+    // 打开输入文件
+    p->pFormatCtx = avformat_alloc_context();
+    if (!p->pFormatCtx) {
+        goto fail;
+    }
+    p->pFormatCtx->interrupt_callback.callback = decode_interrupt_cb;
+    p->pFormatCtx->interrupt_callback.opaque = p;
+    if (p->opt.streaming) {
+        // 探测时读到的包不留给av_read_frame，开头少几帧换来更早出画面
+        p->pFormatCtx->flags |= AVFMT_FLAG_NOBUFFER;
+    }
+    // 探测范围默认是5MB、5秒，码率低或者有稀疏流的文件要读很多数据才返回
+    if (p->opt.probesize) {
+        p->pFormatCtx->probesize = FFMAX(p->opt.probesize, 32);
+    }
+    if (p->opt.analyzeduration) {
+        p->pFormatCtx->max_analyze_duration = p->opt.analyzeduration;
+    }
+    // 本地文件可以由后台线程预读或mmap，av_read_frame只从内存拷贝
+    if (p->opt.io_mode != READ_AHEAD_OFF) {
+        p->read_ahead = read_ahead_open(p->filename, p->opt.io_mode, p->opt.io_buffer_size,
+                                        &p->pFormatCtx->interrupt_callback);
+        if (p->read_ahead) {
+            p->pFormatCtx->pb = read_ahead_avio(p->read_ahead);
+        }
+    }
+    if (avformat_open_input(&p->pFormatCtx, p->filename, NULL, NULL) != 0) {
+        fprintf(stderr, "Could not open file %s\n", p->filename);
+        goto fail;
+    }
+
+    // 获取流信息
+    if (avformat_find_stream_info(p->pFormatCtx, NULL) < 0) {
+        fprintf(stderr, "Could not find stream information\n");
+        goto fail;
+    }
+    p->probe_us = startup_elapsed(p);
+    if (p->opt.verbose) {
+        av_dump_format(p->pFormatCtx, 0, p->filename, 0);
+    }
+
+    // 查找视频流和音频流
+    int video_index = -1, audio_index = -1;
+    for (unsigned int i = 0; i < p->pFormatCtx->nb_streams; i++) {
+        enum AVMediaType type = p->pFormatCtx->streams[i]->codecpar->codec_type;
+        if (type == AVMEDIA_TYPE_VIDEO && video_index < 0) {
+            video_index = i;
+        }
+        if (type == AVMEDIA_TYPE_AUDIO && audio_index < 0) {
+            audio_index = i;
+        }
+    }
+
+    // 音频解码器和音频设备(SDL_OpenAudioDevice可能要几十毫秒)在另一个线程打开，
+    // 同时在这里打开视频解码器；两边只写各自的字段，avcodec_open2本身是线程安全的
+    StreamOpenArgs audio_args = { p, audio_index, 0 };
+    SDL_Thread *audio_open_tid = NULL;
+    if (audio_index >= 0 && p->opt.audio) {
+        if (!SDL_WasInit(SDL_INIT_AUDIO)) {
+            if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+                fprintf(stderr, "Could not initialize SDL audio - %s\n", SDL_GetError());
+            } else {
+                p->audio_subsystem = 1;
+            }
+        }
+        if (SDL_WasInit(SDL_INIT_AUDIO)) {
+            audio_open_tid = SDL_CreateThread(stream_open_thread, "audio_open", &audio_args);
+            if (!audio_open_tid) {
+                stream_open_thread(&audio_args);
+            }
+        }
+    }
+    if (video_index >= 0 && stream_component_open(p, video_index) < 0) {
+        fprintf(stderr, "Could not open video stream\n");
+    }
+    if (audio_open_tid) {
+        SDL_WaitThread(audio_open_tid, NULL);
+    }
+    if (audio_args.ret < 0) {
+        fprintf(stderr, "Could not open audio stream\n");
+    }
+    p->open_us = startup_elapsed(p);
+
+    if (p->videoStream < 0 && p->audioStream < 0) {
+        fprintf(stderr, "Could not open any streams\n");
+        goto fail;
+    }
+
+    apply_memory_cap(p);
+    p->continue_read.max_size = p->opt.max_queue_size;
+
+    // 加载或在后台建立关键帧索引，供seek使用
+    if (p->video_st && p->opt.keyframe_index) {
+        keyframe_index_open(&p->kf_index, p->filename, p->videoStream, p->video_st->time_base);
+    }
+    return p;
+
+fail:
+    player_close(p);
+    return NULL;
+}
+
+/**
+ * ! 读包线程
+ */
+// 包队列是否已经缓冲足够：总字节数超过硬上限，或每个打开的流都缓冲了足够时长
+static int packet_queues_full(Player *p) {
+    if (packet_signal_full(&p->continue_read)) {
+        return 1;
+    }
+    return (!p->audio_opened || packet_queue_has_enough(&p->audioq)) &&
+           (!p->video_st || packet_queue_has_enough(&p->videoq));
+}
+
+// 在continue_read上睡眠，直到消费者腾出空间、超时或退出；timeout为负时不限时，
+// 只靠player_pause/player_seek/player_stop和消费者唤醒。
+// full_only为1时只在队列仍满时睡眠；paused是调用者看到的暂停状态，已经变化时不睡眠
+static void wait_continue_read(Player *p, int full_only, int paused, int timeout) {
+    PacketQueueSignal *s = &p->continue_read;
+
+    SDL_LockMutex(s->mutex);
+    atomic_fetch_add(&s->waiters, 1);
+    if (!atomic_load(&p->quit) && !atomic_load(&p->seek_req) && atomic_load(&p->paused) == paused &&
+        (!full_only || packet_queues_full(p))) {
+        if (timeout < 0) {
+            SDL_CondWait(s->cond, s->mutex);
+        } else {
+            SDL_CondWaitTimeout(s->cond, s->mutex, timeout);
+        }
+    }
+    atomic_fetch_sub(&s->waiters, 1);
+    SDL_UnlockMutex(s->mutex);
+}
+
+// 在decode_thread中执行seek：按关键帧索引定位到目标之前最近的关键帧，
+// 然后往包队列里放flush标记，解码线程取到标记时冲刷解码器
+static void do_seek(Player *p) {
+    AVFormatContext *ic = p->pFormatCtx;
+    double target = p->seek_pos;
+    double landed = target;
+    double start = clock_now();
+    KeyframeEntry entry;
+    int ret = -1;
+
+    if (p->video_st && p->opt.keyframe_index) {
+        AVRational tb = p->video_st->time_base;
+        int64_t ts = llrint(target / av_q2d(tb));
+
+        if (keyframe_index_lookup(&p->kf_index, ts, tb, &entry) == 0) {
+            landed = entry.ts * av_q2d(tb);
+            // 没有自身索引的格式(裸流等)按时间戳seek会从头扫描，直接按字节位置定位
+            if (entry.pos >= 0 && (ic->iformat->flags & AVFMT_GENERIC_INDEX) &&
+                !(ic->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+                ret = avformat_seek_file(ic, -1, INT64_MIN, entry.pos, entry.pos, AVSEEK_FLAG_BYTE);
+            } else {
+                ret = avformat_seek_file(ic, p->videoStream, INT64_MIN, entry.ts, entry.ts, 0);
+            }
+        }
+    }
+    if (ret < 0) {
+        // 索引还没覆盖到目标位置，交给解复用器
+        int64_t ts = (int64_t)(target * AV_TIME_BASE);
+        landed = target;
+        ret = avformat_seek_file(ic, -1, INT64_MIN, ts, ts, 0);
+    }
+
+    if (ret < 0) {
+        fprintf(stderr, "%s: error while seeking to %.2f s\n", p->filename, target);
+    } else {
+        p->seek_target = target;
+        p->seek_landed = landed;
+        p->seek_start_time = start;
+        atomic_fetch_add(&p->seek_serial, 1);
+        if (p->audio_opened) {
+            audio_output_set_seek(&p->audio, target, landed);
+            audio_output_set_eof(&p->audio, 0);
+            packet_queue_flush(&p->audioq);
+        }
+        if (p->video_st) {
+            packet_queue_flush(&p->videoq);
+        }
+        atomic_store(&p->eof, 0);
+    }
+    atomic_store(&p->seek_req, 0);
+}
+
+// 读到文件结尾：通知解码线程冲刷解码器里剩余的帧
+static void set_eof(Player *p) {
+    atomic_store(&p->eof, 1);
+    if (p->video_st) {
+        packet_queue_put_eof(&p->videoq);
+    }
+    if (p->audio_opened) {
+        audio_output_set_eof(&p->audio, 1);
+        packet_queue_put_eof(&p->audioq);
+    }
+    player_signal_state(p);
+}
+
+// 读包线程函数
+static int decode_thread(void *arg) {
+    Player *p = (Player *)arg;
+    AVPacket packet;
+    int retry_delay = READ_RETRY_MIN_DELAY;
+    int paused = 0;
+
+    while (!atomic_load(&p->quit)) {
+        // 网络流(RTSP等)暂停时通知服务器；本地文件暂停时队列很快填满，在continue_read上睡眠
+        if (paused != atomic_load(&p->paused)) {
+            paused = atomic_load(&p->paused);
+            if (paused) {
+                av_read_pause(p->pFormatCtx);
+            } else {
+                av_read_play(p->pFormatCtx);
+            }
+        }
+
+        if (atomic_load(&p->seek_req)) {
+            do_seek(p);
+            continue;
+        }
+
+        // 队列满时等消费者取包后唤醒，而不是轮询：字节数降到上限以内、或某个队列不再足够时
+        // 消费者会发信号；暂停时没有消费者，只等恢复、seek或退出
+        if (packet_queues_full(p)) {
+            wait_continue_read(p, 1, paused, -1);
+            continue;
+        }
+
+        // 读到结尾后不退出，等待seek、暂停状态变化或退出
+        if (atomic_load(&p->eof)) {
+            wait_continue_read(p, 0, paused, -1);
+            continue;
+        }
+
+        int64_t t0 = av_gettime_relative();
+        int ret = av_read_frame(p->pFormatCtx, &packet);
+        int64_t t1 = av_gettime_relative();
+        stage_hist_add_at(&p->stage[PLAYER_STAGE_READ], t1 - t0, t1);
+        if (ret < 0) {
+            if (ret != AVERROR_EOF && p->pFormatCtx->pb && avio_feof(p->pFormatCtx->pb) == 0) {
+                // 读失败但不是文件结尾，退避重试，退出时立即被唤醒
+                wait_continue_read(p, 0, paused, retry_delay);
+                retry_delay = FFMIN(retry_delay * 2, READ_RETRY_MAX_DELAY);
+            } else {
+                set_eof(p);
+            }
+            continue;
+        }
+        retry_delay = READ_RETRY_MIN_DELAY;
+
+        // 分发包到相应队列
+        if (packet.stream_index == p->videoStream) {
+            packet_queue_put(&p->videoq, &packet);
+        } else if (packet.stream_index == p->audioStream && p->audio_opened) {
+            packet_queue_put(&p->audioq, &packet);
+        } else {
+            av_packet_unref(&packet);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * ! 视频解码线程
+ */
+// 根据best_effort_timestamp和流的time_base计算帧的pts(秒)
+// 没有时间戳的帧沿用上一帧的pts加上帧时长
+static double synchronize_video(Player *p, AVFrame *frame, double *duration) {
+    AVRational frame_rate = av_guess_frame_rate(p->pFormatCtx, p->video_st, frame);
+    double frame_delay;
+    double pts;
+
+    if (frame_rate.num && frame_rate.den) {
+        frame_delay = av_q2d((AVRational){frame_rate.den, frame_rate.num});
+    } else {
+        frame_delay = p->frame_last_delay;
+    }
+    // 重复场需要额外显示半帧
+    frame_delay += frame->repeat_pict * (frame_delay * 0.5);
+
+    if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+        pts = frame->best_effort_timestamp * av_q2d(p->video_st->time_base);
+        p->video_clock = pts;
+    } else {
+        pts = p->video_clock;
+    }
+    p->video_clock += frame_delay;
+
+    *duration = frame_delay;
+    return pts;
+}
+
+// 帧回调要求停止
+static void player_set_stopped(Player *p) {
+    atomic_store(&p->stopped, 1);
+    player_signal_state(p);
+}
+
+// 显示区域的宽高都不到视频的1/DOWNSCALE_MIN_RATIO时，在视频线程上用swscale缩小到显示尺寸，
+// 渲染线程不必上传整帧再交给渲染器缩小。输出YUV420P，缓冲区取自帧缓冲池；失败时保留原帧
+static void downscale_picture(Player *p, AVFrame *frame) {
+    int width = atomic_load(&p->display_width) & ~1;
+    int height = atomic_load(&p->display_height) & ~1;
+
+    if (!p->opt.downscale || width <= 0 || height <= 0 ||
+        frame->width < width * DOWNSCALE_MIN_RATIO || frame->height < height * DOWNSCALE_MIN_RATIO) {
+        return;
+    }
+
+    int64_t t0 = av_gettime_relative();
+    if (!p->scale_frame && !(p->scale_frame = av_frame_alloc())) {
+        return;
+    }
+    p->scale_ctx = sws_getCachedContext(p->scale_ctx, frame->width, frame->height, frame->format,
+                                        width, height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!p->scale_ctx) {
+        return;
+    }
+    AVFrame *out = p->scale_frame;
+    out->format = AV_PIX_FMT_YUV420P;
+    out->width = width;
+    out->height = height;
+    if (frame_pool_get_frame(&p->frame_pool, out) < 0) {
+        return;
+    }
+    sws_scale(p->scale_ctx, (const uint8_t * const *)frame->data, frame->linesize, 0, frame->height,
+              out->data, out->linesize);
+    av_frame_copy_props(out, frame);
+    // 调整像素宽高比使显示宽高比不变，前端算出的显示区域和缩小前一样；swscale输出的是有限范围
+    AVRational sar = av_guess_sample_aspect_ratio(p->pFormatCtx, p->video_st, frame);
+    if (!sar.num || !sar.den) {
+        sar = (AVRational){1, 1};
+    }
+    av_reduce(&out->sample_aspect_ratio.num, &out->sample_aspect_ratio.den,
+              (int64_t)frame->width * sar.num * height, (int64_t)frame->height * sar.den * width, INT_MAX);
+    out->color_range = AVCOL_RANGE_MPEG;
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, out);
+    stage_hist_add(&p->stage[PLAYER_STAGE_SCALE], av_gettime_relative() - t0);
+}
+
+// 放入图像队列，由player_refresh按时钟取出
+static int queue_picture(Player *p, AVFrame *pFrame, double pts, double duration, int serial) {
+    VideoPicture *vp;
+    int64_t t0 = av_gettime_relative();
+
+    // 等待空闲的图像队列
+    SDL_LockMutex(p->pictq_mutex);
+    while (atomic_load(&p->pictq_size) >= p->pictq_max && !atomic_load(&p->quit)) {
+        SDL_CondWait(p->pictq_cond, p->pictq_mutex);
+    }
+    SDL_UnlockMutex(p->pictq_mutex);
+    stage_hist_add(&p->stage[PLAYER_STAGE_QUEUE_WAIT], av_gettime_relative() - t0);
+
+    if (atomic_load(&p->quit)) {
+        return -1;
+    }
+
+    // 获取写入位置，直接接管解码帧的引用，不拷贝像素
+    vp = &p->pictq[p->pictq_windex];
+    av_frame_move_ref(vp->frame, pFrame);
+    vp->width = vp->frame->width;
+    vp->height = vp->frame->height;
+    vp->pts = pts;
+    vp->duration = duration;
+    vp->serial = serial;
+
+    if (++p->pictq_windex == VIDEO_PICTURE_QUEUE_SIZE) {
+        p->pictq_windex = 0;
+    }
+
+    // 槽位写完之后才让渲染线程看到
+    SDL_LockMutex(p->pictq_mutex);
+    int was_empty = atomic_fetch_add(&p->pictq_size, 1) == 0;
+    SDL_UnlockMutex(p->pictq_mutex);
+
+    // 渲染线程看到空队列后在无限期等待，只有由空变为非空时需要唤醒它
+    if (was_empty && p->opt.wake_cb) {
+        p->opt.wake_cb(p->opt.opaque);
+    }
+
+    return 0;
+}
+
+// 无头模式：解码出的帧直接交给回调
+static int output_picture(Player *p, AVFrame *pFrame, double pts, double duration) {
+    int ret = p->opt.frame_cb ? p->opt.frame_cb(p->opt.opaque, pFrame, pts, duration) : 0;
+
+    av_frame_unref(pFrame);
+    mark_first(&p->first_frame_us, p);
+    p->frames_shown++;
+    if (ret) {
+        player_set_stopped(p);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * ! 降级策略
+ * 实时模式下按帧相对主时钟的迟到量调整：迟到的帧在入队前丢弃，
+ * 窗口内迟到的比例高时逐级打开解码器的skip_loop_filter/skip_frame，
+ * 追上之后再逐级恢复。音频有自己的线程和队列，不受影响。
+ */
+static int degrade_enabled(Player *p) {
+    return p->opt.realtime && p->opt.framedrop && get_master_sync_type(p) != AV_SYNC_VIDEO_MASTER;
+}
+
+// 帧相对主时钟的迟到量(秒)，正数表示显示时间已经过了
+static double frame_lateness(Player *p, double pts) {
+    double late = get_master_clock(p) - pts;
+    if (isnan(late) || fabs(late) > AV_NOSYNC_THRESHOLD) {
+        return NAN;
+    }
+    return late;
+}
+
+// 按级别设置解码器，帧级多线程时在下一次送包时同步到各个线程
+static void apply_degrade_level(Player *p, AVCodecContext *codecCtx, int level) {
+    codecCtx->skip_loop_filter = level >= DEGRADE_NONREF ? AVDISCARD_ALL :
+                                 level >= DEGRADE_LOOP_FILTER ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    codecCtx->skip_frame = FFMAX(p->opt.skip_frame,
+                                 level >= DEGRADE_KEYFRAMES ? AVDISCARD_NONKEY :
+                                 level >= DEGRADE_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT);
+}
+
+static void set_degrade_level(Player *p, AVCodecContext *codecCtx, int level) {
+    int old = atomic_exchange(&p->degrade_level, level);
+    if (old == level) {
+        return;
+    }
+    apply_degrade_level(p, codecCtx, level);
+    p->degrade_changed = clock_now();
+    atomic_fetch_add(&p->degrade_changes, 1);
+    if (p->opt.verbose) {
+        fprintf(stderr, "video %s: degrade level %d -> %d\n", level > old ? "behind" : "caught up", old, level);
+    }
+}
+
+static void degrade_window_reset(Player *p) {
+    p->window_frames = 0;
+    p->window_late = 0;
+    p->window_min_late = INFINITY;
+    p->window_max_late = -INFINITY;
+}
+
+// 记录一帧的迟到量，攒满一个窗口后决定升级还是降级
+static void degrade_update(Player *p, AVCodecContext *codecCtx, double late) {
+    int level = atomic_load(&p->degrade_level);
+    double now;
+
+    if (isnan(late)) {
+        return;
+    }
+    p->window_frames++;
+    p->window_late += late > 0;
+    p->window_min_late = FFMIN(p->window_min_late, late);
+    p->window_max_late = FFMAX(p->window_max_late, late);
+    if (p->window_frames < DEGRADE_WINDOW) {
+        return;
+    }
+
+    now = clock_now();
+    if (p->window_late >= DEGRADE_WINDOW * DEGRADE_ESCALATE_RATIO) {
+        // 只解码关键帧只在远远落后时使用
+        if (level < DEGRADE_NONREF || (level == DEGRADE_NONREF && p->window_max_late > DEGRADE_KEYFRAME_LATE)) {
+            if (now - p->degrade_changed >= DEGRADE_ESCALATE_HOLD) {
+                set_degrade_level(p, codecCtx, level + 1);
+            }
+        }
+    } else if (level > DEGRADE_NONE && p->window_late == 0 && p->window_max_late < -DEGRADE_RELAX_AHEAD &&
+               now - p->degrade_changed >= DEGRADE_RELAX_HOLD) {
+        set_degrade_level(p, codecCtx, level - 1);
+    }
+    degrade_window_reset(p);
+}
+
+static int video_thread(void *arg) {
+    Player *p = (Player *)arg;
+    AVPacket pkt1, *packet = &pkt1;
+    AVFrame *pFrame;
+    AVCodecContext *codecCtx = p->video_ctx;
+    DecodeStats *stats = &p->video_stats;
+    int serial = atomic_load(&p->seek_serial);
+    double skip_until = NAN;    // seek后丢弃显示时间早于此的帧
+    int64_t queued = 0;         // seek后入队的帧数，第一帧总是显示
+    int64_t t0, t1;
+
+    pFrame = av_frame_alloc();
+    if (!pFrame) {
+        fprintf(stderr, "Could not allocate video frame\n");
+        return -1;
+    }
+    degrade_window_reset(p);
+
+    while (!atomic_load(&p->quit) && !atomic_load(&p->stopped)) {
+        if (packet_queue_get(&p->videoq, packet, 1) < 0) {
+            break;
+        }
+
+        // seek之后冲刷解码器，从落到的关键帧开始计算时间戳
+        if (packet_queue_is_flush(packet)) {
+            av_packet_unref(packet);
+            avcodec_flush_buffers(codecCtx);
+            serial = atomic_load(&p->seek_serial);
+            p->video_clock = p->seek_landed;
+            skip_until = p->seek_target;
+            atomic_store(&p->video_drained, 0);
+            degrade_window_reset(p);
+            queued = 0;
+            continue;
+        }
+
+        // 空包表示文件结尾，送NULL冲刷解码器中缓存的帧
+        int draining = packet_queue_is_eof(packet);
+        t0 = av_gettime_relative();
+        if (!stats->start_time) {
+            stats->start_time = t0;
+        }
+        int ret = avcodec_send_packet(codecCtx, draining ? NULL : packet);
+        t1 = av_gettime_relative();
+        if (ret >= 0 && !draining && atomic_load(&p->degrade_level) >= DEGRADE_NONREF) {
+            atomic_fetch_add(&p->skip_packets, 1);
+        }
+        stats->pending_us += t1 - t0;
+        stage_hist_add_at(&p->stage[PLAYER_STAGE_SEND], t1 - t0, t1);
+        av_packet_unref(packet);
+        if (ret < 0 && !draining) {
+            fprintf(stderr, "Error sending packet for decoding\n");
+            continue;
+        }
+
+        // 接收解码后的帧
+        while (ret >= 0) {
+            t0 = av_gettime_relative();
+            ret = avcodec_receive_frame(codecCtx, pFrame);
+            t1 = av_gettime_relative();
+            stats->pending_us += t1 - t0;
+            stage_hist_add_at(&p->stage[PLAYER_STAGE_RECEIVE], t1 - t0, t1);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                fprintf(stderr, "Error during decoding\n");
+                break;
+            }
+
+            // 上一帧之后花在解码调用上的时间记到这一帧
+            stats->frames++;
+            stats->total_us += stats->pending_us;
+            stats->max_us = FFMAX(stats->max_us, stats->pending_us);
+            stats->pending_us = 0;
+            stats->end_time = av_gettime_relative();
+            mark_first(&p->first_decoded_us, p);
+
+            if (atomic_load(&p->degrade_level) >= DEGRADE_NONREF) {
+                atomic_fetch_add(&p->skip_frames, 1);
+            }
+
+            double duration;
+            double pts = synchronize_video(p, pFrame, &duration);
+
+            // 从关键帧解码到seek目标，中间的帧不显示
+            if (!isnan(skip_until)) {
+                if (pts + duration <= skip_until) {
+                    av_frame_unref(pFrame);
+                    continue;
+                }
+                skip_until = NAN;
+            }
+
+            // 已经迟到的帧不再上传显示；队列里没有后续的包时保留，避免画面停住
+            if (degrade_enabled(p)) {
+                double late = frame_lateness(p, pts);
+                degrade_update(p, codecCtx, late);
+                if (late > 0 && queued > 0 && atomic_load(&p->videoq.nb_packets) > 0) {
+                    atomic_fetch_add(&p->frames_dropped_early, 1);
+                    av_frame_unref(pFrame);
+                    continue;
+                }
+            }
+
+            if (p->opt.realtime) {
+                downscale_picture(p, pFrame);
+                ret = queue_picture(p, pFrame, pts, duration, serial);
+                queued++;
+            } else {
+                ret = output_picture(p, pFrame, pts, duration);
+            }
+            if (ret < 0) {
+                break;
+            }
+        }
+
+        if (draining) {
+            atomic_store(&p->video_drained, 1);
+            player_signal_state(p);
+        }
+    }
+
+    av_frame_free(&pFrame);
+    return 0;
+}
+
+/**
+ * ! 控制
+ */
+// 启动读包、视频解码和音频线程
+int player_start(Player *p) {
+    if (atomic_exchange(&p->started, 1)) {
+        return 0;
+    }
+
+    p->parse_tid = SDL_CreateThread(decode_thread, "decode_thread", p);
+    if (!p->parse_tid) {
+        fprintf(stderr, "Could not create decode thread\n");
+        return -1;
+    }
+    if (p->video_st) {
+        p->video_tid = SDL_CreateThread(video_thread, "video_thread", p);
+        if (!p->video_tid) {
+            fprintf(stderr, "Could not create video thread\n");
+            return -1;
+        }
+    }
+    // 音频线程开始填充环形缓冲区后再启动设备
+    if (p->audio_opened && audio_output_start(&p->audio) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// 暂停/继续，需要和player_refresh在同一线程调用
+void player_pause(Player *p, int paused) {
+    if (atomic_load(&p->paused) == paused) {
+        return;
+    }
+    if (!paused) {
+        // 暂停的时长不算进帧的显示时间
+        p->frame_timer += clock_now() - p->vidclk.last_updated;
+    }
+    set_clock_paused(&p->vidclk, paused);
+    set_clock_paused(&p->audclk, paused);
+    set_clock_paused(&p->extclk, paused);
+    atomic_store(&p->paused, paused);
+    if (p->audio_opened) {
+        audio_output_pause(&p->audio, paused);
+    }
+    // 让decode_thread及时暂停/恢复网络流
+    packet_signal_wake(&p->continue_read);
+}
+
+int player_is_paused(Player *p) {
+    return atomic_load(&p->paused);
+}
+
+// 单帧步进：显示下一帧后暂停，暂停时先恢复播放；和player_refresh在同一线程调用
+void player_step(Player *p) {
+    if (atomic_load(&p->paused)) {
+        player_pause(p, 0);
+    }
+    p->step = 1;
+}
+
+// 设置播放速度(PLAYER_SPEED_MIN ~ PLAYER_SPEED_MAX)，和player_refresh在同一线程调用。
+// 时钟按新速度走，音频经atempo伸缩后保持音调不变
+void player_set_speed(Player *p, double speed) {
+    speed = av_clipd(speed, PLAYER_SPEED_MIN, PLAYER_SPEED_MAX);
+    if (speed == p->speed) {
+        return;
+    }
+    set_clock_speed(&p->vidclk, speed);
+    set_clock_speed(&p->audclk, speed);
+    set_clock_speed(&p->extclk, speed);
+    p->speed = speed;
+    if (p->audio_opened) {
+        audio_output_set_speed(&p->audio, speed);
+    }
+}
+
+double player_get_speed(Player *p) {
+    return p->speed;
+}
+
+// 请求seek到pos(秒)，由decode_thread执行；上一次请求还没执行时忽略
+void player_seek(Player *p, double pos) {
+    AVIOContext *pb = p->pFormatCtx->pb;
+
+    // 管道等不能seek的流式输入
+    if (atomic_load(&p->seek_req) || (p->opt.streaming && pb && !(pb->seekable & AVIO_SEEKABLE_NORMAL))) {
+        return;
+    }
+    p->seek_pos = pos;
+    atomic_store(&p->seek_req, 1);
+    packet_signal_wake(&p->continue_read);
+}
+
+// 从当前播放位置前后seek，不超出文件范围
+void player_seek_relative(Player *p, double incr) {
+    AVFormatContext *ic = p->pFormatCtx;
+    double start = 0;
+    double pos;
+
+    if (ic->start_time != AV_NOPTS_VALUE) {
+        start = ic->start_time / (double)AV_TIME_BASE;
+    }
+
+    pos = get_master_clock(p);
+    if (isnan(pos)) {
+        pos = isnan(p->frame_last_pts) ? start : p->frame_last_pts;
+    }
+    pos += incr;
+    if (ic->duration != AV_NOPTS_VALUE && pos > start + ic->duration / (double)AV_TIME_BASE) {
+        pos = start + ic->duration / (double)AV_TIME_BASE;
+    }
+    if (pos < start) {
+        pos = start;
+    }
+    player_seek(p, pos);
+}
+
+/**
+ * ! 显示
+ */
+// 当前主时钟类型，音频时钟还没开始走时退回到外部时钟
+static int get_master_sync_type(Player *p) {
+    if (p->opt.sync_type == AV_SYNC_VIDEO_MASTER) {
+        return p->video_st ? AV_SYNC_VIDEO_MASTER : AV_SYNC_EXTERNAL_CLOCK;
+    } else if (p->opt.sync_type == AV_SYNC_AUDIO_MASTER) {
+        if (p->audio_opened && !isnan(get_clock(&p->audclk))) {
+            return AV_SYNC_AUDIO_MASTER;
+        }
+        return AV_SYNC_EXTERNAL_CLOCK;
+    }
+    return AV_SYNC_EXTERNAL_CLOCK;
+}
+
+static double get_master_clock(Player *p) {
+    switch (get_master_sync_type(p)) {
+        case AV_SYNC_VIDEO_MASTER:
+            return get_clock(&p->vidclk);
+        case AV_SYNC_AUDIO_MASTER:
+            return get_clock(&p->audclk);
+        default:
+            return get_clock(&p->extclk);
+    }
+}
+
+double player_master_clock(Player *p) {
+    return get_master_clock(p);
+}
+
+// 两帧之间的时长，时间戳不连续时用帧率估计值
+static double frame_duration(double pts, double next_pts, double fallback) {
+    double duration = next_pts - pts;
+    if (isnan(duration) || duration <= 0 || duration > AV_NOSYNC_THRESHOLD) {
+        return fallback;
+    }
+    return duration;
+}
+
+// 按视频时钟和主时钟的误差调整帧延迟：落后时缩短，超前时加长
+static double compute_target_delay(Player *p, double delay) {
+    double sync_threshold, diff;
+
+    if (get_master_sync_type(p) == AV_SYNC_VIDEO_MASTER) {
+        return delay;
+    }
+
+    // 时钟差是pts差，变速时换算成显示时间
+    diff = (get_clock(&p->vidclk) - get_master_clock(p)) / p->speed;
+    sync_threshold = FFMAX(AV_SYNC_THRESHOLD_MIN, FFMIN(AV_SYNC_THRESHOLD_MAX, delay));
+    if (!isnan(diff) && fabs(diff) < AV_NOSYNC_THRESHOLD) {
+        if (diff <= -sync_threshold) {
+            delay = FFMAX(0, delay + diff);
+        } else if (diff >= sync_threshold && delay > AV_SYNC_FRAMEDUP_THRESHOLD) {
+            delay = delay + diff;
+        } else if (diff >= sync_threshold) {
+            delay = 2 * delay;
+        }
+    }
+    return delay;
+}
+
+// 读位置前进一帧，释放帧引用，并通知video_thread有空位
+static void pictq_next(Player *p) {
+    av_frame_unref(p->pictq[p->pictq_rindex].frame);
+    if (++p->pictq_rindex == VIDEO_PICTURE_QUEUE_SIZE) {
+        p->pictq_rindex = 0;
+    }
+
+    SDL_LockMutex(p->pictq_mutex);
+    atomic_fetch_sub(&p->pictq_size, 1);
+    SDL_CondSignal(p->pictq_cond);
+    SDL_UnlockMutex(p->pictq_mutex);
+}
+
+// 前端显示区域(去掉黑边后)的像素尺寸，窗口大小变化时更新；opt.downscale打开时，
+// 比它大很多的帧在入队前缩小
+void player_set_display_size(Player *p, int width, int height) {
+    atomic_store(&p->display_width, FFMAX(width, 0));
+    atomic_store(&p->display_height, FFMAX(height, 0));
+}
+
+// 设置显示提前量：回调里的显示要等到下一次垂直同步时，帧在clock_now() + lead
+// 到达显示时间时就交给回调，player_refresh返回的等待时间也相应提前
+void player_set_present_lead(Player *p, double lead) {
+    p->present_lead = FFMAX(0, lead);
+}
+
+// 实时模式：把到了显示时间的帧交给回调，返回距离下一次应当调用的秒数。
+// 没有排定的帧(没有视频流、暂停、图像队列为空)时返回INFINITY，新帧入队时由opt.wake_cb通知
+double player_refresh(Player *p) {
+    VideoPicture *vp, *nextvp;
+    double time, delay, duration;
+    int serial, seek_done = 0;
+
+    if (!p->video_st || atomic_load(&p->paused)) {
+        return INFINITY;
+    }
+
+retry:
+    if (atomic_load(&p->pictq_size) == 0) {
+        return INFINITY;
+    }
+
+    vp = &p->pictq[p->pictq_rindex];
+
+    // seek之前解码的帧
+    serial = atomic_load(&p->seek_serial);
+    if (vp->serial != serial) {
+        pictq_next(p);
+        goto retry;
+    }
+
+    // seek后的第一帧：重新开始计时，立即显示
+    if (p->frame_serial != serial) {
+        p->frame_serial = serial;
+        p->frame_last_pts = NAN;
+        p->frame_timer = clock_now() - p->frame_last_delay;
+        set_clock(&p->vidclk, vp->pts);
+        set_clock(&p->extclk, vp->pts);
+        seek_done = serial > 0;
+    }
+
+    // 由上一帧到这一帧的pts差得到延迟，再向主时钟校正
+    // 帧间隔按播放速度缩放成显示时间
+    delay = frame_duration(p->frame_last_pts, vp->pts, p->frame_last_delay);
+    p->frame_last_delay = delay;
+    delay = compute_target_delay(p, delay / p->speed);
+
+    time = clock_now() + p->present_lead;
+    if (time < p->frame_timer + delay) {
+        // 帧来早了，等到它的显示时间
+        return p->frame_timer + delay - time;
+    }
+
+    p->frame_timer += delay;
+    if (delay > 0 && time - p->frame_timer > AV_SYNC_THRESHOLD_MAX) {
+        p->frame_timer = time;
+    }
+
+    p->frame_last_pts = vp->pts;
+    // 视频时钟以帧真正显示出来的时间为准
+    set_clock_at(&p->vidclk, vp->pts, time);
+    if (isnan(get_clock(&p->extclk))) {
+        set_clock(&p->extclk, vp->pts);
+    }
+
+    // 下一帧的显示时间也已经过了，丢掉这一帧
+    if (atomic_load(&p->pictq_size) > 1 && get_master_sync_type(p) != AV_SYNC_VIDEO_MASTER) {
+        nextvp = &p->pictq[(p->pictq_rindex + 1) % VIDEO_PICTURE_QUEUE_SIZE];
+        duration = frame_duration(vp->pts, nextvp->pts, vp->duration) / p->speed;
+        if (time > p->frame_timer + duration) {
+            p->frame_drops_late++;
+            pictq_next(p);
+            goto retry;
+        }
+    }
+
+    // 采样队列深度
+    stage_hist_add(&p->depth[PLAYER_DEPTH_VIDEOQ], atomic_load(&p->videoq.nb_packets));
+    stage_hist_add(&p->depth[PLAYER_DEPTH_AUDIOQ], atomic_load(&p->audioq.nb_packets));
+    stage_hist_add(&p->depth[PLAYER_DEPTH_PICTQ], atomic_load(&p->pictq_size));
+
+    // 交给前端显示
+    if (p->opt.frame_cb && p->opt.frame_cb(p->opt.opaque, vp->frame, vp->pts, vp->duration)) {
+        player_set_stopped(p);
+    }
+    mark_first(&p->first_frame_us, p);
+    p->frames_shown++;
+
+    if (seek_done) {
+        fprintf(stderr, "seek to %.2f s: keyframe %.2f s, first frame %.2f s shown after %.1f ms\n",
+                p->seek_target, p->seek_landed, vp->pts,
+                (clock_now() - p->seek_start_time) * 1000.0);
+    }
+
+    // 单帧步进：显示一帧后重新暂停
+    if (p->step) {
+        p->step = 0;
+        pictq_next(p);
+        player_pause(p, 1);
+        return INFINITY;
+    }
+
+    // 预计下一帧的显示时间，到时再精确校正
+    duration = vp->duration / p->speed;
+    pictq_next(p);
+    return FFMAX(0, p->frame_timer + duration - clock_now() - p->present_lead);
+}
+
+// 读到结尾且所有数据都已输出，或者回调要求停止
+int player_finished(Player *p) {
+    if (atomic_load(&p->stopped)) {
+        return 1;
+    }
+    if (!atomic_load(&p->eof)) {
+        return 0;
+    }
+    if (p->video_st && !atomic_load(&p->video_drained)) {
+        return 0;
+    }
+    if (p->audio_opened && (!atomic_load(&p->audio.drained) || audio_output_buffered(&p->audio) > 0)) {
+        return 0;
+    }
+    return !p->opt.realtime || atomic_load(&p->pictq_size) == 0;
+}
+
+// 等待播放结束，回调要求停止时返回1
+int player_wait(Player *p) {
+    SDL_LockMutex(p->state_mutex);
+    while (!player_finished(p) && !atomic_load(&p->quit)) {
+        // 音频缓冲播放完没有通知，定时检查
+        SDL_CondWaitTimeout(p->state_cond, p->state_mutex, 100);
+    }
+    SDL_UnlockMutex(p->state_mutex);
+    return atomic_load(&p->stopped) ? 1 : 0;
+}
+
+// 停止所有线程并关闭音频设备，统计仍然可以读取
+void player_stop(Player *p) {
+    atomic_store(&p->quit, 1);
+
+    // 设置队列退出标志，打开失败时队列可能还没创建
+    if (p->audioq.mutex) {
+        packet_queue_quit(&p->audioq);
+    }
+    if (p->videoq.mutex) {
+        packet_queue_quit(&p->videoq);
+    }
+    packet_signal_wake(&p->continue_read);
+
+    // 唤醒等待图像队列空位的video_thread
+    if (p->pictq_mutex) {
+        SDL_LockMutex(p->pictq_mutex);
+        SDL_CondBroadcast(p->pictq_cond);
+        SDL_UnlockMutex(p->pictq_mutex);
+    }
+    if (p->state_mutex) {
+        player_signal_state(p);
+    }
+
+    if (p->parse_tid) {
+        SDL_WaitThread(p->parse_tid, NULL);
+        p->parse_tid = NULL;
+    }
+    if (p->video_tid) {
+        SDL_WaitThread(p->video_tid, NULL);
+        p->video_tid = NULL;
+    }
+    // 关闭音频设备后回调不再访问环形缓冲区
+    if (p->audio_opened) {
+        audio_output_close(&p->audio);
+    }
+    keyframe_index_close(&p->kf_index);
+}
+
+void player_close(Player *p) {
+    if (!p) {
+        return;
+    }
+    player_stop(p);
+
+    packet_queue_destroy(&p->videoq);
+    packet_queue_destroy(&p->audioq);
+    packet_signal_destroy(&p->continue_read);
+    for (int i = 0; i < VIDEO_PICTURE_QUEUE_SIZE; i++) {
+        av_frame_free(&p->pictq[i].frame);
+    }
+    if (p->pictq_mutex) {
+        SDL_DestroyMutex(p->pictq_mutex);
+    }
+    if (p->pictq_cond) {
+        SDL_DestroyCond(p->pictq_cond);
+    }
+    if (p->state_mutex) {
+        SDL_DestroyMutex(p->state_mutex);
+    }
+    if (p->state_cond) {
+        SDL_DestroyCond(p->state_cond);
+    }
+
+    sws_freeContext(p->scale_ctx);
+    av_frame_free(&p->scale_frame);
+    avcodec_free_context(&p->video_ctx);
+    avcodec_free_context(&p->audio_ctx);
+    frame_pool_destroy(&p->frame_pool);
+    if (p->pFormatCtx) {
+        avformat_close_input(&p->pFormatCtx);
+    }
+    // 自定义的AVIOContext不会被avformat_close_input释放
+    read_ahead_close(&p->read_ahead);
+    if (p->audio_subsystem) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+    av_free(p);
+}
+
+AVStream *player_video_stream(Player *p) {
+    return p->video_st;
+}
+
+AVStream *player_audio_stream(Player *p) {
+    return p->audio_opened ? p->audio_st : NULL;
+}
+
+/**
+ * ! 统计
+ */
+StageHist *player_stage(Player *p, int stage) {
+    return &p->stage[stage];
+}
+
+void player_get_stats(Player *p, PlayerStats *stats) {
+    DecodeStats *ds = &p->video_stats;
+    double wall = (ds->end_time - ds->start_time) / 1000000.0;
+    FramePoolStats pool;
+
+    memset(stats, 0, sizeof(PlayerStats));
+    frame_pool_get_stats(&p->frame_pool, &pool);
+    stats->pool_allocs = pool.allocs;
+    stats->pool_frames = pool.gets;
+    stats->pool_steady_frames = pool.gets - pool.last_alloc_get;
+    stats->pool_steady_heap_allocs = pool.steady_heap_allocs;
+    if (p->read_ahead) {
+        ReadAheadStats io;
+        read_ahead_get_stats(p->read_ahead, &io);
+        stats->io_stalls = io.stalls;
+        stats->io_stall_ms = io.stall_us / 1000.0;
+    }
+    stats->frames_decoded = ds->frames;
+    stats->frames_shown = p->frames_shown;
+    stats->frames_dropped_late = p->frame_drops_late;
+    stats->frames_dropped_early = atomic_load(&p->frames_dropped_early);
+    stats->frames_skipped = FFMAX(0, atomic_load(&p->skip_packets) - atomic_load(&p->skip_frames));
+    stats->degrade_level = atomic_load(&p->degrade_level);
+    stats->degrade_changes = atomic_load(&p->degrade_changes);
+    stats->audio_underruns = p->audio_opened ? atomic_load(&p->audio.underruns) : 0;
+    stats->probe_ms = p->probe_us ? p->probe_us / 1000.0 : -1;
+    stats->open_ms = p->open_us ? p->open_us / 1000.0 : -1;
+    int64_t first_decoded = atomic_load(&p->first_decoded_us);
+    int64_t first_frame = atomic_load(&p->first_frame_us);
+    stats->first_decoded_ms = first_decoded ? first_decoded / 1000.0 : -1;
+    stats->first_frame_ms = first_frame ? first_frame / 1000.0 : -1;
+    if (ds->frames > 0) {
+        stats->decode_avg_ms = ds->total_us / 1000.0 / ds->frames;
+        stats->decode_max_ms = ds->max_us / 1000.0;
+        stats->decode_fps = wall > 0 ? ds->frames / wall : 0.0;
+    }
+}
+
+// 输出视频解码耗时和音频欠载统计
+void player_print_summary(Player *p, FILE *f) {
+    AVCodecContext *codecCtx = p->video_ctx;
+    PlayerStats stats;
+
+    player_get_stats(p, &stats);
+    fprintf(f, "startup: probe %.1f ms (probesize %lld, analyzeduration %lld us), open %.1f ms, "
+               "first frame decoded %.1f ms, shown %.1f ms\n",
+            stats.probe_ms, (long long)p->pFormatCtx->probesize,
+            (long long)p->pFormatCtx->max_analyze_duration, stats.open_ms,
+            stats.first_decoded_ms, stats.first_frame_ms);
+    if (codecCtx && stats.frames_decoded > 0) {
+        fprintf(f, "video decode: %s %dx%d, threads %d (%s)\n",
+                codecCtx->codec ? codecCtx->codec->name : "?",
+                codecCtx->width, codecCtx->height, codecCtx->thread_count,
+                codecCtx->active_thread_type == FF_THREAD_FRAME ? "frame" :
+                codecCtx->active_thread_type == FF_THREAD_SLICE ? "slice" : "none");
+        fprintf(f, "video decode: %lld frames, avg %.2f ms, max %.2f ms, %.1f fps, %d dropped late\n",
+                (long long)stats.frames_decoded, stats.decode_avg_ms, stats.decode_max_ms,
+                stats.decode_fps, stats.frames_dropped_late);
+        if (stats.degrade_changes > 0 || stats.frames_dropped_early > 0) {
+            fprintf(f, "video degrade: %lld dropped before upload, %lld skipped by decoder, "
+                       "level %d, %d level changes\n",
+                    (long long)stats.frames_dropped_early, (long long)stats.frames_skipped,
+                    stats.degrade_level, stats.degrade_changes);
+        }
+        frame_pool_print(&p->frame_pool, f);
+    }
+    if (p->audio_opened) {
+        static const char *const convert_names[] = {"swresample", "none", "interleave"};
+        fprintf(f, "audio: %d Hz, %d channels, %s, %d-sample device buffer (%.1f ms), conversion %s, "
+                   "%d underruns\n",
+                p->audio.spec.freq, p->audio.spec.channels, av_get_sample_fmt_name(p->audio.out_fmt),
+                p->audio.spec.samples, p->audio.spec.samples * 1000.0 / p->audio.spec.freq,
+                convert_names[p->audio.convert], stats.audio_underruns);
+    }
+    if (p->opt.memory_cap) {
+        fprintf(f, "memory cap: %.1f MB, packet queues %.1f MB, picture queue %d x %.1f MB\n",
+                p->opt.memory_cap / (1024.0 * 1024.0), p->opt.max_queue_size / (1024.0 * 1024.0),
+                p->pictq_max, p->pictq_frame_bytes / (1024.0 * 1024.0));
+    }
+    if (p->read_ahead) {
+        read_ahead_print(p->read_ahead, f);
+    }
+}
+
+// 打印当前队列深度和各阶段耗时分布
+void player_print_stats(Player *p, FILE *f) {
+    fprintf(f, "stats: videoq %d pkts, audioq %d pkts, pictq %d frames, pcm %zu bytes, %d dropped late, "
+               "%lld dropped early, degrade level %d, %d underruns\n",
+            atomic_load(&p->videoq.nb_packets), atomic_load(&p->audioq.nb_packets),
+            atomic_load(&p->pictq_size), p->audio_opened ? audio_output_buffered(&p->audio) : 0,
+            p->frame_drops_late, (long long)atomic_load(&p->frames_dropped_early),
+            atomic_load(&p->degrade_level), p->audio_opened ? atomic_load(&p->audio.underruns) : 0);
+    for (int i = 0; i < PLAYER_STAGE_NB; i++) {
+        stage_hist_print(&p->stage[i], f);
+    }
+    for (int i = 0; i < PLAYER_DEPTH_NB; i++) {
+        stage_hist_print(&p->depth[i], f);
+    }
+}
+
+// 把统计写成JSON
+int player_write_stats_json(Player *p, const char *path) {
+    PlayerStats stats;
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return -1;
+    }
+
+    player_get_stats(p, &stats);
+    fprintf(f, "{\n  \"stages\": {\n");
+    for (int i = 0; i < PLAYER_STAGE_NB; i++) {
+        fprintf(f, "    ");
+        stage_hist_json(&p->stage[i], f);
+        fprintf(f, i + 1 < PLAYER_STAGE_NB ? ",\n" : "\n");
+    }
+    fprintf(f, "  },\n  \"depths\": {\n");
+    for (int i = 0; i < PLAYER_DEPTH_NB; i++) {
+        fprintf(f, "    ");
+        stage_hist_json(&p->depth[i], f);
+        fprintf(f, i + 1 < PLAYER_DEPTH_NB ? ",\n" : "\n");
+    }
+    fprintf(f, "  },\n  \"counters\": {\"frames_decoded\": %lld, \"frames_shown\": %lld, "
+               "\"frames_dropped_late\": %d, \"frames_dropped_early\": %lld, \"frames_skipped\": %lld, "
+               "\"degrade_changes\": %d, \"audio_underruns\": %d, "
+               "\"pool_allocs\": %lld, \"pool_frames\": %lld, \"pool_steady_frames\": %lld, "
+               "\"pool_steady_heap_allocs\": %lld, "
+               "\"io_stalls\": %lld, \"io_stall_ms\": %.3f},\n"
+               "  \"startup\": {\"probe_ms\": %.3f, \"open_ms\": %.3f, \"first_decoded_ms\": %.3f, "
+               "\"first_frame_ms\": %.3f}\n}\n",
+            (long long)stats.frames_decoded, (long long)stats.frames_shown,
+            stats.frames_dropped_late, (long long)stats.frames_dropped_early,
+            (long long)stats.frames_skipped, stats.degrade_changes, stats.audio_underruns,
+            (long long)stats.pool_allocs, (long long)stats.pool_frames,
+            (long long)stats.pool_steady_frames, (long long)stats.pool_steady_heap_allocs,
+            (long long)stats.io_stalls, stats.io_stall_ms,
+            stats.probe_ms, stats.open_ms, stats.first_decoded_ms, stats.first_frame_ms);
+    fclose(f);
+    return 0;
+}
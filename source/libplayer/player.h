@@ -0,0 +1,134 @@
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <stdio.h>
+#include "read_ahead.h"
+#include "stage_stats.h"
+
+// 热路径各阶段的耗时直方图(微秒)
+enum {
+    PLAYER_STAGE_READ,          // 读包线程: av_read_frame
+    PLAYER_STAGE_SEND,          // 视频线程: avcodec_send_packet
+    PLAYER_STAGE_RECEIVE,       // 视频线程: avcodec_receive_frame
+    PLAYER_STAGE_SCALE,         // 视频线程: 显示区域远小于视频时的缩小
+    PLAYER_STAGE_QUEUE_WAIT,    // 视频线程: 等待图像队列空位
+    PLAYER_STAGE_UPLOAD,        // 前端: 上传纹理，由前端记录
+    PLAYER_STAGE_PRESENT,       // 前端: 显示，由前端记录
+    PLAYER_STAGE_PRESENT_JITTER, // 前端: 相邻两次显示的间隔与两帧pts差之间的偏差，由前端记录
+    PLAYER_STAGE_AUDIO_FILL,    // 音频回调: 填充设备缓冲
+    PLAYER_STAGE_NB
+};
+
+// 周期采样的队列深度
+enum {
+    PLAYER_DEPTH_VIDEOQ,        // 视频包队列(包数)
+    PLAYER_DEPTH_AUDIOQ,        // 音频包队列(包数)
+    PLAYER_DEPTH_PICTQ,         // 图像队列(帧数)
+    PLAYER_DEPTH_PCM,           // PCM环形缓冲区(毫秒)
+    PLAYER_DEPTH_NB
+};
+
+/**
+ * ! 帧回调
+ * 实时模式下由player_refresh在调用者线程上、帧的显示时间到了时调用；
+ * 无头模式下由视频解码线程在解码出帧后立即调用。
+ * frame只在回调期间有效，需要保留时用av_frame_ref。
+ * 返回非0时停止播放。
+ */
+typedef int (*PlayerFrameCallback)(void *opaque, AVFrame *frame, double pts, double duration);
+
+/**
+ * ! 唤醒回调
+ * 实时模式下图像队列由空变为非空时在视频线程上调用。player_refresh在队列为空时返回INFINITY，
+ * 调用者据此无限期等待，由这个回调唤醒(例如SDL_PushEvent)后重新调用player_refresh。
+ */
+typedef void (*PlayerWakeCallback)(void *opaque);
+
+// 播放速度范围
+#define PLAYER_SPEED_MIN 0.25
+#define PLAYER_SPEED_MAX 4.0
+
+typedef struct PlayerOptions {
+    int sync_type;              // AV_SYNC_AUDIO_MASTER / AV_SYNC_VIDEO_MASTER / AV_SYNC_EXTERNAL_CLOCK
+    int decode_threads;         // 视频解码线程数，0表示按CPU核数自动选择
+    int thread_type;            // FF_THREAD_FRAME / FF_THREAD_SLICE
+    int skip_frame;             // 视频解码器的skip_frame，例如AVDISCARD_NONKEY
+    int audio;                  // 是否打开音频流和音频设备
+    int audio_samples;          // 音频设备缓冲的采样数，0表示AUDIO_OUTPUT_SAMPLES；小则延迟低、回调多
+    int realtime;               // 1: 按时钟显示；0: 无头模式，帧解码出来就交给回调
+    int keyframe_index;         // 是否建立关键帧索引加速seek
+    int verbose;                // 打开时打印av_dump_format
+    int framedrop;              // 实时模式下视频落后时丢帧并降低解码质量
+    int io_mode;                // READ_AHEAD_OFF / READ_AHEAD_THREAD / READ_AHEAD_MMAP，只对本地文件生效
+    size_t io_buffer_size;      // 预读缓冲区字节数，0表示READ_AHEAD_DEFAULT_SIZE
+    size_t max_queue_size;      // 所有包队列的字节数上限，0表示默认的15MB
+    int fast_start;             // 快速启动：缩小探测范围，第一帧解码出来立即显示
+    int64_t probesize;          // 探测流信息最多读取的字节数，0表示默认(快速启动时为512KB)
+    int64_t analyzeduration;    // 探测流信息最多分析的时长(微秒)，0表示默认(快速启动时为0.5秒)
+    int downscale;              // 实时模式下显示区域远小于视频时，入队前在视频线程上缩小(见player_set_display_size)
+    int streaming;              // 流式输入(管道、FIFO、标准输入"-"、还在写入的文件)：顺序读、低延迟解复用和解码
+    size_t memory_cap;          // 包队列、图像队列、PCM和预读缓冲区合计的字节数上限，0表示只受max_queue_size限制
+    PlayerFrameCallback frame_cb;
+    PlayerWakeCallback wake_cb;
+    void *opaque;
+} PlayerOptions;
+
+// 播放计数
+typedef struct PlayerStats {
+    int64_t frames_decoded;     // 解码出的视频帧数
+    int64_t frames_shown;       // 交给回调的视频帧数
+    int frames_dropped_late;    // 显示前因为迟到而丢弃的帧数
+    int64_t frames_dropped_early; // 解码后入队前因为迟到而丢弃的帧数
+    int64_t frames_skipped;     // 降级时解码器跳过的帧数(送入的包数减去解码出的帧数)
+    int degrade_level;          // 当前降级级别，0为正常解码
+    int degrade_changes;        // 调整降级级别的次数
+    int audio_underruns;        // 音频回调时数据不足的次数
+    double decode_avg_ms;       // 每帧平均解码耗时
+    double decode_max_ms;
+    double decode_fps;          // 解码线程的吞吐
+    int64_t pool_allocs;        // 帧缓冲池新分配的缓冲区数
+    int64_t pool_frames;        // 从帧缓冲池取缓冲区的帧数
+    int64_t pool_steady_frames; // 最后一次新分配之后没有新分配像素缓冲区的帧数
+    int64_t pool_steady_heap_allocs; // 这些帧期间整个进程的堆分配次数，需要LD_PRELOAD alloc_count.so，否则为-1
+    int64_t io_stalls;          // 解复用器等待预读数据的次数
+    double io_stall_ms;         // 等待的总时间
+    // 启动耗时，从player_open开始计时(毫秒)，还没到达的阶段为-1
+    double probe_ms;            // 打开文件并探测完流信息
+    double open_ms;             // 解码器和音频设备打开完成
+    double first_decoded_ms;    // 解码出第一帧
+    double first_frame_ms;      // 第一帧交给回调(time-to-first-frame)
+} PlayerStats;
+
+typedef struct Player Player;
+
+void player_default_options(PlayerOptions *opt);
+Player *player_open(const char *filename, const PlayerOptions *opt);
+int player_start(Player *p);
+void player_pause(Player *p, int paused);
+int player_is_paused(Player *p);
+void player_step(Player *p);
+void player_set_speed(Player *p, double speed);
+double player_get_speed(Player *p);
+void player_seek(Player *p, double pos);
+void player_seek_relative(Player *p, double incr);
+double player_refresh(Player *p);
+void player_set_present_lead(Player *p, double lead);
+void player_set_display_size(Player *p, int width, int height);
+int player_wait(Player *p);
+int player_finished(Player *p);
+void player_stop(Player *p);
+void player_close(Player *p);
+
+AVStream *player_video_stream(Player *p);
+AVStream *player_audio_stream(Player *p);
+double player_master_clock(Player *p);
+
+StageHist *player_stage(Player *p, int stage);
+void player_get_stats(Player *p, PlayerStats *stats);
+void player_print_summary(Player *p, FILE *f);
+void player_print_stats(Player *p, FILE *f);
+int player_write_stats_json(Player *p, const char *path);
+
+#endif
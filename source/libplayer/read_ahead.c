@@ -0,0 +1,612 @@
+#include "read_ahead.h"
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#define READ_AHEAD_AVIO_BUFFER (64 * 1024)  // AVIOContext自己的缓冲区
+#define READ_AHEAD_CHUNK (512 * 1024)       // I/O线程每次读取的大小
+#define READ_AHEAD_MIN_READ (64 * 1024)     // 空间少于这些时I/O线程先等待，避免零碎小读
+#define READ_AHEAD_MIN_SIZE (2 * READ_AHEAD_CHUNK)
+#define READ_AHEAD_URING_DEPTH 4            // io_uring同时在途的读请求数
+#define READ_AHEAD_WAIT_MS 10               // 解复用器等待数据时检查中断的间隔
+#define READ_AHEAD_MMAP_STALL_US 1000       // mmap模式下单次拷贝超过这个时间计为一次等待
+#define READ_AHEAD_FOLLOW_MS 50             // 流式模式下等待文件增长或FIFO写端的间隔
+
+struct ReadAhead {
+    int mode;
+    int fd;
+    int regular;                // fd是普通文件，可以pread
+    int64_t file_size;          // 打开时的文件大小，不可seek(管道、流式模式)时为-1
+    AVIOContext *avio;
+    AVIOInterruptCB int_cb;
+
+    // mmap模式
+    uint8_t *map;
+    size_t page_size;
+    int64_t advised;            // 已经madvise(WILLNEED)到的位置
+
+    // 线程模式：环形缓冲区保存文件[max(base, wpos + chunk - size), wpos)的数据
+    uint8_t *ring;
+    size_t size;
+    size_t back;                // 读位置之后保留的已读数据，供小范围向后seek
+    int64_t base;               // 环形缓冲区最后一次重置的文件位置
+    int64_t rpos;               // 解复用器的读位置，只有读端修改
+    int64_t wpos;               // 已读入的数据末尾，只有I/O线程修改
+    int eof;                    // I/O线程已读到文件结尾
+    int64_t idle_start;         // 流式模式下开始等待文件增长的时间，0表示没有在等待
+    int error;                  // I/O线程的读错误
+    int generation;             // 每次重置加1，I/O线程据此丢弃重置前发出的读取
+    int quit;
+    SDL_mutex *mutex;
+    SDL_cond *data_cond;        // I/O线程读入数据后唤醒解复用器
+    SDL_cond *space_cond;       // 读走数据或重置后唤醒I/O线程
+    SDL_Thread *tid;
+#ifdef HAVE_LIBURING
+    struct io_uring uring;
+#endif
+    int uring_ok;
+    int uring_failed;           // 提交失败过，环里可能留着没提交的请求，只由I/O线程访问，之后都用pread
+
+    // 计数
+    atomic_llong bytes_read;
+    atomic_llong bytes_consumed;
+    atomic_llong stalls;
+    atomic_llong stall_us;
+    atomic_llong seeks_buffered;
+    atomic_llong seeks_reset;
+};
+
+const char *read_ahead_mode_name(int mode) {
+    switch (mode) {
+    case READ_AHEAD_THREAD:
+        return "thread";
+    case READ_AHEAD_MMAP:
+        return "mmap";
+    case READ_AHEAD_STREAM:
+        return "stream";
+    default:
+        return "off";
+    }
+}
+
+// 命令行取值off|thread|mmap，未知时返回-1
+int read_ahead_parse_mode(const char *name) {
+    for (int mode = READ_AHEAD_OFF; mode <= READ_AHEAD_MMAP; mode++) {
+        if (!strcmp(name, read_ahead_mode_name(mode))) {
+            return mode;
+        }
+    }
+    return -1;
+}
+
+/** ! I/O线程 */
+
+#ifdef HAVE_LIBURING
+// 收回一个读请求的完成事件，结果记到res里。提交过的请求在返回前必须全部收回，
+// 否则内核还会往dst里写：io_uring_wait_cqe失败时改为直接查看完成队列，普通文件的读请求总会完成
+static void read_ahead_reap(ReadAhead *ra, int *res) {
+    struct io_uring_cqe *cqe;
+    int ret;
+
+    do {
+        ret = io_uring_wait_cqe(&ra->uring, &cqe);
+    } while (ret == -EINTR);
+    if (ret < 0) {
+        while (io_uring_peek_cqe(&ra->uring, &cqe) != 0) {
+            av_usleep(1000);
+        }
+    }
+    res[(intptr_t)io_uring_cqe_get_data(cqe)] = cqe->res;
+    io_uring_cqe_seen(&ra->uring, cqe);
+}
+
+// 拆成几个请求同时提交，冷存储上可以并行读取。结果同read_ahead_fill，存到*total；
+// 一个请求都没提交成功时返回-1，由调用者改用pread
+static int read_ahead_fill_uring(ReadAhead *ra, uint8_t *dst, size_t len, int64_t pos, int64_t *total) {
+    size_t piece[READ_AHEAD_URING_DEPTH];
+    int res[READ_AHEAD_URING_DEPTH];
+    int n = 0, submitted = 0, done = 0, ret = 0;
+
+    for (size_t off = 0; off < len && n < READ_AHEAD_URING_DEPTH; off += piece[n++]) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ra->uring);
+        if (!sqe) {
+            break;
+        }
+        piece[n] = FFMIN((size_t)READ_AHEAD_CHUNK, len - off);
+        io_uring_prep_read(sqe, ra->fd, dst + off, piece[n], pos + off);
+        io_uring_sqe_set_data(sqe, (void *)(intptr_t)n);
+    }
+
+    // 内核可能只接受一部分请求，剩下的还在提交队列里，再次提交；
+    // 暂时提交不了(EAGAIN/EBUSY)时先收回一个完成事件腾出资源
+    while (submitted < n) {
+        ret = io_uring_submit(&ra->uring);
+        if (ret > 0) {
+            submitted += ret;
+        } else if (ret == -EINTR) {
+            continue;
+        } else if ((ret == 0 || ret == -EAGAIN || ret == -EBUSY) && done < submitted) {
+            read_ahead_reap(ra, res);
+            done++;
+        } else {
+            break;
+        }
+    }
+
+    // 只等已经提交的请求，出错也要全部收回才返回
+    while (done < submitted) {
+        read_ahead_reap(ra, res);
+        done++;
+    }
+
+    // 没提交的请求还留在提交队列里，这个环不能再用：以后的读都走pread
+    if (submitted < n) {
+        fprintf(stderr, "io_uring submit failed - %s, read-ahead falls back to pread\n",
+                strerror(ret < 0 ? -ret : EAGAIN));
+        ra->uring_failed = 1;
+        n = submitted;
+    }
+    if (n == 0) {
+        return -1;
+    }
+
+    // 按顺序提交结果，遇到短读或错误就停在那里
+    *total = 0;
+    for (int i = 0; i < n; i++) {
+        if (res[i] < 0) {
+            *total = *total ? *total : res[i];
+            break;
+        }
+        *total += res[i];
+        if ((size_t)res[i] < piece[i]) {
+            break;
+        }
+    }
+    return 0;
+}
+#endif
+
+// 从文件pos处读取最多len字节到dst，返回读到的字节数，0表示文件结尾，负数为AVERROR
+static int64_t read_ahead_fill(ReadAhead *ra, uint8_t *dst, size_t len, int64_t pos) {
+#ifdef HAVE_LIBURING
+    int64_t total;
+    if (ra->uring_ok && !ra->uring_failed && read_ahead_fill_uring(ra, dst, len, pos, &total) == 0) {
+        return total;
+    }
+#endif
+    ssize_t n;
+    do {
+        n = pread(ra->fd, dst, len, pos);
+    } while (n < 0 && errno == EINTR);
+    return n < 0 ? AVERROR(errno) : n;
+}
+
+// 流式读取，忽略pos顺序读：普通文件读到当前末尾、管道暂时没有数据时返回AVERROR(EAGAIN)，
+// 返回0表示写端已经关闭。管道用poll限时等待，不会阻塞在read里，关闭时不用等写端
+static int64_t read_ahead_fill_stream(ReadAhead *ra, uint8_t *dst, size_t len, int64_t pos) {
+    ssize_t n;
+
+    if (ra->regular) {
+        do {
+            n = pread(ra->fd, dst, len, pos);
+        } while (n < 0 && errno == EINTR);
+        if (n == 0) {
+            return AVERROR(EAGAIN);
+        }
+        return n < 0 ? AVERROR(errno) : n;
+    }
+
+    struct pollfd pfd = { .fd = ra->fd, .events = POLLIN };
+    int ret = poll(&pfd, 1, READ_AHEAD_WAIT_MS);
+    if (ret < 0 && errno != EINTR) {
+        return AVERROR(errno);
+    }
+    if (ret <= 0) {
+        return AVERROR(EAGAIN);
+    }
+    do {
+        n = read(ra->fd, dst, len);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return errno == EAGAIN ? AVERROR(EAGAIN) : AVERROR(errno);
+    }
+    if (n == 0 && atomic_load(&ra->bytes_read) == 0) {
+        // FIFO的写端还没打开过，read直接返回0；稍等再试，不算结尾
+        SDL_Delay(READ_AHEAD_FOLLOW_MS);
+        return AVERROR(EAGAIN);
+    }
+    return n;
+}
+
+static int read_ahead_thread(void *arg) {
+    ReadAhead *ra = (ReadAhead *)arg;
+
+    SDL_LockMutex(ra->mutex);
+    while (!ra->quit) {
+        if (ra->eof || ra->error) {
+            SDL_CondWait(ra->space_cond, ra->mutex);
+            continue;
+        }
+
+        // 写入区域覆盖的是文件[wpos - size, wpos - size + len)的旧数据，
+        // 必须早于读位置之后保留的back字节
+        int64_t back = FFMIN((int64_t)ra->back, ra->rpos - ra->base);
+        int64_t space = (int64_t)ra->size - back - (ra->wpos - ra->rpos);
+        if (space < READ_AHEAD_MIN_READ) {
+            SDL_CondWait(ra->space_cond, ra->mutex);
+            continue;
+        }
+
+        size_t index = ra->wpos % ra->size;
+        size_t len = FFMIN((size_t)space, ra->size - index);
+        len = FFMIN(len, (size_t)READ_AHEAD_CHUNK * (ra->uring_ok ? READ_AHEAD_URING_DEPTH : 1));
+        int64_t pos = ra->wpos;
+        int generation = ra->generation;
+        SDL_UnlockMutex(ra->mutex);
+
+        // 管道和FIFO不能pread，总是顺序读
+        int64_t n = ra->mode == READ_AHEAD_STREAM || !ra->regular ?
+                    read_ahead_fill_stream(ra, ra->ring + index, len, pos) :
+                    read_ahead_fill(ra, ra->ring + index, len, pos);
+
+        SDL_LockMutex(ra->mutex);
+        if (generation != ra->generation) {
+            continue;               // 读取期间发生了重置，结果作废
+        }
+        if (n == AVERROR(EAGAIN)) {
+            // 暂时没有新数据：管道继续poll；普通文件等它增长，太久不增长就当作结尾
+            if (ra->regular) {
+                int64_t now = av_gettime_relative();
+                if (!ra->idle_start) {
+                    ra->idle_start = now;
+                }
+                if (now - ra->idle_start < READ_AHEAD_STREAM_IDLE_MS * 1000LL) {
+                    SDL_CondWaitTimeout(ra->space_cond, ra->mutex, READ_AHEAD_FOLLOW_MS);
+                    continue;
+                }
+                n = 0;
+            } else {
+                continue;
+            }
+        }
+        ra->idle_start = 0;
+        if (n > 0) {
+            ra->wpos += n;
+            atomic_fetch_add(&ra->bytes_read, n);
+        } else if (n == 0) {
+            ra->eof = 1;
+        } else {
+            ra->error = (int)n;
+        }
+        SDL_CondSignal(ra->data_cond);
+    }
+    SDL_UnlockMutex(ra->mutex);
+    return 0;
+}
+
+/** ! AVIOContext回调，都在解复用线程上调用 */
+
+static int read_ahead_read_ring(void *opaque, uint8_t *buf, int buf_size) {
+    ReadAhead *ra = (ReadAhead *)opaque;
+    int64_t wait_start = 0;
+
+    SDL_LockMutex(ra->mutex);
+    while (ra->rpos == ra->wpos && !ra->eof && !ra->error && !ra->quit) {
+        if (ra->int_cb.callback && ra->int_cb.callback(ra->int_cb.opaque)) {
+            SDL_UnlockMutex(ra->mutex);
+            return AVERROR_EXIT;
+        }
+        if (!wait_start) {
+            wait_start = av_gettime_relative();
+        }
+        SDL_CondWaitTimeout(ra->data_cond, ra->mutex, READ_AHEAD_WAIT_MS);
+    }
+    if (wait_start) {
+        atomic_fetch_add(&ra->stalls, 1);
+        atomic_fetch_add(&ra->stall_us, av_gettime_relative() - wait_start);
+    }
+    if (ra->rpos == ra->wpos) {
+        int ret = ra->quit ? AVERROR_EXIT : ra->error ? ra->error : AVERROR_EOF;
+        SDL_UnlockMutex(ra->mutex);
+        return ret;
+    }
+    size_t index = ra->rpos % ra->size;
+    size_t len = FFMIN((size_t)buf_size, (size_t)(ra->wpos - ra->rpos));
+    SDL_UnlockMutex(ra->mutex);
+
+    // [rpos, wpos)的数据I/O线程不会改写，拷贝时不需要持锁
+    size_t first = FFMIN(len, ra->size - index);
+    memcpy(buf, ra->ring + index, first);
+    memcpy(buf + first, ra->ring, len - first);
+
+    SDL_LockMutex(ra->mutex);
+    ra->rpos += len;
+    SDL_CondSignal(ra->space_cond);
+    SDL_UnlockMutex(ra->mutex);
+    atomic_fetch_add(&ra->bytes_consumed, len);
+    return (int)len;
+}
+
+static int read_ahead_read_mmap(void *opaque, uint8_t *buf, int buf_size) {
+    ReadAhead *ra = (ReadAhead *)opaque;
+
+    if (ra->rpos >= ra->file_size) {
+        return AVERROR_EOF;
+    }
+    size_t len = FFMIN((size_t)buf_size, (size_t)(ra->file_size - ra->rpos));
+
+    // 读位置进入预取窗口的后半段时，让内核异步预取下一个窗口
+    if (ra->rpos + (int64_t)ra->size / 2 >= ra->advised && ra->advised < ra->file_size) {
+        int64_t start = ra->advised & ~(int64_t)(ra->page_size - 1);
+        size_t advise = FFMIN((int64_t)ra->size, ra->file_size - start);
+        madvise(ra->map + start, advise, MADV_WILLNEED);
+        ra->advised = start + advise;
+    }
+
+    int64_t start = av_gettime_relative();
+    memcpy(buf, ra->map + ra->rpos, len);
+    int64_t elapsed = av_gettime_relative() - start;
+    if (elapsed > READ_AHEAD_MMAP_STALL_US) {
+        atomic_fetch_add(&ra->stalls, 1);
+        atomic_fetch_add(&ra->stall_us, elapsed);
+    }
+    ra->rpos += len;
+    atomic_fetch_add(&ra->bytes_consumed, len);
+    return (int)len;
+}
+
+static int64_t read_ahead_seek(void *opaque, int64_t offset, int whence) {
+    ReadAhead *ra = (ReadAhead *)opaque;
+    int64_t pos;
+
+    if (whence & AVSEEK_SIZE) {
+        return ra->file_size;
+    }
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = ra->rpos + offset;
+        break;
+    case SEEK_END:
+        pos = ra->file_size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    if (ra->mode == READ_AHEAD_MMAP) {
+        ra->rpos = pos;
+        ra->advised = pos;
+        atomic_fetch_add(&ra->seeks_buffered, 1);
+        return pos;
+    }
+
+    SDL_LockMutex(ra->mutex);
+    // I/O线程可能正在改写最旧的一块，保守地把它排除在外
+    int64_t oldest = FFMAX(ra->base, ra->wpos + READ_AHEAD_CHUNK * (ra->uring_ok ? READ_AHEAD_URING_DEPTH : 1) -
+                                         (int64_t)ra->size);
+    if (pos >= oldest && pos <= ra->wpos) {
+        ra->rpos = pos;
+        atomic_fetch_add(&ra->seeks_buffered, 1);
+    } else {
+        ra->base = ra->rpos = ra->wpos = pos;
+        ra->eof = 0;
+        ra->error = 0;
+        ra->generation++;
+        atomic_fetch_add(&ra->seeks_reset, 1);
+    }
+    SDL_CondSignal(ra->space_cond);
+    SDL_UnlockMutex(ra->mutex);
+    return pos;
+}
+
+/** ! 打开和关闭 */
+
+static int read_ahead_open_mmap(ReadAhead *ra) {
+    if (ra->file_size <= 0 || (uint64_t)ra->file_size > SIZE_MAX) {
+        return -1;
+    }
+    void *map = mmap(NULL, ra->file_size, PROT_READ, MAP_PRIVATE, ra->fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    ra->map = (uint8_t *)map;
+    ra->page_size = sysconf(_SC_PAGESIZE);
+    madvise(ra->map, ra->file_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+static int read_ahead_open_thread(ReadAhead *ra) {
+    ra->size = FFMAX(ra->size, (size_t)READ_AHEAD_MIN_SIZE);
+    ra->back = ra->size / 8;
+    ra->ring = (uint8_t *)av_malloc(ra->size);
+    ra->mutex = SDL_CreateMutex();
+    ra->data_cond = SDL_CreateCond();
+    ra->space_cond = SDL_CreateCond();
+    if (!ra->ring || !ra->mutex || !ra->data_cond || !ra->space_cond) {
+        return -1;
+    }
+    // 顺序读提示，内核会加大自己的预读
+    posix_fadvise(ra->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+#ifdef HAVE_LIBURING
+    // 流式模式和管道顺序读，用不上按偏移并行的io_uring请求，也就不用提示回退
+    if (ra->mode != READ_AHEAD_STREAM && ra->regular) {
+        int ret = io_uring_queue_init(READ_AHEAD_URING_DEPTH, &ra->uring, 0);
+        if (ret == 0) {
+            ra->uring_ok = 1;
+        } else {
+            fprintf(stderr, "io_uring unavailable - %s, read-ahead falls back to pread\n", strerror(-ret));
+        }
+    }
+#endif
+
+    ra->tid = SDL_CreateThread(read_ahead_thread, "read_ahead", ra);
+    if (!ra->tid) {
+        fprintf(stderr, "Could not create read-ahead thread - %s\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+ReadAhead *read_ahead_open(const char *filename, int mode, size_t size, const AVIOInterruptCB *int_cb) {
+    const char *path = filename;
+    struct stat st;
+
+    if (mode == READ_AHEAD_OFF) {
+        return NULL;
+    }
+    // 只处理本地文件(流式模式下还有标准输入)，网络协议仍交给FFmpeg
+    int is_stdin = mode == READ_AHEAD_STREAM &&
+                   (!strcmp(filename, "-") || !strcmp(filename, "pipe:") || !strcmp(filename, "pipe:0"));
+    const char *proto = avio_find_protocol_name(filename);
+    if (!is_stdin && (!proto || strcmp(proto, "file"))) {
+        return NULL;
+    }
+    av_strstart(filename, "file:", &path);
+
+    ReadAhead *ra = (ReadAhead *)av_mallocz(sizeof(ReadAhead));
+    if (!ra) {
+        return NULL;
+    }
+    if (is_stdin) {
+        ra->fd = dup(STDIN_FILENO);
+    } else if (mode == READ_AHEAD_STREAM) {
+        // FIFO在写端打开之前open会一直阻塞，先非阻塞打开再恢复成阻塞读
+        ra->fd = open(path, O_RDONLY | O_NONBLOCK);
+        if (ra->fd >= 0) {
+            fcntl(ra->fd, F_SETFL, fcntl(ra->fd, F_GETFL) & ~O_NONBLOCK);
+        }
+    } else {
+        ra->fd = open(path, O_RDONLY);
+    }
+    if (ra->fd < 0) {
+        av_free(ra);
+        return NULL;
+    }
+    if (int_cb) {
+        ra->int_cb = *int_cb;
+    }
+    ra->size = size ? size : READ_AHEAD_DEFAULT_SIZE;
+    ra->regular = fstat(ra->fd, &st) == 0 && S_ISREG(st.st_mode);
+    // 流式模式下文件还在增长，大小没有意义，也不提供seek
+    ra->file_size = ra->regular && mode != READ_AHEAD_STREAM ? st.st_size : -1;
+    atomic_init(&ra->bytes_read, 0);
+    atomic_init(&ra->bytes_consumed, 0);
+    atomic_init(&ra->stalls, 0);
+    atomic_init(&ra->stall_us, 0);
+    atomic_init(&ra->seeks_buffered, 0);
+    atomic_init(&ra->seeks_reset, 0);
+
+    // 不是普通文件或映射失败时改用I/O线程；流式模式总是用I/O线程
+    ra->mode = mode;
+    if (mode == READ_AHEAD_MMAP && read_ahead_open_mmap(ra) < 0) {
+        fprintf(stderr, "Could not mmap %s, using read-ahead thread\n", path);
+        ra->mode = READ_AHEAD_THREAD;
+    }
+    if ((ra->mode == READ_AHEAD_THREAD || ra->mode == READ_AHEAD_STREAM) && read_ahead_open_thread(ra) < 0) {
+        read_ahead_close(&ra);
+        return NULL;
+    }
+
+    uint8_t *buffer = (uint8_t *)av_malloc(READ_AHEAD_AVIO_BUFFER);
+    ra->avio = buffer ? avio_alloc_context(buffer, READ_AHEAD_AVIO_BUFFER, 0, ra,
+                                           ra->mode == READ_AHEAD_MMAP ? read_ahead_read_mmap : read_ahead_read_ring,
+                                           NULL, ra->file_size >= 0 ? read_ahead_seek : NULL)
+                        : NULL;
+    if (!ra->avio) {
+        av_free(buffer);
+        read_ahead_close(&ra);
+        return NULL;
+    }
+    return ra;
+}
+
+AVIOContext *read_ahead_avio(ReadAhead *ra) {
+    return ra->avio;
+}
+
+// 在avformat_close_input之后调用
+void read_ahead_close(ReadAhead **pra) {
+    ReadAhead *ra = *pra;
+    if (!ra) {
+        return;
+    }
+
+    if (ra->tid) {
+        SDL_LockMutex(ra->mutex);
+        ra->quit = 1;
+        SDL_CondSignal(ra->space_cond);
+        SDL_UnlockMutex(ra->mutex);
+        SDL_WaitThread(ra->tid, NULL);
+    }
+#ifdef HAVE_LIBURING
+    if (ra->uring_ok) {
+        io_uring_queue_exit(&ra->uring);
+    }
+#endif
+    if (ra->avio) {
+        av_freep(&ra->avio->buffer);
+        avio_context_free(&ra->avio);
+    }
+    if (ra->map) {
+        munmap(ra->map, ra->file_size);
+    }
+    av_free(ra->ring);
+    if (ra->mutex) {
+        SDL_DestroyMutex(ra->mutex);
+    }
+    if (ra->data_cond) {
+        SDL_DestroyCond(ra->data_cond);
+    }
+    if (ra->space_cond) {
+        SDL_DestroyCond(ra->space_cond);
+    }
+    if (ra->fd >= 0) {
+        close(ra->fd);
+    }
+    av_freep(pra);
+}
+
+void read_ahead_get_stats(ReadAhead *ra, ReadAheadStats *stats) {
+    stats->mode = ra->mode;
+    stats->uring = ra->uring_ok;
+    stats->size = ra->size;
+    stats->bytes_read = ra->mode == READ_AHEAD_MMAP ? atomic_load(&ra->bytes_consumed) : atomic_load(&ra->bytes_read);
+    stats->bytes_consumed = atomic_load(&ra->bytes_consumed);
+    stats->stalls = atomic_load(&ra->stalls);
+    stats->stall_us = atomic_load(&ra->stall_us);
+    stats->seeks_buffered = atomic_load(&ra->seeks_buffered);
+    stats->seeks_reset = atomic_load(&ra->seeks_reset);
+}
+
+void read_ahead_print(ReadAhead *ra, FILE *f) {
+    ReadAheadStats stats;
+
+    read_ahead_get_stats(ra, &stats);
+    fprintf(f, "read-ahead: %s%s, %.1f MB read, %.1f MB consumed, %lld stalls (%.1f ms), "
+               "%lld buffered seeks, %lld reset seeks\n",
+            read_ahead_mode_name(stats.mode), stats.uring ? " (io_uring)" : "",
+            stats.bytes_read / (1024.0 * 1024.0), stats.bytes_consumed / (1024.0 * 1024.0),
+            (long long)stats.stalls, stats.stall_us / 1000.0,
+            (long long)stats.seeks_buffered, (long long)stats.seeks_reset);
+}
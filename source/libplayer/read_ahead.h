@@ -0,0 +1,54 @@
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+#include <libavformat/avio.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// 读取方式
+enum {
+    READ_AHEAD_OFF,             // 使用FFmpeg默认的file协议
+    READ_AHEAD_THREAD,          // 后台I/O线程预读到环形缓冲区(有liburing时用io_uring)
+    READ_AHEAD_MMAP,            // 整个文件mmap，按读取位置madvise预取
+    READ_AHEAD_STREAM           // 流式输入：管道、FIFO、标准输入或还在写入的文件，只能顺序读
+};
+
+#define READ_AHEAD_DEFAULT_SIZE (8 * 1024 * 1024) // 环形缓冲区/预取窗口的默认大小
+#define READ_AHEAD_STREAM_IDLE_MS 10000           // 流式模式下普通文件多久不增长算作结尾
+
+typedef struct ReadAhead ReadAhead;
+
+// 读取统计
+typedef struct ReadAheadStats {
+    int mode;                   // 实际使用的方式，打不开io_uring或不能mmap时会回退
+    int uring;                  // I/O线程是否使用io_uring
+    size_t size;                // 环形缓冲区(或mmap预取窗口)的字节数
+    int64_t bytes_read;         // 从文件读取的字节数
+    int64_t bytes_consumed;     // 交给解复用器的字节数
+    int64_t stalls;             // 解复用器等待数据的次数
+    int64_t stall_us;           // 等待的总时间(微秒)
+    int64_t seeks_buffered;     // 落在已缓冲数据内的seek
+    int64_t seeks_reset;        // 需要丢弃缓冲区重新读取的seek
+} ReadAheadStats;
+
+/**
+ * ! 异步预读
+ *
+ * 为本地文件创建自定义AVIOContext，赋给AVFormatContext.pb后
+ * av_read_frame只从内存拷贝数据，冷存储或大文件上的慢读不再阻塞解复用。
+ * int_cb在解复用器等待数据时检查，返回非0时读取以AVERROR_EXIT结束。
+ * 不是本地文件或打开失败时返回NULL，调用者使用默认I/O。
+ *
+ * READ_AHEAD_STREAM模式下输入不可seek：管道和FIFO用poll等待数据，写端关闭才算结尾；
+ * 普通文件读到当前末尾时等待文件增长，READ_AHEAD_STREAM_IDLE_MS内没有增长才算结尾。
+ * 文件名"-"或"pipe:"表示标准输入。FIFO打开时不等待写端，等待数据期间也能立即退出。
+ */
+ReadAhead *read_ahead_open(const char *filename, int mode, size_t size, const AVIOInterruptCB *int_cb);
+AVIOContext *read_ahead_avio(ReadAhead *ra);
+void read_ahead_close(ReadAhead **ra);
+void read_ahead_get_stats(ReadAhead *ra, ReadAheadStats *stats);
+void read_ahead_print(ReadAhead *ra, FILE *f);
+const char *read_ahead_mode_name(int mode);
+int read_ahead_parse_mode(const char *name);
+
+#endif
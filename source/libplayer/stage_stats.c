@@ -0,0 +1,111 @@
+#include "stage_stats.h"
+#include <libavutil/time.h>
+#include <string.h>
+
+// 值所在的桶
+static int stage_hist_bucket(uint64_t v) {
+    if (v < STAGE_HIST_LINEAR)
+        return (int)v;
+    int e = 63 - __builtin_clzll(v);   // v >= 16时e >= 4
+    if (e >= STAGE_HIST_OCTAVES)
+        return STAGE_HIST_BUCKETS - 1;
+    int sub = (int)(v >> (e - STAGE_HIST_SUB_BITS)) & ((1 << STAGE_HIST_SUB_BITS) - 1);
+    return STAGE_HIST_LINEAR + (e - 4) * (1 << STAGE_HIST_SUB_BITS) + sub;
+}
+
+// 桶的代表值(区间中点)
+static int64_t stage_hist_value(int bucket) {
+    if (bucket < STAGE_HIST_LINEAR)
+        return bucket;
+    int i = bucket - STAGE_HIST_LINEAR;
+    int e = i / (1 << STAGE_HIST_SUB_BITS) + 4;
+    int sub = i % (1 << STAGE_HIST_SUB_BITS);
+    int64_t width = (int64_t)1 << (e - STAGE_HIST_SUB_BITS);
+    int64_t low = ((int64_t)1 << e) + sub * width;
+    return low + width / 2;
+}
+
+void stage_hist_init(StageHist *h, const char *name, const char *unit) {
+    memset(h, 0, sizeof(StageHist));
+    h->name = name;
+    h->unit = unit;
+    atomic_init(&h->count, 0);
+    atomic_init(&h->sum, 0);
+    atomic_init(&h->max, 0);
+    atomic_init(&h->last_time, 0);
+    for (int i = 0; i < STAGE_HIST_BUCKETS; i++)
+        atomic_init(&h->buckets[i], 0);
+}
+
+// 记录一个值，now为记录时间(微秒)
+void stage_hist_add_at(StageHist *h, int64_t value, int64_t now) {
+    uint64_t v = value > 0 ? (uint64_t)value : 0;
+    unsigned long long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&h->buckets[stage_hist_bucket(v)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, v, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    while (v > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &max, v,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+    atomic_store_explicit(&h->last_time, now, memory_order_relaxed);
+}
+
+void stage_hist_add(StageHist *h, int64_t value) {
+    stage_hist_add_at(h, value, av_gettime_relative());
+}
+
+// 第p(0~1)分位数的近似值，没有数据时返回0
+int64_t stage_hist_percentile(StageHist *h, double p) {
+    unsigned long long counts[STAGE_HIST_BUCKETS];
+    unsigned long long total = 0, seen = 0, rank;
+
+    for (int i = 0; i < STAGE_HIST_BUCKETS; i++) {
+        counts[i] = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0)
+        return 0;
+
+    rank = (unsigned long long)(p * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    for (int i = 0; i < STAGE_HIST_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // 不超过记录到的最大值
+            int64_t v = stage_hist_value(i);
+            int64_t max = (int64_t)atomic_load_explicit(&h->max, memory_order_relaxed);
+            return v < max ? v : max;
+        }
+    }
+    return (int64_t)atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+// 一行文本：次数、均值、p50/p99/max
+void stage_hist_print(StageHist *h, FILE *f) {
+    unsigned long long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    unsigned long long sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+
+    fprintf(f, "  %-14s n=%-8llu mean=%-8.1f p50=%-8lld p99=%-8lld max=%-8llu %s\n",
+            h->name, count, count ? (double)sum / count : 0.0,
+            (long long)stage_hist_percentile(h, 0.50),
+            (long long)stage_hist_percentile(h, 0.99),
+            (unsigned long long)atomic_load_explicit(&h->max, memory_order_relaxed),
+            h->unit);
+}
+
+// JSON对象："name": {...}
+void stage_hist_json(StageHist *h, FILE *f) {
+    unsigned long long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    unsigned long long sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+
+    fprintf(f, "\"%s\": {\"unit\": \"%s\", \"count\": %llu, \"sum\": %llu, \"mean\": %.3f, "
+               "\"p50\": %lld, \"p99\": %lld, \"max\": %llu, \"last_time_us\": %lld}",
+            h->name, h->unit, count, sum, count ? (double)sum / count : 0.0,
+            (long long)stage_hist_percentile(h, 0.50),
+            (long long)stage_hist_percentile(h, 0.99),
+            (unsigned long long)atomic_load_explicit(&h->max, memory_order_relaxed),
+            (long long)atomic_load_explicit(&h->last_time, memory_order_relaxed));
+}
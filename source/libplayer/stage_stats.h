@@ -0,0 +1,37 @@
+#ifndef STAGE_STATS_H
+#define STAGE_STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// 直方图桶：0..15单独一个桶，之后每个2的幂区间分8个子桶(相对误差约12.5%)
+#define STAGE_HIST_LINEAR 16
+#define STAGE_HIST_SUB_BITS 3
+#define STAGE_HIST_OCTAVES 40
+#define STAGE_HIST_BUCKETS (STAGE_HIST_LINEAR + (STAGE_HIST_OCTAVES - 4) * (1 << STAGE_HIST_SUB_BITS))
+
+/**
+ * ! 单个阶段的耗时(或采样值)直方图
+ *
+ * 记录时只做几次relaxed原子加，不加锁，可以在音频回调等热路径里使用；
+ * 打印线程读取时不需要和写入线程同步，得到的是近似一致的快照。
+ */
+typedef struct StageHist {
+    const char *name;
+    const char *unit;               // 打印用的单位，例如"us"
+    atomic_ullong count;
+    atomic_ullong sum;
+    atomic_ullong max;
+    atomic_llong last_time;         // 最后一次记录的时间(av_gettime_relative微秒)
+    atomic_ullong buckets[STAGE_HIST_BUCKETS];
+} StageHist;
+
+void stage_hist_init(StageHist *h, const char *name, const char *unit);
+void stage_hist_add(StageHist *h, int64_t value);
+void stage_hist_add_at(StageHist *h, int64_t value, int64_t now);
+int64_t stage_hist_percentile(StageHist *h, double p);
+void stage_hist_print(StageHist *h, FILE *f);
+void stage_hist_json(StageHist *h, FILE *f);
+
+#endif
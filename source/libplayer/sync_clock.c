@@ -0,0 +1,71 @@
+#include "sync_clock.h"
+#include <libavutil/time.h>
+#include <math.h>
+
+// 单调系统时间(秒)
+double clock_now(void) {
+    return av_gettime_relative() / 1000000.0;
+}
+
+void init_clock(Clock *c) {
+    c->lock = 0;
+    c->speed = 1.0;
+    c->paused = 0;
+    set_clock(c, NAN);
+}
+
+double get_clock(Clock *c) {
+    double pts;
+
+    SDL_AtomicLock(&c->lock);
+    if (c->paused) {
+        pts = c->pts;
+    } else {
+        double time = clock_now();
+        pts = c->pts_drift + time - (time - c->last_updated) * (1.0 - c->speed);
+    }
+    SDL_AtomicUnlock(&c->lock);
+    return pts;
+}
+
+void set_clock_at(Clock *c, double pts, double time) {
+    SDL_AtomicLock(&c->lock);
+    c->pts = pts;
+    c->last_updated = time;
+    c->pts_drift = pts - time;
+    SDL_AtomicUnlock(&c->lock);
+}
+
+void set_clock(Clock *c, double pts) {
+    set_clock_at(c, pts, clock_now());
+}
+
+// 暂停时把时钟停在当前值，恢复时从当前值继续走
+void set_clock_paused(Clock *c, int paused) {
+    double time = clock_now();
+
+    SDL_AtomicLock(&c->lock);
+    if (paused && !c->paused) {
+        c->pts = c->pts_drift + time - (time - c->last_updated) * (1.0 - c->speed);
+    }
+    c->last_updated = time;
+    c->pts_drift = c->pts - time;
+    c->paused = paused;
+    SDL_AtomicUnlock(&c->lock);
+}
+
+// 改变时钟速度，从当前值开始按新速度走
+void set_clock_speed(Clock *c, double speed) {
+    double pts = get_clock(c);
+    double time = clock_now();
+
+    SDL_AtomicLock(&c->lock);
+    // 暂停时时钟停在pts，恢复时set_clock_paused会重新计时；last_updated还要用来计算暂停时长
+    if (!c->paused && !isnan(pts)) {
+        c->pts = pts;
+        c->pts_drift = pts - time;
+        c->last_updated = time;
+    }
+    c->speed = speed;
+    SDL_AtomicUnlock(&c->lock);
+}
@@ -0,0 +1,41 @@
+#ifndef SYNC_CLOCK_H
+#define SYNC_CLOCK_H
+
+#include <SDL2/SDL_atomic.h>
+
+// 音视频同步阈值(秒)
+#define AV_SYNC_THRESHOLD_MIN 0.04      // 同步阈值下限
+#define AV_SYNC_THRESHOLD_MAX 0.1       // 同步阈值上限
+#define AV_SYNC_FRAMEDUP_THRESHOLD 0.1  // 帧时长超过此值时不再翻倍延迟
+#define AV_NOSYNC_THRESHOLD 10.0        // 误差超过此值时认为时间戳不连续，不做同步
+
+// 主时钟类型
+enum {
+    AV_SYNC_AUDIO_MASTER,       // 默认跟随音频
+    AV_SYNC_VIDEO_MASTER,
+    AV_SYNC_EXTERNAL_CLOCK,     // 系统时钟
+};
+
+/**
+ * ! 播放时钟
+ * 记录某一时刻的pts和系统时间的差(pts_drift)，读取时用当前系统时间外推。
+ * 音频回调线程写、主线程读，用自旋锁保证pts/pts_drift成对更新。
+ */
+typedef struct Clock {
+    double pts;           // 时钟基准(秒)，NAN表示尚未开始
+    double pts_drift;     // pts - 更新时的系统时间
+    double last_updated;  // 最后一次更新的系统时间(秒)
+    double speed;         // 播放速度
+    int paused;
+    SDL_SpinLock lock;
+} Clock;
+
+double clock_now(void);
+void init_clock(Clock *c);
+double get_clock(Clock *c);
+void set_clock_at(Clock *c, double pts, double time);
+void set_clock(Clock *c, double pts);
+void set_clock_paused(Clock *c, int paused);
+void set_clock_speed(Clock *c, double speed);
+
+#endif
@@ -0,0 +1,553 @@
+#include "yuv2rgb.h"
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define YUV2RGB_X86 1
+#endif
+
+#define YUV2RGB_SHIFT 13               // 定点系数的小数位数
+#define YUV2RGB_MAX_THREADS 16
+#define YUV2RGB_MIN_BAND_ROWS 32       // 每个带至少这么多行，小图不分带
+
+// 定点系数：R = (cy*(Y-y_offset) + crv*V' + round) >> SHIFT，U' = U-128，V' = V-128
+typedef struct Yuv2RgbCoeffs {
+    int y_offset;
+    int cy, crv, cgu, cgv, cbu;
+} Yuv2RgbCoeffs;
+
+// 转换一行；semi为1时u指向NV12交错的UV行，v不使用
+typedef void (*Yuv2RgbRowFunc)(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                               uint8_t *dst, int width, const Yuv2RgbCoeffs *k);
+
+// 一次转换，按带分给各线程
+typedef struct Yuv2RgbJob {
+    const uint8_t *src[3];
+    int src_linesize[3];
+    uint8_t *dst;
+    int dst_linesize;
+    int width, height;
+    int semi;
+    int band_rows, nb_bands;
+    Yuv2RgbRowFunc row;
+    Yuv2RgbCoeffs k;
+} Yuv2RgbJob;
+
+typedef struct Yuv2RgbWorker {
+    struct Yuv2Rgb *c;
+    int index;                  // 负责的带，调用线程负责第0带
+    pthread_t tid;
+} Yuv2RgbWorker;
+
+struct Yuv2Rgb {
+    int isa;
+    int nb_threads;             // 包括调用线程
+    Yuv2RgbWorker *workers;
+    int nb_workers;             // 已启动的工作线程
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;   // 有新的转换
+    pthread_cond_t done_cond;   // 所有工作线程完成了当前转换
+    int generation;             // 每次转换加1
+    int pending;                // 还没完成当前转换的工作线程数
+    int quit;
+    Yuv2RgbJob job;
+};
+
+/** ! 标量实现，也用来处理SIMD循环剩下的像素 */
+
+static av_always_inline void row_scalar_from(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                             uint8_t *dst, int x, int width, const Yuv2RgbCoeffs *k,
+                                             int semi, int rgba) {
+    const int bpp = rgba ? 4 : 3;
+
+    for (; x < width; x++) {
+        int cx = x >> 1;
+        int cu = (semi ? u[2 * cx] : u[cx]) - 128;
+        int cv = (semi ? u[2 * cx + 1] : v[cx]) - 128;
+        int yt = k->cy * (y[x] - k->y_offset) + (1 << (YUV2RGB_SHIFT - 1));
+        uint8_t *p = dst + x * bpp;
+
+        p[0] = av_clip_uint8((yt + k->crv * cv) >> YUV2RGB_SHIFT);
+        p[1] = av_clip_uint8((yt + k->cgu * cu + k->cgv * cv) >> YUV2RGB_SHIFT);
+        p[2] = av_clip_uint8((yt + k->cbu * cu) >> YUV2RGB_SHIFT);
+        if (rgba) {
+            p[3] = 255;
+        }
+    }
+}
+
+#define ROW_FUNC(name, impl, semi, rgba)                                                  \
+    static void name(const uint8_t *y, const uint8_t *u, const uint8_t *v,               \
+                     uint8_t *dst, int width, const Yuv2RgbCoeffs *k) {                   \
+        impl(y, u, v, dst, width, k, semi, rgba);                                        \
+    }
+
+static av_always_inline void row_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                        uint8_t *dst, int width, const Yuv2RgbCoeffs *k,
+                                        int semi, int rgba) {
+    row_scalar_from(y, u, v, dst, 0, width, k, semi, rgba);
+}
+
+ROW_FUNC(row_scalar_yuv_rgb24, row_scalar, 0, 0)
+ROW_FUNC(row_scalar_yuv_rgba, row_scalar, 0, 1)
+ROW_FUNC(row_scalar_nv12_rgb24, row_scalar, 1, 0)
+ROW_FUNC(row_scalar_nv12_rgba, row_scalar, 1, 1)
+
+#ifdef YUV2RGB_X86
+/**
+ * ! SIMD实现
+ * 亮度按(Y', 1)和(cy, round)成对做pmaddwd，色度按(U', V')和每个分量的系数成对做pmaddwd，
+ * 得到和标量实现完全相同的32位中间结果，右移后饱和打包到0..255。
+ */
+
+// 两个16位系数拼成pmaddwd的一对
+static inline int coeff_pair(int lo, int hi) {
+    return (int)(((uint32_t)(uint16_t)hi << 16) | (uint16_t)lo);
+}
+
+/** ! SSE2：每次8个像素 */
+
+typedef struct Sse2Consts {
+    __m128i y_offset, one, cy_rnd, r_uv, g_uv, b_uv, c128, alpha;
+} Sse2Consts;
+
+static av_always_inline void sse2_consts(Sse2Consts *c, const Yuv2RgbCoeffs *k) {
+    c->y_offset = _mm_set1_epi16(k->y_offset);
+    c->one = _mm_set1_epi16(1);
+    c->cy_rnd = _mm_set1_epi32(coeff_pair(k->cy, 1 << (YUV2RGB_SHIFT - 1)));
+    c->r_uv = _mm_set1_epi32(coeff_pair(0, k->crv));
+    c->g_uv = _mm_set1_epi32(coeff_pair(k->cgu, k->cgv));
+    c->b_uv = _mm_set1_epi32(coeff_pair(k->cbu, 0));
+    c->c128 = _mm_set1_epi16(128);
+    c->alpha = _mm_set1_epi8((char)0xff);
+}
+
+// 亮度项加上色度项(每个色度值复制给两个像素)，右移并打包成8个16位值
+#define SSE2_CHANNEL(ylo, yhi, chroma)                                                      \
+    _mm_packs_epi32(                                                                        \
+        _mm_srai_epi32(_mm_add_epi32(ylo, _mm_unpacklo_epi32(chroma, chroma)), YUV2RGB_SHIFT), \
+        _mm_srai_epi32(_mm_add_epi32(yhi, _mm_unpackhi_epi32(chroma, chroma)), YUV2RGB_SHIFT))
+
+// uv为4对(U', V')的16位值，算出8个像素的R/G/B，结果在低8字节
+static av_always_inline void sse2_pixels8(const uint8_t *yp, __m128i uv, const Sse2Consts *c,
+                                          __m128i *r8, __m128i *g8, __m128i *b8) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i y16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)yp), zero), c->y_offset);
+    __m128i ylo = _mm_madd_epi16(_mm_unpacklo_epi16(y16, c->one), c->cy_rnd);
+    __m128i yhi = _mm_madd_epi16(_mm_unpackhi_epi16(y16, c->one), c->cy_rnd);
+    __m128i rc = _mm_madd_epi16(uv, c->r_uv);
+    __m128i gc = _mm_madd_epi16(uv, c->g_uv);
+    __m128i bc = _mm_madd_epi16(uv, c->b_uv);
+    __m128i r16 = SSE2_CHANNEL(ylo, yhi, rc);
+    __m128i g16 = SSE2_CHANNEL(ylo, yhi, gc);
+    __m128i b16 = SSE2_CHANNEL(ylo, yhi, bc);
+
+    *r8 = _mm_packus_epi16(r16, r16);
+    *g8 = _mm_packus_epi16(g16, g16);
+    *b8 = _mm_packus_epi16(b16, b16);
+}
+
+static av_always_inline void sse2_store8(uint8_t *dst, __m128i r8, __m128i g8, __m128i b8, __m128i a8, int rgba) {
+    __m128i rg = _mm_unpacklo_epi8(r8, g8);
+    __m128i ba = _mm_unpacklo_epi8(b8, a8);
+    __m128i p0 = _mm_unpacklo_epi16(rg, ba);
+    __m128i p1 = _mm_unpackhi_epi16(rg, ba);
+
+    if (rgba) {
+        _mm_storeu_si128((__m128i *)dst, p0);
+        _mm_storeu_si128((__m128i *)(dst + 16), p1);
+    } else {
+        // SSE2没有字节重排：先排成RGBA，再每个像素写4字节，多出的一字节被下一个像素覆盖
+        uint8_t tmp[32];
+        _mm_storeu_si128((__m128i *)tmp, p0);
+        _mm_storeu_si128((__m128i *)(tmp + 16), p1);
+        for (int i = 0; i < 8; i++) {
+            memcpy(dst + 3 * i, tmp + 4 * i, 4);
+        }
+    }
+}
+
+static av_always_inline void row_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                      uint8_t *dst, int width, const Yuv2RgbCoeffs *k,
+                                      int semi, int rgba) {
+    const __m128i zero = _mm_setzero_si128();
+    const int bpp = rgba ? 4 : 3;
+    // RGB24最后一个像素会多写一字节，留一个像素的余量
+    const int end = width - 8 - (rgba ? 0 : 1);
+    Sse2Consts c;
+    __m128i uv, r8, g8, b8;
+    int x = 0;
+
+    sse2_consts(&c, k);
+    for (; x <= end; x += 8) {
+        if (semi) {
+            uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x)), zero);
+        } else {
+            int32_t cu, cv;
+            memcpy(&cu, u + x / 2, 4);
+            memcpy(&cv, v + x / 2, 4);
+            uv = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(cu), zero),
+                                    _mm_unpacklo_epi8(_mm_cvtsi32_si128(cv), zero));
+        }
+        uv = _mm_sub_epi16(uv, c.c128);
+        sse2_pixels8(y + x, uv, &c, &r8, &g8, &b8);
+        sse2_store8(dst + x * bpp, r8, g8, b8, c.alpha, rgba);
+    }
+    row_scalar_from(y, u, v, dst, x, width, k, semi, rgba);
+}
+
+ROW_FUNC(row_sse2_yuv_rgb24, row_sse2, 0, 0)
+ROW_FUNC(row_sse2_yuv_rgba, row_sse2, 0, 1)
+ROW_FUNC(row_sse2_nv12_rgb24, row_sse2, 1, 0)
+ROW_FUNC(row_sse2_nv12_rgba, row_sse2, 1, 1)
+
+/**
+ * ! AVX2：每次16个像素
+ * 256位的unpack/pack都在128位通道内进行：亮度的lo/hi分别是像素0-3|8-11和4-7|12-15，
+ * 色度的第0通道放前4个样本、第1通道放后4个，复制后正好对上；打包后每个通道是8个连续像素。
+ */
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+typedef struct Avx2Consts {
+    __m256i y_offset, one, cy_rnd, r_uv, g_uv, b_uv, c128, alpha, rgb24_shuffle;
+} Avx2Consts;
+
+static av_always_inline AVX2_TARGET void avx2_consts(Avx2Consts *c, const Yuv2RgbCoeffs *k) {
+    c->y_offset = _mm256_set1_epi16(k->y_offset);
+    c->one = _mm256_set1_epi16(1);
+    c->cy_rnd = _mm256_set1_epi32(coeff_pair(k->cy, 1 << (YUV2RGB_SHIFT - 1)));
+    c->r_uv = _mm256_set1_epi32(coeff_pair(0, k->crv));
+    c->g_uv = _mm256_set1_epi32(coeff_pair(k->cgu, k->cgv));
+    c->b_uv = _mm256_set1_epi32(coeff_pair(k->cbu, 0));
+    c->c128 = _mm256_set1_epi16(128);
+    c->alpha = _mm256_set1_epi8((char)0xff);
+    // 每个通道里4个RGBA像素压成12字节RGB，后4字节清零
+    c->rgb24_shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+}
+
+#define AVX2_CHANNEL(ylo, yhi, chroma)                                                               \
+    _mm256_packs_epi32(                                                                              \
+        _mm256_srai_epi32(_mm256_add_epi32(ylo, _mm256_unpacklo_epi32(chroma, chroma)), YUV2RGB_SHIFT), \
+        _mm256_srai_epi32(_mm256_add_epi32(yhi, _mm256_unpackhi_epi32(chroma, chroma)), YUV2RGB_SHIFT))
+
+static av_always_inline AVX2_TARGET void avx2_pixels16(const uint8_t *yp, __m256i uv, const Avx2Consts *c,
+                                                       __m256i *r8, __m256i *g8, __m256i *b8) {
+    __m256i y16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)yp)), c->y_offset);
+    __m256i ylo = _mm256_madd_epi16(_mm256_unpacklo_epi16(y16, c->one), c->cy_rnd);
+    __m256i yhi = _mm256_madd_epi16(_mm256_unpackhi_epi16(y16, c->one), c->cy_rnd);
+    __m256i rc = _mm256_madd_epi16(uv, c->r_uv);
+    __m256i gc = _mm256_madd_epi16(uv, c->g_uv);
+    __m256i bc = _mm256_madd_epi16(uv, c->b_uv);
+    __m256i r16 = AVX2_CHANNEL(ylo, yhi, rc);
+    __m256i g16 = AVX2_CHANNEL(ylo, yhi, gc);
+    __m256i b16 = AVX2_CHANNEL(ylo, yhi, bc);
+
+    *r8 = _mm256_packus_epi16(r16, r16);
+    *g8 = _mm256_packus_epi16(g16, g16);
+    *b8 = _mm256_packus_epi16(b16, b16);
+}
+
+static av_always_inline AVX2_TARGET void avx2_store16(uint8_t *dst, __m256i r8, __m256i g8, __m256i b8,
+                                                      const Avx2Consts *c, int rgba) {
+    __m256i rg = _mm256_unpacklo_epi8(r8, g8);
+    __m256i ba = _mm256_unpacklo_epi8(b8, c->alpha);
+    __m256i lo = _mm256_unpacklo_epi16(rg, ba);              // 像素0-3 | 8-11
+    __m256i hi = _mm256_unpackhi_epi16(rg, ba);              // 像素4-7 | 12-15
+    __m256i p0 = _mm256_permute2x128_si256(lo, hi, 0x20);    // 像素0-7
+    __m256i p1 = _mm256_permute2x128_si256(lo, hi, 0x31);    // 像素8-15
+
+    if (rgba) {
+        _mm256_storeu_si256((__m256i *)dst, p0);
+        _mm256_storeu_si256((__m256i *)(dst + 32), p1);
+    } else {
+        // 每4个像素12字节，16字节写出时尾部的4字节被下一次写覆盖
+        __m256i s0 = _mm256_shuffle_epi8(p0, c->rgb24_shuffle);
+        __m256i s1 = _mm256_shuffle_epi8(p1, c->rgb24_shuffle);
+        _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(s0));
+        _mm_storeu_si128((__m128i *)(dst + 12), _mm256_extracti128_si256(s0, 1));
+        _mm_storeu_si128((__m128i *)(dst + 24), _mm256_castsi256_si128(s1));
+        _mm_storeu_si128((__m128i *)(dst + 36), _mm256_extracti128_si256(s1, 1));
+    }
+}
+
+static av_always_inline AVX2_TARGET void row_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                                  uint8_t *dst, int width, const Yuv2RgbCoeffs *k,
+                                                  int semi, int rgba) {
+    const int bpp = rgba ? 4 : 3;
+    // RGB24最后一次写出多写4字节，留两个像素的余量
+    const int end = width - 16 - (rgba ? 0 : 2);
+    Avx2Consts c;
+    __m256i uv, r8, g8, b8;
+    int x = 0;
+
+    avx2_consts(&c, k);
+    for (; x <= end; x += 16) {
+        if (semi) {
+            uv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + x)));
+        } else {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i cu = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x / 2)), zero);
+            __m128i cv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + x / 2)), zero);
+            uv = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(cu, cv)),
+                                         _mm_unpackhi_epi16(cu, cv), 1);
+        }
+        uv = _mm256_sub_epi16(uv, c.c128);
+        avx2_pixels16(y + x, uv, &c, &r8, &g8, &b8);
+        avx2_store16(dst + x * bpp, r8, g8, b8, &c, rgba);
+    }
+    row_scalar_from(y, u, v, dst, x, width, k, semi, rgba);
+}
+
+#define ROW_FUNC_AVX2(name, semi, rgba)                                                   \
+    static AVX2_TARGET void name(const uint8_t *y, const uint8_t *u, const uint8_t *v,   \
+                                 uint8_t *dst, int width, const Yuv2RgbCoeffs *k) {       \
+        row_avx2(y, u, v, dst, width, k, semi, rgba);                                    \
+    }
+
+ROW_FUNC_AVX2(row_avx2_yuv_rgb24, 0, 0)
+ROW_FUNC_AVX2(row_avx2_yuv_rgba, 0, 1)
+ROW_FUNC_AVX2(row_avx2_nv12_rgb24, 1, 0)
+ROW_FUNC_AVX2(row_avx2_nv12_rgba, 1, 1)
+#endif
+
+// [指令集][NV12][RGBA]
+static const Yuv2RgbRowFunc row_funcs[YUV2RGB_ISA_NB][2][2] = {
+    [YUV2RGB_ISA_SCALAR] = {{row_scalar_yuv_rgb24, row_scalar_yuv_rgba},
+                            {row_scalar_nv12_rgb24, row_scalar_nv12_rgba}},
+#ifdef YUV2RGB_X86
+    [YUV2RGB_ISA_SSE2] = {{row_sse2_yuv_rgb24, row_sse2_yuv_rgba},
+                          {row_sse2_nv12_rgb24, row_sse2_nv12_rgba}},
+    [YUV2RGB_ISA_AVX2] = {{row_avx2_yuv_rgb24, row_avx2_yuv_rgba},
+                          {row_avx2_nv12_rgb24, row_avx2_nv12_rgba}},
+#endif
+};
+
+/** ! 系数和指令集 */
+
+static void yuv2rgb_coeffs(Yuv2RgbCoeffs *k, int matrix, int full_range) {
+    double kr = matrix == YUV2RGB_BT709 ? 0.2126 : 0.299;
+    double kb = matrix == YUV2RGB_BT709 ? 0.0722 : 0.114;
+    double kg = 1.0 - kr - kb;
+    double ys = full_range ? 1.0 : 255.0 / 219.0;
+    double cs = full_range ? 1.0 : 255.0 / 224.0;
+    double one = 1 << YUV2RGB_SHIFT;
+
+    k->y_offset = full_range ? 0 : 16;
+    k->cy = (int)lrint(ys * one);
+    k->crv = (int)lrint(2.0 * (1.0 - kr) * cs * one);
+    k->cbu = (int)lrint(2.0 * (1.0 - kb) * cs * one);
+    k->cgu = (int)lrint(-2.0 * (1.0 - kb) * kb / kg * cs * one);
+    k->cgv = (int)lrint(-2.0 * (1.0 - kr) * kr / kg * cs * one);
+}
+
+const char *yuv2rgb_isa_name(int isa) {
+    switch (isa) {
+    case YUV2RGB_ISA_SCALAR:
+        return "scalar";
+    case YUV2RGB_ISA_SSE2:
+        return "sse2";
+    case YUV2RGB_ISA_AVX2:
+        return "avx2";
+    default:
+        return "auto";
+    }
+}
+
+// 当前CPU能否运行该指令集的实现
+int yuv2rgb_isa_available(int isa) {
+    if (isa == YUV2RGB_ISA_SCALAR) {
+        return 1;
+    }
+#ifdef YUV2RGB_X86
+    int flags = av_get_cpu_flags();
+    if (isa == YUV2RGB_ISA_SSE2) {
+        return !!(flags & AV_CPU_FLAG_SSE2);
+    }
+    if (isa == YUV2RGB_ISA_AVX2) {
+        return !!(flags & AV_CPU_FLAG_AVX2);
+    }
+#endif
+    return 0;
+}
+
+int yuv2rgb_supported(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt) {
+    return (src_fmt == AV_PIX_FMT_YUV420P || src_fmt == AV_PIX_FMT_YUVJ420P || src_fmt == AV_PIX_FMT_NV12) &&
+           (dst_fmt == AV_PIX_FMT_RGB24 || dst_fmt == AV_PIX_FMT_RGBA);
+}
+
+/** ! 分带多线程 */
+
+static void convert_band(const Yuv2RgbJob *job, int band) {
+    int start = band * job->band_rows;
+    int end = FFMIN(start + job->band_rows, job->height);
+
+    for (int j = start; j < end; j++) {
+        const uint8_t *y = job->src[0] + (ptrdiff_t)j * job->src_linesize[0];
+        const uint8_t *u = job->src[1] + (ptrdiff_t)(j >> 1) * job->src_linesize[1];
+        const uint8_t *v = job->semi ? NULL : job->src[2] + (ptrdiff_t)(j >> 1) * job->src_linesize[2];
+        job->row(y, u, v, job->dst + (ptrdiff_t)j * job->dst_linesize, job->width, &job->k);
+    }
+}
+
+static void *yuv2rgb_worker(void *arg) {
+    Yuv2RgbWorker *w = (Yuv2RgbWorker *)arg;
+    Yuv2Rgb *c = w->c;
+    int seen = 0;
+
+    pthread_mutex_lock(&c->mutex);
+    for (;;) {
+        while (c->generation == seen && !c->quit) {
+            pthread_cond_wait(&c->work_cond, &c->mutex);
+        }
+        if (c->quit) {
+            break;
+        }
+        seen = c->generation;
+        Yuv2RgbJob job = c->job;
+        pthread_mutex_unlock(&c->mutex);
+
+        if (w->index < job.nb_bands) {
+            convert_band(&job, w->index);
+        }
+
+        pthread_mutex_lock(&c->mutex);
+        if (--c->pending == 0) {
+            pthread_cond_signal(&c->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&c->mutex);
+    return NULL;
+}
+
+// nb_threads: 0按CPU核数，1只在调用线程上转换
+Yuv2Rgb *yuv2rgb_create(int nb_threads, int isa) {
+    Yuv2Rgb *c = (Yuv2Rgb *)av_mallocz(sizeof(Yuv2Rgb));
+    if (!c) {
+        return NULL;
+    }
+
+    if (isa == YUV2RGB_ISA_AUTO) {
+        isa = yuv2rgb_isa_available(YUV2RGB_ISA_AVX2) ? YUV2RGB_ISA_AVX2 :
+              yuv2rgb_isa_available(YUV2RGB_ISA_SSE2) ? YUV2RGB_ISA_SSE2 : YUV2RGB_ISA_SCALAR;
+    } else if (!yuv2rgb_isa_available(isa)) {
+        fprintf(stderr, "yuv2rgb: %s not supported on this CPU, using scalar\n", yuv2rgb_isa_name(isa));
+        isa = YUV2RGB_ISA_SCALAR;
+    }
+    c->isa = isa;
+    c->nb_threads = nb_threads > 0 ? nb_threads : av_cpu_count();
+    c->nb_threads = av_clip(c->nb_threads, 1, YUV2RGB_MAX_THREADS);
+
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->work_cond, NULL);
+    pthread_cond_init(&c->done_cond, NULL);
+    if (c->nb_threads > 1) {
+        c->workers = (Yuv2RgbWorker *)av_mallocz((c->nb_threads - 1) * sizeof(Yuv2RgbWorker));
+        if (!c->workers) {
+            yuv2rgb_free(&c);
+            return NULL;
+        }
+        for (int i = 0; i < c->nb_threads - 1; i++) {
+            c->workers[i].c = c;
+            c->workers[i].index = i + 1;
+            if (pthread_create(&c->workers[i].tid, NULL, yuv2rgb_worker, &c->workers[i]) != 0) {
+                break;
+            }
+            c->nb_workers++;
+        }
+        // 线程没能全部启动时按实际数量分带
+        c->nb_threads = c->nb_workers + 1;
+    }
+    return c;
+}
+
+void yuv2rgb_free(Yuv2Rgb **pc) {
+    Yuv2Rgb *c = *pc;
+    if (!c) {
+        return;
+    }
+
+    pthread_mutex_lock(&c->mutex);
+    c->quit = 1;
+    pthread_cond_broadcast(&c->work_cond);
+    pthread_mutex_unlock(&c->mutex);
+    for (int i = 0; i < c->nb_workers; i++) {
+        pthread_join(c->workers[i].tid, NULL);
+    }
+    av_free(c->workers);
+    pthread_mutex_destroy(&c->mutex);
+    pthread_cond_destroy(&c->work_cond);
+    pthread_cond_destroy(&c->done_cond);
+    av_freep(pc);
+}
+
+int yuv2rgb_isa(Yuv2Rgb *c) {
+    return c->isa;
+}
+
+int yuv2rgb_convert(Yuv2Rgb *c,
+                    const uint8_t *const src[4], const int src_linesize[4], enum AVPixelFormat src_fmt,
+                    uint8_t *const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt,
+                    int width, int height, int matrix, int full_range) {
+    Yuv2RgbJob job;
+
+    if (!yuv2rgb_supported(src_fmt, dst_fmt) || width <= 0 || height <= 0) {
+        return AVERROR(EINVAL);
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.semi = src_fmt == AV_PIX_FMT_NV12;
+    for (int i = 0; i < (job.semi ? 2 : 3); i++) {
+        job.src[i] = src[i];
+        job.src_linesize[i] = src_linesize[i];
+    }
+    job.dst = dst[0];
+    job.dst_linesize = dst_linesize[0];
+    job.width = width;
+    job.height = height;
+    job.row = row_funcs[c->isa][job.semi][dst_fmt == AV_PIX_FMT_RGBA];
+    yuv2rgb_coeffs(&job.k, matrix, full_range || src_fmt == AV_PIX_FMT_YUVJ420P);
+
+    // 带高取偶数，每个色度行只属于一个带
+    job.nb_bands = FFMAX(1, FFMIN(c->nb_threads, height / YUV2RGB_MIN_BAND_ROWS));
+    job.band_rows = ((height + job.nb_bands - 1) / job.nb_bands + 1) & ~1;
+    job.nb_bands = (height + job.band_rows - 1) / job.band_rows;
+
+    if (job.nb_bands == 1) {
+        convert_band(&job, 0);
+        return 0;
+    }
+
+    pthread_mutex_lock(&c->mutex);
+    c->job = job;
+    c->pending = c->nb_workers;
+    c->generation++;
+    pthread_cond_broadcast(&c->work_cond);
+    pthread_mutex_unlock(&c->mutex);
+
+    convert_band(&job, 0);
+
+    pthread_mutex_lock(&c->mutex);
+    while (c->pending > 0) {
+        pthread_cond_wait(&c->done_cond, &c->mutex);
+    }
+    pthread_mutex_unlock(&c->mutex);
+    return 0;
+}
+
+// 按帧的色彩空间和范围转换：BT.709之外按BT.601，与swscale的默认一致
+int yuv2rgb_frame(Yuv2Rgb *c, const AVFrame *frame,
+                  uint8_t *const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt) {
+    int matrix = frame->colorspace == AVCOL_SPC_BT709 ? YUV2RGB_BT709 : YUV2RGB_BT601;
+    int full_range = frame->color_range == AVCOL_RANGE_JPEG;
+
+    return yuv2rgb_convert(c, (const uint8_t *const *)frame->data, frame->linesize, frame->format,
+                           dst, dst_linesize, dst_fmt, frame->width, frame->height, matrix, full_range);
+}
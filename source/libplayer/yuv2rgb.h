@@ -0,0 +1,46 @@
+#ifndef YUV2RGB_H
+#define YUV2RGB_H
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <stdint.h>
+
+// 指令集，AUTO在运行时按CPU选择
+enum {
+    YUV2RGB_ISA_AUTO,
+    YUV2RGB_ISA_SCALAR,
+    YUV2RGB_ISA_SSE2,
+    YUV2RGB_ISA_AVX2,
+    YUV2RGB_ISA_NB
+};
+
+// 转换矩阵
+enum {
+    YUV2RGB_BT601,
+    YUV2RGB_BT709
+};
+
+typedef struct Yuv2Rgb Yuv2Rgb;
+
+/**
+ * ! 同尺寸YUV→RGB转换
+ *
+ * 只做颜色转换不做缩放：YUV420P/YUVJ420P/NV12 → RGB24/RGBA，
+ * 色度按最近邻上采样(每个色度样本覆盖2x2个像素)，与swscale同尺寸时的快速路径一致。
+ * 各指令集的实现使用同一套13位定点系数，结果逐位相同。
+ * nb_threads大于1时把图像按行分带，由线程池和调用线程并行转换。
+ */
+Yuv2Rgb *yuv2rgb_create(int nb_threads, int isa);
+void yuv2rgb_free(Yuv2Rgb **c);
+int yuv2rgb_isa(Yuv2Rgb *c);
+const char *yuv2rgb_isa_name(int isa);
+int yuv2rgb_isa_available(int isa);
+int yuv2rgb_supported(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt);
+int yuv2rgb_convert(Yuv2Rgb *c,
+                    const uint8_t *const src[4], const int src_linesize[4], enum AVPixelFormat src_fmt,
+                    uint8_t *const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt,
+                    int width, int height, int matrix, int full_range);
+int yuv2rgb_frame(Yuv2Rgb *c, const AVFrame *frame,
+                  uint8_t *const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt);
+
+#endif
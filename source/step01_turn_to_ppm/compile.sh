@@ -3,21 +3,38 @@
 # 编译ffmpeg_demo01.c
 echo "=== 编译ffmpeg_demo01 ==="
 
+LIBPLAYER="../libplayer/player.c ../libplayer/audio_output.c ../libplayer/frame_pool.c ../libplayer/frame_writer.c \
+    ../libplayer/keyframe_index.c ../libplayer/packet_queue.c ../libplayer/pcm_ring.c \
+    ../libplayer/read_ahead.c ../libplayer/stage_stats.c ../libplayer/sync_clock.c ../libplayer/yuv2rgb.c"
+
 # 方法1: 直接指定所有库，确保正确的链接顺序
-gcc -o ffmpeg_demo01 ffmpeg_demo01.c \
-    -lavformat -lavcodec -lswscale -lavutil -lm
+gcc -o ffmpeg_demo01 ffmpeg_demo01.c $LIBPLAYER -I../libplayer \
+    -lavformat -lavfilter -lavcodec -lswscale -lswresample -lavutil -lm -lpthread -ldl \
+    `sdl2-config --cflags --libs`
 
 # 如果上面的命令失败，尝试方法2
 if [ $? -ne 0 ]; then
     echo "=== 方法1失败，尝试方法2 ==="
-    gcc -o ffmpeg_demo01 ffmpeg_demo01.c \
-        $(pkg-config --cflags --libs libavformat libavcodec libswscale libavutil) \
-        -lm
+    gcc -o ffmpeg_demo01 ffmpeg_demo01.c $LIBPLAYER -I../libplayer \
+        $(pkg-config --cflags --libs libavformat libavfilter libavcodec libswscale libswresample libavutil sdl2) \
+        -lm -lpthread -ldl
 fi
 
 # 如果编译成功，显示测试命令
 if [ $? -eq 0 ]; then
     echo "=== 编译成功! ==="
     echo "使用以下命令测试:"
-    echo "./ffmpeg_demo01 test_videos/test_176x144.264"
+    echo "./ffmpeg_demo01 ../../input/test_176x144.mp4 ../../output"
+    echo "./ffmpeg_demo01 ../../input/test_176x144.mp4 ../../output --all --every 5 --format png --writers 8"
+    echo "./ffmpeg_demo01 ../../input ../../output --batch --all --every 10 --mem-cap 2048"
+fi
+
+# 编译YUV→RGB转换基准
+echo "=== 编译yuv2rgb_bench ==="
+gcc -O2 -o yuv2rgb_bench yuv2rgb_bench.c ../libplayer/yuv2rgb.c -I../libplayer \
+    -lswscale -lavutil -lm -lpthread
+
+if [ $? -eq 0 ]; then
+    echo "=== 编译成功! ==="
+    echo "./yuv2rgb_bench [宽x高] [--check]"
 fi
@@ -1,243 +1,850 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/avstring.h>
 #include <libavutil/avutil.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 #include <libswscale/swscale.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <string.h>
+#include "frame_writer.h"
+#include "player.h"
+#include "yuv2rgb.h"
+
+// 抽帧选项
+typedef struct ExtractOptions {
+    int64_t start;          // 第一帧编号(从1开始)
+    int64_t end;            // 最后一帧编号，-1表示到文件结尾
+    int every;              // 每N帧取一帧
+    int keyframes_only;     // 只解码和输出关键帧
+    int format;             // FRAME_FORMAT_PPM / FRAME_FORMAT_PNG
+    int writers;            // 每个文件的写线程数，0为默认(单个文件4，批处理1)
+    int io_mode;            // READ_AHEAD_OFF / READ_AHEAD_THREAD / READ_AHEAD_MMAP
+    int io_buffer_mb;       // 预读缓冲区(MB)，0为默认
+    int convert;            // CONVERT_SWS，或yuv2rgb的指令集(YUV2RGB_ISA_*)
+    int convert_threads;    // yuv2rgb分带线程数，0按CPU核数
+    int decode_threads;     // 每个文件的视频解码线程数，0为自动
+    int batch;              // 输入是文件列表或目录
+    int jobs;               // 批处理时同时处理的文件数，0为自动
+    int mem_cap_mb;         // 批处理的全局内存上限(MB)，0为不限制
+    int fast_start;         // 缩小探测流信息的范围
+    int64_t probesize;      // 探测流信息读取的字节数上限，0为默认
+} ExtractOptions;
+
+#define CONVERT_SWS -1      // 总是使用swscale
+
+// 抽帧过程的状态
+typedef struct ExtractContext {
+    ExtractOptions opt;
+    FrameWriter *writer;
+    struct SwsContext *sws_ctx;
+    Yuv2Rgb *yuv2rgb;       // 支持的像素格式用它转换，其余用sws_ctx；由调用者创建和释放
+    int64_t decoded;        // 已解码帧数，也是当前帧编号
+    int64_t selected;       // 交给写线程的帧数
+    int64_t convert_time;   // 颜色转换累计耗时(微秒)
+    int failed;             // 转换或写出出错
+} ExtractContext;
+
+static void usage(const char *prog) {
+    printf("用法: %s <视频文件路径> <输出文件夹> [选项]\n", prog);
+    printf("  --range A:B      输出第A到第B帧(从1开始，B省略表示到结尾)，默认1:6\n");
+    printf("  --all            输出所有帧\n");
+    printf("  --every N        每N帧输出一帧\n");
+    printf("  --keyframes      只解码关键帧，帧编号按关键帧计数\n");
+    printf("  --format ppm|png 输出格式，默认ppm\n");
+    printf("  --writers N      每个文件的写线程数，默认4，批处理时默认1\n");
+    printf("  --threads N      每个文件的视频解码线程数，默认自动\n");
+    printf("  --io off|thread|mmap  输入读取方式：默认I/O、后台线程预读或mmap，默认off\n");
+    printf("  --io-buffer MB   预读缓冲区大小，默认8\n");
+    printf("  --convert auto|scalar|sse2|avx2|sws  颜色转换：YUV420P/NV12用yuv2rgb(默认按CPU选指令集)，\n");
+    printf("                   其余格式或sws时用swscale\n");
+    printf("  --convert-threads N  yuv2rgb分带转换的线程数，0按CPU核数，默认1\n");
+    printf("  --fast-start     只探测开头512KB/0.5秒的数据，缩短打开时间\n");
+    printf("  --probesize N    探测流信息最多读取N字节\n");
+    printf("批处理:\n");
+    printf("  --batch          第一个参数是文件列表(每行一个路径)或目录，\n");
+    printf("                   每个输入输出到输出文件夹下的同名子目录\n");
+    printf("  --jobs N         同时处理的文件数，默认CPU核数的一半\n");
+    printf("  --mem-cap MB     所有文件合计的内存上限，超出时后面的文件等待，默认不限制\n");
+}
 
-// 声明SaveFrame函数
-void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame, const char *outdir);
+static int parse_convert(const char *name) {
+    if (!strcmp(name, "sws")) {
+        return CONVERT_SWS;
+    }
+    for (int isa = YUV2RGB_ISA_AUTO; isa < YUV2RGB_ISA_NB; isa++) {
+        if (!strcmp(name, yuv2rgb_isa_name(isa))) {
+            return isa;
+        }
+    }
+    return -2;
+}
 
-int main(int argc, char *argv[])
-{
-/**
- * ! 打开文件
- */
-    // 在新版本的FFmpeg中，av_register_all()已被弃用
-    printf("FFmpeg版本: %s\n", av_version_info());
+static int parse_options(ExtractOptions *opt, int argc, char *argv[]) {
+    opt->start = 1;
+    opt->end = 6;
+    opt->every = 1;
+    opt->keyframes_only = 0;
+    opt->format = FRAME_FORMAT_PPM;
+    opt->writers = 0;
+    opt->io_mode = READ_AHEAD_OFF;
+    opt->io_buffer_mb = 0;
+    opt->convert = YUV2RGB_ISA_AUTO;
+    opt->convert_threads = 1;
+    opt->decode_threads = 0;
+    opt->batch = 0;
+    opt->jobs = 0;
+    opt->mem_cap_mb = 0;
+    opt->fast_start = 0;
+    opt->probesize = 0;
+
+    for (int i = 3; i < argc; i++) {
+        if (!strcmp(argv[i], "--range") && i + 1 < argc) {
+            const char *range = argv[++i];
+            const char *colon = strchr(range, ':');
+            opt->start = atoll(range);
+            opt->end = (colon && colon[1]) ? atoll(colon + 1) : -1;
+            if (!colon || opt->start < 1 || (opt->end != -1 && opt->end < opt->start)) {
+                printf("无效的帧范围: %s\n", range);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--all")) {
+            opt->start = 1;
+            opt->end = -1;
+        } else if (!strcmp(argv[i], "--every") && i + 1 < argc) {
+            opt->every = atoi(argv[++i]);
+            if (opt->every < 1) {
+                printf("无效的间隔: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--keyframes")) {
+            opt->keyframes_only = 1;
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            const char *format = argv[++i];
+            if (!strcmp(format, "ppm")) {
+                opt->format = FRAME_FORMAT_PPM;
+            } else if (!strcmp(format, "png")) {
+                opt->format = FRAME_FORMAT_PNG;
+            } else {
+                printf("不支持的输出格式: %s\n", format);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--writers") && i + 1 < argc) {
+            opt->writers = atoi(argv[++i]);
+            if (opt->writers < 1) {
+                printf("无效的写线程数: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--io") && i + 1 < argc) {
+            opt->io_mode = read_ahead_parse_mode(argv[++i]);
+            if (opt->io_mode < 0) {
+                printf("未知的读取方式: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--io-buffer") && i + 1 < argc) {
+            opt->io_buffer_mb = atoi(argv[++i]);
+            if (opt->io_buffer_mb < 1) {
+                printf("无效的预读缓冲区大小: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--convert") && i + 1 < argc) {
+            opt->convert = parse_convert(argv[++i]);
+            if (opt->convert < CONVERT_SWS) {
+                printf("未知的转换方式: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--convert-threads") && i + 1 < argc) {
+            opt->convert_threads = atoi(argv[++i]);
+            if (opt->convert_threads < 0) {
+                printf("无效的转换线程数: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            opt->decode_threads = atoi(argv[++i]);
+            if (opt->decode_threads < 1) {
+                printf("无效的解码线程数: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--fast-start")) {
+            opt->fast_start = 1;
+        } else if (!strcmp(argv[i], "--probesize") && i + 1 < argc) {
+            opt->probesize = strtoll(argv[++i], NULL, 10);
+            if (opt->probesize < 32) {
+                printf("无效的探测字节数: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--batch")) {
+            opt->batch = 1;
+        } else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+            opt->jobs = atoi(argv[++i]);
+            if (opt->jobs < 1) {
+                printf("无效的并行文件数: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--mem-cap") && i + 1 < argc) {
+            opt->mem_cap_mb = atoi(argv[++i]);
+            if (opt->mem_cap_mb < 1) {
+                printf("无效的内存上限: %s\n", argv[i]);
+                return -1;
+            }
+        } else {
+            printf("未知选项: %s\n", argv[i]);
+            return -1;
+        }
+    }
+    if (!opt->writers) {
+        opt->writers = opt->batch ? 1 : 4;
+    }
+    return 0;
+}
 
-    // 检查命令行参数
-    if (argc != 3) {
-        printf("用法: %s <视频文件路径> <输出文件夹>\n", argv[0]);
-        return -1;
+// 当前帧是否需要输出
+static int frame_selected(ExtractOptions *opt, AVFrame *frame, int64_t index) {
+    if (index < opt->start || (opt->end != -1 && index > opt->end)) {
+        return 0;
+    }
+    if (opt->keyframes_only && !frame->key_frame) {
+        return 0;
     }
+    return (index - opt->start) % opt->every == 0;
+}
 
-    const char *input_file = argv[1];
-    const char *output_dir = argv[2];
+// 转换选中的帧并交给写线程，未选中的帧不做颜色转换
+static int extract_frame(ExtractContext *ctx, AVFrame *pFrame) {
+    int64_t index = ++ctx->decoded;
 
-    // 检查输出目录
-    struct stat st = {0};
-    if (stat(output_dir, &st) == -1) {
-        return -1;
+    if (!frame_selected(&ctx->opt, pFrame, index)) {
+        return 0;
     }
 
-    // 检查文件是否存在并且可读
-    FILE *file = fopen(input_file, "rb");
-    if (!file) {
-        printf("错误：文件 '%s' 不存在或无法访问\n", input_file);
-        return -1;
+    // 同尺寸的YUV420P/NV12用专门的转换，其余格式用swscale，转换上下文只在尺寸或像素格式变化时重建
+    int use_yuv2rgb = ctx->yuv2rgb && yuv2rgb_supported(pFrame->format, AV_PIX_FMT_RGB24);
+    if (!use_yuv2rgb) {
+        ctx->sws_ctx = sws_getCachedContext(ctx->sws_ctx,
+            pFrame->width, pFrame->height, pFrame->format,
+            pFrame->width, pFrame->height, AV_PIX_FMT_RGB24,
+            SWS_BILINEAR, NULL, NULL, NULL
+        );
+        if (!ctx->sws_ctx) {
+            printf("无法创建转换上下文\n");
+            return -1;
+        }
     }
-    fclose(file);
 
-    // 初始化格式上下文
-    printf("正在打开文件: %s\n", input_file);
-    
-    // 创建格式上下文
-    AVFormatContext *pFormatCtx = avformat_alloc_context();
-    if (!pFormatCtx) {
-        printf("无法分配格式上下文\n");
+    // 直接转换进写任务的缓冲区，写线程跟不上时在这里阻塞
+    WriteJob *job = frame_writer_acquire(ctx->writer, pFrame->width, pFrame->height);
+    if (!job) {
+        printf("无法分配RGB内存\n");
         return -1;
     }
 
-    // 打开输入文件
-    int ret = avformat_open_input(&pFormatCtx, input_file, NULL, NULL);
-    if (ret < 0) {
-        char errbuf[AV_ERROR_MAX_STRING_SIZE];
-        av_strerror(ret, errbuf, AV_ERROR_MAX_STRING_SIZE);
-        printf("无法打开文件: %s (错误码: %d)\n", errbuf, ret);
-        avformat_free_context(pFormatCtx);
-        return -1;
+    int64_t t0 = av_gettime_relative();
+    if (use_yuv2rgb) {
+        yuv2rgb_frame(ctx->yuv2rgb, pFrame, job->data, job->linesize, AV_PIX_FMT_RGB24);
+    } else {
+        sws_scale(ctx->sws_ctx, (const uint8_t * const*)pFrame->data, pFrame->linesize, 0,
+                  pFrame->height, job->data, job->linesize);
     }
-    // 检查文件流信息
-    if(avformat_find_stream_info(pFormatCtx, NULL) < 0){
-        printf("无法获取视频流信息\n");
+    ctx->convert_time += av_gettime_relative() - t0;
+
+    frame_writer_submit(ctx->writer, job, (int)index);
+    ctx->selected++;
+    return 0;
+}
+
+// 帧回调，在libplayer的视频解码线程上调用
+// 返回非0让播放器停止：出错，或已经超过输出范围
+static int on_frame(void *opaque, AVFrame *pFrame, double pts, double duration) {
+    ExtractContext *ctx = (ExtractContext *)opaque;
+
+    if (extract_frame(ctx, pFrame) < 0) {
+        ctx->failed = 1;
         return -1;
     }
-    // 手工调试函数
-    av_dump_format(pFormatCtx, 0, input_file, 0);
+    return ctx->opt.end != -1 && ctx->decoded >= ctx->opt.end;
+}
 
-    int i;
-    int videoStream=-1;
-    AVCodecContext *pCodecCtx;
 
-    // 找到第一个视频流
-    for(i=0; i<pFormatCtx->nb_streams; i++) {
-        if(pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            videoStream=i;
-            break;
-        }
-        if(videoStream == -1){
-            printf("无法找到视频流\n");
-            return -1;
+/**
+ * ! 单个文件
+ */
+// 一个文件的处理结果
+typedef struct FileResult {
+    int64_t decoded;        // 解码帧数
+    int64_t written;        // 输出帧数
+    int64_t bytes;          // 输出字节数
+    int64_t selected;       // 转换过的帧数
+    int64_t convert_time;   // 颜色转换累计耗时(微秒)
+    int errors;             // 写出失败的帧数
+    double open_time;       // 打开文件、探测流和打开解码器的耗时(秒)
+    double first_frame;     // 从打开到第一帧交给on_frame的耗时(秒)，不包括等待内存预算；没有帧时为-1
+    double elapsed;         // 从打开到写完的耗时(秒)，不包括等待内存预算
+    double budget_wait;     // 等待内存预算的时间(秒)
+    int64_t mem_estimate;   // 申请的内存预算(字节)，没有预算时为0
+    int failed;
+} FileResult;
+
+// 批处理的全局内存预算：每个文件开始解码前按估计的占用申请，处理完归还
+typedef struct MemBudget {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int64_t cap;            // 上限(字节)
+    int64_t used;
+    int64_t peak;
+    int waits;              // 因为超出上限而等待的次数
+} MemBudget;
+
+#define BATCH_QUEUE_SIZE (4 * 1024 * 1024)   // 批处理时每个文件的包队列上限，无头解码不需要深缓冲
+#define BATCH_DECODER_FRAMES 16              // 解码器参考帧、重排序和帧缓冲池余量的粗略上限(帧)
+
+static void mem_budget_acquire(MemBudget *b, int64_t bytes) {
+    pthread_mutex_lock(&b->mutex);
+    // 单个文件就超过上限时，等到没有其他文件在处理再开始，不会永远等待
+    if (b->used > 0 && b->used + bytes > b->cap) {
+        b->waits++;
+        while (b->used > 0 && b->used + bytes > b->cap) {
+            pthread_cond_wait(&b->cond, &b->mutex);
         }
     }
-    // 获得视频流的编解码器参数
-    AVCodecParameters *pCodecPar = pFormatCtx->streams[videoStream]->codecpar;
+    b->used += bytes;
+    b->peak = FFMAX(b->peak, b->used);
+    pthread_mutex_unlock(&b->mutex);
+}
 
-    // 找到编解码器
-    AVCodec *pCodec;
-    // 找到解码器
-    pCodec = avcodec_find_decoder(pCodecPar->codec_id);
+static void mem_budget_release(MemBudget *b, int64_t bytes) {
+    pthread_mutex_lock(&b->mutex);
+    b->used -= bytes;
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->mutex);
+}
 
-    if(pCodec == NULL){
-        printf("无法找到解码器\n");
-        return -1;
+// 估计一个文件解码时的内存占用：解码器和帧缓冲池里的YUV帧、写任务的RGB缓冲区、包队列和预读缓冲区
+static int64_t estimate_memory(const ExtractOptions *opt, const PlayerOptions *popt, AVStream *st) {
+    AVCodecParameters *par = st->codecpar;
+    int64_t frame = par->format >= 0 ? av_image_get_buffer_size(par->format, par->width, par->height, 1) : -1;
+    if (frame <= 0) {
+        frame = (int64_t)par->width * par->height * 3;
     }
+    int64_t rgb = (int64_t)FFALIGN(par->width * 3, RGB_ALIGN) * par->height;
+    int64_t io = popt->io_mode == READ_AHEAD_OFF ? 0 :
+                 popt->io_buffer_size ? (int64_t)popt->io_buffer_size : READ_AHEAD_DEFAULT_SIZE;
 
-    // 分配编解码器上下文
-    pCodecCtx = avcodec_alloc_context3(pCodec);
-    if(pCodecCtx == NULL){
-        printf("无法分配编解码器上下文\n");
-        return -1;
+    return frame * (BATCH_DECODER_FRAMES + FFMAX(popt->decode_threads, 1)) +
+           rgb * opt->writers * 2 + (int64_t)popt->max_queue_size + io;
+}
+
+// 抽取一个文件的帧：打开、解码、转换、写出。budget不为NULL时解码前按估计的内存占用排队
+static int extract_file(const ExtractOptions *opt, const char *input_file, const char *output_dir,
+                        Yuv2Rgb *yuv2rgb, MemBudget *budget, FileResult *res) {
+    ExtractContext ctx = {0};
+    int64_t start_time = av_gettime_relative();
+
+    memset(res, 0, sizeof(FileResult));
+    res->first_frame = -1;
+    ctx.opt = *opt;
+    ctx.yuv2rgb = yuv2rgb;
+
+    // 无头模式：不打开音频，帧解码出来就交给on_frame，不按时钟等待
+    PlayerOptions popt;
+    player_default_options(&popt);
+    popt.audio = 0;
+    popt.realtime = 0;
+    popt.keyframe_index = 0;
+    popt.decode_threads = opt->decode_threads;
+    popt.frame_cb = on_frame;
+    popt.opaque = &ctx;
+    popt.io_mode = opt->io_mode;
+    popt.io_buffer_size = (size_t)opt->io_buffer_mb * 1024 * 1024;
+    popt.fast_start = opt->fast_start;
+    popt.probesize = opt->probesize;
+    // 批处理时多个文件同时解码，不打印流信息，包队列也不需要默认那么深
+    if (opt->batch) {
+        popt.verbose = 0;
+        popt.max_queue_size = BATCH_QUEUE_SIZE;
+    }
+    // 只要关键帧时让解码器直接跳过其余帧
+    if (opt->keyframes_only) {
+        popt.skip_frame = AVDISCARD_NONKEY;
     }
 
-    // 将编解码器参数复制到上下文
-    if(avcodec_parameters_to_context(pCodecCtx, pCodecPar) < 0){
-        printf("无法复制编解码器参数\n");
+    Player *player = player_open(input_file, &popt);
+    res->open_time = (av_gettime_relative() - start_time) / 1000000.0;
+    if (!player) {
+        printf("无法打开文件: %s\n", input_file);
+        res->failed = 1;
+        return -1;
+    }
+    if (!player_video_stream(player)) {
+        printf("无法找到视频流: %s\n", input_file);
+        player_close(player);
+        res->failed = 1;
         return -1;
     }
 
-    // 打开解码器
-    if(avcodec_open2(pCodecCtx, pCodec, NULL) < 0){
-        printf("无法打开解码器\n");
+    // 写任务数为写线程数的两倍，解码和写盘可以重叠
+    ctx.writer = frame_writer_create(output_dir, opt->format, opt->writers, opt->writers * 2);
+    if (!ctx.writer) {
+        printf("无法创建写线程\n");
+        player_close(player);
+        res->failed = 1;
         return -1;
     }
 
+    if (budget) {
+        int64_t t0 = av_gettime_relative();
+        res->mem_estimate = estimate_memory(opt, &popt, player_video_stream(player));
+        mem_budget_acquire(budget, res->mem_estimate);
+        res->budget_wait = (av_gettime_relative() - t0) / 1000000.0;
+    }
+
+    if (player_start(player) == 0) {
+        // 播完(包括冲刷解码器中缓存的帧)或超过输出范围时返回
+        player_wait(player);
+    }
+    player_stop(player);
+
+    PlayerStats stats;
+    player_get_stats(player, &stats);
+    res->first_frame = stats.first_frame_ms >= 0 ? stats.first_frame_ms / 1000.0 - res->budget_wait : -1;
+
+    // 等待写线程写完
+    res->errors = frame_writer_close(ctx.writer, &res->written, &res->bytes);
+
+    // 关闭解码器和文件
+    player_close(player);
+    sws_freeContext(ctx.sws_ctx);
+    if (budget) {
+        mem_budget_release(budget, res->mem_estimate);
+    }
+
+    res->decoded = ctx.decoded;
+    res->selected = ctx.selected;
+    res->convert_time = ctx.convert_time;
+    // 写出失败的帧也算这个文件失败，批处理汇总和退出码都要反映出来
+    res->failed = ctx.failed || res->errors > 0;
+    res->elapsed = (av_gettime_relative() - start_time) / 1000000.0 - res->budget_wait;
+    return res->failed ? -1 : 0;
+}
+
+static Yuv2Rgb *open_converter(const ExtractOptions *opt) {
+    Yuv2Rgb *yuv2rgb = NULL;
+    if (opt->convert != CONVERT_SWS) {
+        yuv2rgb = yuv2rgb_create(opt->convert_threads, opt->convert);
+        if (!yuv2rgb) {
+            printf("无法创建颜色转换，使用swscale\n");
+        }
+    }
+    return yuv2rgb;
+}
+
 /**
- * ! 保存数据
+ * ! 批处理
+ * 每个工作线程处理一个文件的完整流水线(打开、解码、转换、写出)，文件之间完全并行，
+ * 一个文件的打开和探测与其他文件的解码重叠。文件按大小从大到小轮流分给各线程的双端队列，
+ * 线程从自己队列的头部取，取空后从剩余最多的队列尾部偷。
  */
-    AVFrame *pFrame;
-    AVFrame *pFrameRGB;
-    // 分配视频帧
-    pFrame = av_frame_alloc();
-    if(pFrame == NULL){
-        printf("无法分配帧内存\n");
-        return -1;
+typedef struct BatchFile {
+    char *path;
+    char name[256];         // 输出子目录名
+    int64_t size;
+    FileResult result;
+} BatchFile;
+
+typedef struct BatchDeque {
+    pthread_mutex_t mutex;
+    int *items;             // 文件下标
+    int head, tail;         // 剩余[head, tail)
+} BatchDeque;
+
+typedef struct Batch {
+    const ExtractOptions *opt;
+    const char *output_dir;
+    BatchFile *files;
+    int nb_files;
+    BatchDeque *deques;
+    int nb_jobs;
+    MemBudget budget;
+    atomic_int done;        // 已完成的文件数
+    atomic_int steals;      // 从其他线程偷来的文件数
+} Batch;
+
+typedef struct BatchWorker {
+    Batch *batch;
+    int index;
+    pthread_t tid;
+} BatchWorker;
+
+static int batch_add(Batch *b, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        printf("跳过不是文件的输入: %s\n", path);
+        return 0;
     }
 
-    // 申请RGB帧内存
-    pFrameRGB = av_frame_alloc();
-    if(pFrameRGB == NULL){
-        printf("无法分配内存\n");
+    BatchFile *files = (BatchFile *)av_realloc(b->files, (b->nb_files + 1) * sizeof(BatchFile));
+    if (!files) {
+        return -1;
+    }
+    b->files = files;
+    BatchFile *f = &b->files[b->nb_files];
+    memset(f, 0, sizeof(BatchFile));
+    f->path = av_strdup(path);
+    if (!f->path) {
         return -1;
     }
+    f->size = st.st_size;
+
+    // 输出子目录用去掉扩展名的文件名，重名时加上序号
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(f->name, sizeof(f->name), "%s", base);
+    char *dot = strrchr(f->name, '.');
+    if (dot && dot != f->name) {
+        *dot = '\0';
+    }
+    for (int i = 0; i < b->nb_files; i++) {
+        if (!strcmp(b->files[i].name, f->name)) {
+            size_t len = strlen(f->name);
+            snprintf(f->name + len, sizeof(f->name) - len, "_%d", b->nb_files + 1);
+            break;
+        }
+    }
+    b->nb_files++;
+    return 0;
+}
 
-    uint8_t *buffer;
-    int numBytes;
-    // 手工申请内存空间
-    numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height, 1);
-    buffer = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
 
-    // 帧和内存组合
-    av_image_fill_arrays(pFrameRGB->data, pFrameRGB->linesize, buffer, AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height, 1);
+// 输入是目录时取其中的所有普通文件(按文件名排序，跳过隐藏文件)，否则按行读取文件列表
+static int batch_load(Batch *b, const char *source) {
+    struct stat st;
+    if (stat(source, &st) != 0) {
+        printf("错误：'%s' 不存在或无法访问\n", source);
+        return -1;
+    }
 
-/**
- * ! 读取数据
- */
-    int frameFinished;
-    AVPacket packet;
-
-    i = 0;
-    while(av_read_frame(pFormatCtx, &packet) >= 0){
-        // 是视频流
-        if(packet.stream_index == videoStream){
-            // 解码视频帧
-            int ret = avcodec_send_packet(pCodecCtx, &packet);
-            if (ret < 0) {
-                printf("发送数据包失败\n");
-                continue;
-            }
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(source);
+        struct dirent *entry;
+        char **names = NULL;
+        int nb_names = 0, ret = 0;
 
-            ret = avcodec_receive_frame(pCodecCtx, pFrame);
-            if (ret < 0) {
-                // 需要更多数据包或者出错
+        if (!dir) {
+            printf("无法打开目录: %s\n", source);
+            return -1;
+        }
+        while ((entry = readdir(dir))) {
+            if (entry->d_name[0] == '.') {
                 continue;
             }
+            char **tmp = (char **)av_realloc(names, (nb_names + 1) * sizeof(char *));
+            if (!tmp || !(tmp[nb_names] = av_asprintf("%s/%s", source, entry->d_name))) {
+                names = tmp ? tmp : names;
+                ret = -1;
+                break;
+            }
+            names = tmp;
+            nb_names++;
+        }
+        closedir(dir);
 
-            // 创建转换上下文
-            struct SwsContext *sws_ctx = sws_getContext(
-                pCodecCtx->width, pCodecCtx->height, pCodecCtx->pix_fmt,
-                pCodecCtx->width, pCodecCtx->height, AV_PIX_FMT_RGB24,
-                SWS_BILINEAR, NULL, NULL, NULL
-            );
-
-            if (!sws_ctx) {
-                printf("无法创建转换上下文\n");
-                continue;
+        qsort(names, nb_names, sizeof(char *), compare_names);
+        for (int i = 0; i < nb_names; i++) {
+            if (ret == 0) {
+                ret = batch_add(b, names[i]);
             }
+            av_free(names[i]);
+        }
+        av_free(names);
+        return ret;
+    }
 
-            // 转换像素格式
-            sws_scale(sws_ctx, (const uint8_t * const*)pFrame->data, pFrame->linesize, 0,
-                      pCodecCtx->height, pFrameRGB->data, pFrameRGB->linesize);
+    FILE *list = fopen(source, "r");
+    char line[4096];
+    if (!list) {
+        printf("无法打开文件列表: %s\n", source);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), list)) {
+        // 去掉首尾空白，跳过空行和#开头的注释
+        char *path = line;
+        while (*path == ' ' || *path == '\t') {
+            path++;
+        }
+        size_t len = strlen(path);
+        while (len > 0 && strchr(" \t\r\n", path[len - 1])) {
+            path[--len] = '\0';
+        }
+        if (len == 0 || path[0] == '#') {
+            continue;
+        }
+        if (batch_add(b, path) < 0) {
+            fclose(list);
+            return -1;
+        }
+    }
+    fclose(list);
+    return 0;
+}
+
+static int compare_size_desc(const void *a, const void *b) {
+    int64_t sa = ((const BatchFile *)a)->size, sb = ((const BatchFile *)b)->size;
+    return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
 
-            // 释放转换上下文
-            sws_freeContext(sws_ctx);
+// 取下一个文件：先取自己队列的头部，空了再从剩余最多的队列尾部偷，全部取完返回-1
+static int batch_next(Batch *b, int self) {
+    BatchDeque *q = &b->deques[self];
+    int index = -1;
 
-            // 保存帧
-            if(i++ <= 5) {
-                SaveFrame(pFrameRGB, pCodecCtx->width, pCodecCtx->height, i, output_dir);
+    pthread_mutex_lock(&q->mutex);
+    if (q->head < q->tail) {
+        index = q->items[q->head++];
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    while (index < 0) {
+        int victim = -1, most = 0;
+        for (int i = 0; i < b->nb_jobs; i++) {
+            BatchDeque *v = &b->deques[i];
+            pthread_mutex_lock(&v->mutex);
+            int left = v->tail - v->head;
+            pthread_mutex_unlock(&v->mutex);
+            if (left > most) {
+                most = left;
+                victim = i;
             }
         }
-        // 释放资源
-        av_packet_unref(&packet);
+        if (victim < 0) {
+            return -1;
+        }
+        // 选出和加锁之间可能被别的线程取空，重新选
+        BatchDeque *v = &b->deques[victim];
+        pthread_mutex_lock(&v->mutex);
+        if (v->head < v->tail) {
+            index = v->items[--v->tail];
+            atomic_fetch_add(&b->steals, 1);
+        }
+        pthread_mutex_unlock(&v->mutex);
     }
+    return index;
+}
 
-    // 清理RGB图像
-    av_free(buffer);
-    av_frame_free(&pFrameRGB);
+static void *batch_worker(void *arg) {
+    BatchWorker *w = (BatchWorker *)arg;
+    Batch *b = w->batch;
+    Yuv2Rgb *yuv2rgb = open_converter(b->opt);
+    int index;
+
+    while ((index = batch_next(b, w->index)) >= 0) {
+        BatchFile *f = &b->files[index];
+        FileResult *res = &f->result;
+        char dir[1024];
+
+        snprintf(dir, sizeof(dir), "%s/%s", b->output_dir, f->name);
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            printf("无法创建输出目录: %s\n", dir);
+            res->failed = 1;
+        } else {
+            extract_file(b->opt, f->path, dir, yuv2rgb, b->opt->mem_cap_mb ? &b->budget : NULL, res);
+        }
 
-    // 清理YUV帧
-    av_frame_free(&pFrame);
+        int done = atomic_fetch_add(&b->done, 1) + 1;
+        printf("[%d/%d] %s: %s解码 %lld 帧, 输出 %lld 帧 (%.1f MB), 打开 %.1f ms, 首帧 %.1f ms, "
+               "用时 %.3f 秒, %.1f fps\n",
+               done, b->nb_files, f->name, res->failed ? "失败, " : "",
+               (long long)res->decoded, (long long)res->written, res->bytes / (1024.0 * 1024.0),
+               res->open_time * 1000.0, res->first_frame * 1000.0,
+               res->elapsed, res->elapsed > 0 ? res->decoded / res->elapsed : 0.0);
+    }
 
-    // 关闭解码器
-    avcodec_free_context(&pCodecCtx);
+    yuv2rgb_free(&yuv2rgb);
+    return NULL;
+}
 
-    // 关闭文件
-    avformat_close_input(&pFormatCtx);
+static int run_batch(ExtractOptions *opt, const char *source, const char *output_dir) {
+    Batch b;
+    int cores = av_cpu_count();
+    int failed = 0, ret = -1;
+
+    memset(&b, 0, sizeof(b));
+    b.opt = opt;
+    b.output_dir = output_dir;
+    if (batch_load(&b, source) < 0) {
+        printf("无法读取输入列表: %s\n", source);
+        goto end;
+    }
+    if (b.nb_files == 0) {
+        printf("没有可处理的输入\n");
+        goto end;
+    }
 
-    return 0;
+    // 分配CPU：文件之间完全并行，帧级多线程解码有同步和延迟开销，
+    // 所以默认优先同时处理更多文件，每个文件至少两个解码线程
+    b.nb_jobs = FFMIN(opt->jobs > 0 ? opt->jobs : FFMAX(1, cores / 2), b.nb_files);
+    if (!opt->decode_threads) {
+        opt->decode_threads = FFMAX(1, cores / b.nb_jobs);
+    }
+    printf("批处理: %d 个文件, %d 个核, 同时处理 %d 个文件, 每个文件 %d 个解码线程、%d 个写线程",
+           b.nb_files, cores, b.nb_jobs, opt->decode_threads, opt->writers);
+    if (opt->mem_cap_mb) {
+        printf(", 内存上限 %d MB", opt->mem_cap_mb);
+    }
+    printf("\n");
+
+    // 大文件先开始，减少最后只剩一个大文件在跑的时间
+    qsort(b.files, b.nb_files, sizeof(BatchFile), compare_size_desc);
+    b.deques = (BatchDeque *)av_mallocz(b.nb_jobs * sizeof(BatchDeque));
+    if (!b.deques) {
+        goto end;
+    }
+    for (int i = 0; i < b.nb_jobs; i++) {
+        b.deques[i].items = (int *)av_malloc(b.nb_files * sizeof(int));
+        if (!b.deques[i].items) {
+            b.nb_jobs = i;
+            goto end;
+        }
+        pthread_mutex_init(&b.deques[i].mutex, NULL);
+    }
+    for (int i = 0; i < b.nb_files; i++) {
+        BatchDeque *q = &b.deques[i % b.nb_jobs];
+        q->items[q->tail++] = i;
+    }
+    pthread_mutex_init(&b.budget.mutex, NULL);
+    pthread_cond_init(&b.budget.cond, NULL);
+    b.budget.cap = (int64_t)opt->mem_cap_mb * 1024 * 1024;
+    atomic_init(&b.done, 0);
+    atomic_init(&b.steals, 0);
+
+    BatchWorker *workers = (BatchWorker *)av_mallocz(b.nb_jobs * sizeof(BatchWorker));
+    if (!workers) {
+        goto end_budget;
+    }
+    int64_t start_time = av_gettime_relative();
+    int started = 0;
+    for (int i = 0; i < b.nb_jobs; i++) {
+        workers[i].batch = &b;
+        workers[i].index = i;
+        if (pthread_create(&workers[i].tid, NULL, batch_worker, &workers[i]) != 0) {
+            printf("无法创建批处理线程\n");
+            break;
+        }
+        started++;
+    }
+    // 线程没有全部启动时，其余线程会偷走没人取的队列
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].tid, NULL);
+    }
+    av_free(workers);
+    double wall = (av_gettime_relative() - start_time) / 1000000.0;
+
+    // 汇总
+    int64_t decoded = 0, written = 0, bytes = 0;
+    double busy = 0, open_time = 0, budget_wait = 0;
+    for (int i = 0; i < b.nb_files; i++) {
+        FileResult *res = &b.files[i].result;
+        failed += res->failed;
+        decoded += res->decoded;
+        written += res->written;
+        bytes += res->bytes;
+        busy += res->elapsed;
+        open_time += res->open_time;
+        budget_wait += res->budget_wait;
+    }
+    printf("批处理完成: %d 个文件 (%d 个失败), 共解码 %lld 帧, 输出 %lld 帧 (%.1f MB), "
+           "用时 %.3f 秒, %.1f fps, %.2f 文件/秒\n",
+           b.nb_files, failed, (long long)decoded, (long long)written, bytes / (1024.0 * 1024.0),
+           wall, wall > 0 ? decoded / wall : 0.0, wall > 0 ? b.nb_files / wall : 0.0);
+    printf("各文件用时合计 %.3f 秒(其中打开 %.3f 秒), 并行加速 %.2fx, 偷取 %d 个文件\n",
+           busy, open_time, wall > 0 ? busy / wall : 0.0, atomic_load(&b.steals));
+    ret = failed ? -1 : 0;
+    if (opt->mem_cap_mb) {
+        printf("内存预算峰值 %.1f MB, 等待 %d 次共 %.3f 秒\n",
+               b.budget.peak / (1024.0 * 1024.0), b.budget.waits, budget_wait);
+    }
+
+end_budget:
+    pthread_mutex_destroy(&b.budget.mutex);
+    pthread_cond_destroy(&b.budget.cond);
+
+end:
+    for (int i = 0; b.deques && i < b.nb_jobs; i++) {
+        pthread_mutex_destroy(&b.deques[i].mutex);
+        av_free(b.deques[i].items);
+    }
+    av_free(b.deques);
+    for (int i = 0; i < b.nb_files; i++) {
+        av_free(b.files[i].path);
+    }
+    av_free(b.files);
+    return ret;
 }
 
-// 把RGB信息定稿到PPM格式的文件
-void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame, const char *outdir)
+int main(int argc, char *argv[])
 {
-    FILE *pFile;
-    char szFilename[512];  // 增加缓冲区大小以适应路径
-    int  y;
-
-    // 构建完整的文件路径
-    #ifdef _WIN32
-        snprintf(szFilename, sizeof(szFilename), "%s\\frame%d.ppm", outdir, iFrame);
-    #else
-        snprintf(szFilename, sizeof(szFilename), "%s/frame%d.ppm", outdir, iFrame);
-    #endif
-
-    pFile = fopen(szFilename, "wb");
-    if(pFile == NULL) {
-        printf("错误：无法创建文件 '%s'\n", szFilename);
-        return;
-    }
-
-    // Write header
-    fprintf(pFile, "P6\n%d %d\n255\n", width, height);
-
-    // 一次向文件写入一行数据
-    // PPM格式：包含一长串RGB数据的文件
-    for(y=0; y<height; y++)
-        fwrite(pFrame->data[0]+y*pFrame->linesize[0], 1, width*3, pFile);
-
-    // Close file
-    fclose(pFile);
-    printf("已保存帧 %d 到 %s\n", iFrame, szFilename);
+/**
+ * ! 打开文件
+ */
+    // 在新版本的FFmpeg中，av_register_all()已被弃用
+    printf("FFmpeg版本: %s\n", av_version_info());
+
+    // 检查命令行参数
+    ExtractOptions opt;
+    if (argc < 3 || parse_options(&opt, argc, argv) < 0) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    const char *input_file = argv[1];
+    const char *output_dir = argv[2];
+
+    // 检查输出目录
+    struct stat st = {0};
+    if (stat(output_dir, &st) == -1) {
+        return -1;
+    }
+
+    if (opt.batch) {
+        return run_batch(&opt, input_file, output_dir);
+    }
+
+    // 检查文件是否存在并且可读
+    FILE *file = fopen(input_file, "rb");
+    if (!file) {
+        printf("错误：文件 '%s' 不存在或无法访问\n", input_file);
+        return -1;
+    }
+    fclose(file);
+
+    printf("正在打开文件: %s\n", input_file);
+
+/**
+ * ! 读取数据
+ */
+    Yuv2Rgb *yuv2rgb = open_converter(&opt);
+    FileResult res;
+    extract_file(&opt, input_file, output_dir, yuv2rgb, NULL, &res);
+
+    // 输出处理速度
+    if (res.elapsed > 0) {
+        printf("共解码 %lld 帧, 输出 %lld 帧 (%s, %.1f MB, %d 个失败), 用时 %.3f 秒, %.1f fps\n",
+               (long long)res.decoded, (long long)res.written, frame_format_ext(opt.format),
+               res.bytes / (1024.0 * 1024.0), res.errors, res.elapsed,
+               res.decoded / res.elapsed);
+        printf("打开 %.1f ms, 首帧 %.1f ms, 转换平均 %.3f ms/帧 (%s)\n",
+               res.open_time * 1000.0, res.first_frame * 1000.0,
+               res.selected > 0 ? res.convert_time / 1000.0 / res.selected : 0.0,
+               yuv2rgb ? yuv2rgb_isa_name(yuv2rgb_isa(yuv2rgb)) : "sws");
+    }
+    yuv2rgb_free(&yuv2rgb);
+
+    return res.failed ? -1 : 0;
 }
@@ -0,0 +1,337 @@
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yuv2rgb.h"
+
+/**
+ * ! YUV→RGB转换基准和精度检查
+ * 用合成的帧比较yuv2rgb各指令集、分带多线程和swscale(SWS_BILINEAR)的速度
+ * --check时检查：各指令集和多线程的结果与标量实现逐位相同，与双精度公式的差不超过1，
+ * 与swscale的差不超过SWS_TOLERANCE
+ */
+
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+#define DEFAULT_FRAMES 100
+// swscale同尺寸转换走自己的SIMD快速路径，系数精度和舍入与C实现不同，只要求差值在这个范围内
+#define SWS_TOLERANCE 3
+#define REF_TOLERANCE 1
+
+static const enum AVPixelFormat src_fmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12 };
+static const enum AVPixelFormat dst_fmts[] = { AV_PIX_FMT_RGB24, AV_PIX_FMT_RGBA };
+
+typedef struct Image {
+    uint8_t *data[4];
+    int linesize[4];
+    enum AVPixelFormat fmt;
+    int width, height;
+} Image;
+
+static int image_alloc(Image *img, int width, int height, enum AVPixelFormat fmt) {
+    memset(img, 0, sizeof(Image));
+    img->fmt = fmt;
+    img->width = width;
+    img->height = height;
+    return av_image_alloc(img->data, img->linesize, width, height, fmt, 64);
+}
+
+static void image_free(Image *img) {
+    av_freep(&img->data[0]);
+}
+
+// 渐变加噪声，覆盖整个取值范围(包括有限范围以外的值)
+static void fill_yuv(Image *img) {
+    unsigned seed = 12345;
+    int cw = (img->width + 1) / 2, ch = (img->height + 1) / 2;
+
+    for (int j = 0; j < img->height; j++) {
+        for (int i = 0; i < img->width; i++) {
+            seed = seed * 1103515245 + 12345;
+            img->data[0][j * img->linesize[0] + i] = (uint8_t)((i + j) / 4 + (seed >> 24) % 64);
+        }
+    }
+    for (int j = 0; j < ch; j++) {
+        for (int i = 0; i < cw; i++) {
+            seed = seed * 1103515245 + 12345;
+            uint8_t u = (uint8_t)(i * 255 / cw + (seed >> 26));
+            uint8_t v = (uint8_t)(j * 255 / ch - (seed >> 27));
+            if (img->fmt == AV_PIX_FMT_NV12) {
+                img->data[1][j * img->linesize[1] + 2 * i] = u;
+                img->data[1][j * img->linesize[1] + 2 * i + 1] = v;
+            } else {
+                img->data[1][j * img->linesize[1] + i] = u;
+                img->data[2][j * img->linesize[2] + i] = v;
+            }
+        }
+    }
+}
+
+static int convert(Yuv2Rgb *c, const Image *src, Image *dst, int matrix, int full_range) {
+    return yuv2rgb_convert(c, (const uint8_t *const *)src->data, src->linesize, src->fmt,
+                           dst->data, dst->linesize, dst->fmt, src->width, src->height, matrix, full_range);
+}
+
+// 按要转换的矩阵和范围设置swscale，YUV420P同尺寸时走swscale自己的快速路径
+static struct SwsContext *sws_open(const Image *src, const Image *dst, int flags, int matrix, int full_range) {
+    struct SwsContext *sws = sws_getContext(src->width, src->height, src->fmt,
+                                            dst->width, dst->height, dst->fmt,
+                                            flags, NULL, NULL, NULL);
+    if (!sws) {
+        return NULL;
+    }
+    sws_setColorspaceDetails(sws, sws_getCoefficients(matrix == YUV2RGB_BT709 ? SWS_CS_ITU709 : SWS_CS_ITU601),
+                             full_range, sws_getCoefficients(SWS_CS_ITU601), 1, 0, 1 << 16, 1 << 16);
+    return sws;
+}
+
+static int compare(const Image *a, const Image *b, int *max_diff, double *exact) {
+    int bpp = a->fmt == AV_PIX_FMT_RGBA ? 4 : 3;
+    int64_t same = 0, total = (int64_t)a->width * bpp * a->height;
+    int diff_rows = 0;
+
+    *max_diff = 0;
+    for (int j = 0; j < a->height; j++) {
+        const uint8_t *pa = a->data[0] + j * a->linesize[0];
+        const uint8_t *pb = b->data[0] + j * b->linesize[0];
+        int row_diff = 0;
+        for (int i = 0; i < a->width * bpp; i++) {
+            int d = abs(pa[i] - pb[i]);
+            same += d == 0;
+            row_diff |= d;
+            if (d > *max_diff) {
+                *max_diff = d;
+            }
+        }
+        diff_rows += row_diff != 0;
+    }
+    *exact = total > 0 ? 100.0 * same / total : 100.0;
+    return diff_rows;
+}
+
+/** ! 精度检查 */
+
+// 按双精度公式逐像素计算，返回与out的最大差
+static int reference_diff(const Image *src, const Image *out, int matrix, int full_range) {
+    double kr = matrix == YUV2RGB_BT709 ? 0.2126 : 0.299;
+    double kb = matrix == YUV2RGB_BT709 ? 0.0722 : 0.114;
+    double kg = 1.0 - kr - kb;
+    int bpp = out->fmt == AV_PIX_FMT_RGBA ? 4 : 3;
+    int max_diff = 0;
+
+    for (int j = 0; j < src->height; j++) {
+        for (int i = 0; i < src->width; i++) {
+            const uint8_t *c = src->data[1] + (j / 2) * src->linesize[1];
+            double y = src->data[0][j * src->linesize[0] + i];
+            double u = (src->fmt == AV_PIX_FMT_NV12 ? c[i / 2 * 2] : c[i / 2]) - 128.0;
+            double v = (src->fmt == AV_PIX_FMT_NV12 ? c[i / 2 * 2 + 1] :
+                        src->data[2][(j / 2) * src->linesize[2] + i / 2]) - 128.0;
+            if (!full_range) {
+                y = (y - 16.0) * 255.0 / 219.0;
+                u *= 255.0 / 224.0;
+                v *= 255.0 / 224.0;
+            }
+            double r = y + 2.0 * (1.0 - kr) * v;
+            double b = y + 2.0 * (1.0 - kb) * u;
+            double rgb[3] = { r, (y - kr * r - kb * b) / kg, b };
+            const uint8_t *p = out->data[0] + j * out->linesize[0] + i * bpp;
+            for (int k = 0; k < 3; k++) {
+                int d = abs(av_clip_uint8((int)lrint(rgb[k])) - p[k]);
+                max_diff = FFMAX(max_diff, d);
+            }
+            if (bpp == 4 && p[3] != 255) {
+                max_diff = 255;
+            }
+        }
+    }
+    return max_diff;
+}
+
+// 一种尺寸下所有格式、矩阵和范围的组合，返回失败数
+static int check_size(int width, int height, int nb_threads) {
+    int failures = 0;
+
+    for (size_t s = 0; s < FF_ARRAY_ELEMS(src_fmts); s++) {
+        for (size_t d = 0; d < FF_ARRAY_ELEMS(dst_fmts); d++) {
+            Image src, ref, out, sws_out;
+            if (image_alloc(&src, width, height, src_fmts[s]) < 0 ||
+                image_alloc(&ref, width, height, dst_fmts[d]) < 0 ||
+                image_alloc(&out, width, height, dst_fmts[d]) < 0 ||
+                image_alloc(&sws_out, width, height, dst_fmts[d]) < 0) {
+                fprintf(stderr, "Could not allocate images\n");
+                return 1;
+            }
+            fill_yuv(&src);
+
+            for (int matrix = YUV2RGB_BT601; matrix <= YUV2RGB_BT709; matrix++) {
+                for (int full_range = 0; full_range <= 1; full_range++) {
+                    Yuv2Rgb *scalar = yuv2rgb_create(1, YUV2RGB_ISA_SCALAR);
+                    convert(scalar, &src, &ref, matrix, full_range);
+                    yuv2rgb_free(&scalar);
+
+                    char name[64];
+                    snprintf(name, sizeof(name), "%dx%d %s->%s %s %s", width, height,
+                             av_get_pix_fmt_name(src_fmts[s]), av_get_pix_fmt_name(dst_fmts[d]),
+                             matrix == YUV2RGB_BT709 ? "bt709" : "bt601", full_range ? "full" : "limited");
+
+                    // 各指令集单线程和多线程都必须与标量实现逐位相同
+                    for (int isa = YUV2RGB_ISA_SSE2; isa < YUV2RGB_ISA_NB; isa++) {
+                        if (!yuv2rgb_isa_available(isa)) {
+                            continue;
+                        }
+                        for (int t = 1; t <= nb_threads; t += FFMAX(nb_threads - 1, 1)) {
+                            Yuv2Rgb *c = yuv2rgb_create(t, isa);
+                            int max_diff;
+                            double exact;
+                            convert(c, &src, &out, matrix, full_range);
+                            yuv2rgb_free(&c);
+                            if (compare(&ref, &out, &max_diff, &exact) > 0) {
+                                printf("FAIL %s: %s x%d 与标量实现不同, 最大差 %d\n",
+                                       name, yuv2rgb_isa_name(isa), t, max_diff);
+                                failures++;
+                            }
+                        }
+                    }
+
+                    int ref_diff = reference_diff(&src, &ref, matrix, full_range);
+                    if (ref_diff > REF_TOLERANCE) {
+                        printf("FAIL %s: 与双精度公式最大差 %d\n", name, ref_diff);
+                        failures++;
+                    }
+
+                    // 与swscale比较。奇数尺寸时swscale的色度缩放比不是正好1/2，最近邻的采样位置会漂移，不比较；
+                    // NV12没有同尺寸快速路径，用SWS_POINT让通用路径同样按最近邻上采样色度
+                    if ((width | height) & 1) {
+                        printf("ok   %s: 与双精度公式最大差 %d\n", name, ref_diff);
+                        continue;
+                    }
+                    struct SwsContext *sws = sws_open(&src, &sws_out, SWS_POINT, matrix, full_range);
+                    if (!sws) {
+                        printf("FAIL %s: 无法创建swscale上下文\n", name);
+                        failures++;
+                        continue;
+                    }
+                    sws_scale(sws, (const uint8_t *const *)src.data, src.linesize, 0, height,
+                              sws_out.data, sws_out.linesize);
+                    sws_freeContext(sws);
+
+                    int max_diff;
+                    double exact;
+                    compare(&ref, &sws_out, &max_diff, &exact);
+                    printf("%s %s: 与双精度公式最大差 %d, 与swscale最大差 %d, 相同 %.1f%%\n",
+                           max_diff > SWS_TOLERANCE ? "FAIL" : "ok  ", name, ref_diff, max_diff, exact);
+                    failures += max_diff > SWS_TOLERANCE;
+                }
+            }
+
+            image_free(&src);
+            image_free(&ref);
+            image_free(&out);
+            image_free(&sws_out);
+        }
+    }
+    return failures;
+}
+
+/** ! 速度 */
+
+static void bench_format(int width, int height, int frames, int nb_threads,
+                         enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt) {
+    Image src, dst;
+    double mpx = (double)width * height * frames / 1e6;
+
+    if (image_alloc(&src, width, height, src_fmt) < 0 || image_alloc(&dst, width, height, dst_fmt) < 0) {
+        fprintf(stderr, "Could not allocate images\n");
+        return;
+    }
+    fill_yuv(&src);
+    printf("%s -> %s\n", av_get_pix_fmt_name(src_fmt), av_get_pix_fmt_name(dst_fmt));
+
+    for (int isa = YUV2RGB_ISA_SCALAR; isa < YUV2RGB_ISA_NB; isa++) {
+        if (!yuv2rgb_isa_available(isa)) {
+            continue;
+        }
+        for (int t = 1; t <= nb_threads; t += FFMAX(nb_threads - 1, 1)) {
+            Yuv2Rgb *c = yuv2rgb_create(t, isa);
+            convert(c, &src, &dst, YUV2RGB_BT601, 0);
+            int64_t t0 = av_gettime_relative();
+            for (int i = 0; i < frames; i++) {
+                convert(c, &src, &dst, YUV2RGB_BT601, 0);
+            }
+            double sec = (av_gettime_relative() - t0) / 1000000.0;
+            yuv2rgb_free(&c);
+            printf("  yuv2rgb %-6s x%-2d %8.1f Mpx/s  %6.3f ms/帧\n",
+                   yuv2rgb_isa_name(isa), t, mpx / sec, sec * 1000.0 / frames);
+        }
+    }
+
+    struct SwsContext *sws = sws_open(&src, &dst, SWS_BILINEAR, YUV2RGB_BT601, 0);
+    if (sws) {
+        sws_scale(sws, (const uint8_t *const *)src.data, src.linesize, 0, height, dst.data, dst.linesize);
+        int64_t t0 = av_gettime_relative();
+        for (int i = 0; i < frames; i++) {
+            sws_scale(sws, (const uint8_t *const *)src.data, src.linesize, 0, height, dst.data, dst.linesize);
+        }
+        double sec = (av_gettime_relative() - t0) / 1000000.0;
+        sws_freeContext(sws);
+        printf("  swscale        x1  %8.1f Mpx/s  %6.3f ms/帧\n", mpx / sec, sec * 1000.0 / frames);
+    }
+
+    image_free(&src);
+    image_free(&dst);
+}
+
+static void usage(const char *prog) {
+    printf("用法: %s [宽x高] [选项]\n", prog);
+    printf("  --frames N   每种组合转换的帧数，默认%d\n", DEFAULT_FRAMES);
+    printf("  --threads N  多线程测试的线程数，默认按CPU核数\n");
+    printf("  --check      检查各实现与标量实现、swscale的差异，不测速度\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
+    int frames = DEFAULT_FRAMES;
+    int nb_threads = FFMIN(av_cpu_count(), 8);
+    int check = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            nb_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--check")) {
+            check = 1;
+        } else if (sscanf(argv[i], "%dx%d", &width, &height) != 2) {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (width < 1 || height < 1 || frames < 1 || nb_threads < 1) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (check) {
+        // 奇数尺寸覆盖SIMD循环之后的标量尾部和最后半个色度行
+        int failures = check_size(width, height, nb_threads);
+        failures += check_size(width | 1, height | 1, nb_threads);
+        failures += check_size(37, 19, nb_threads);
+        printf("%s: %d 个失败\n", failures ? "FAIL" : "PASS", failures);
+        return failures ? 1 : 0;
+    }
+
+    printf("%dx%d, %d 帧, BT.601有限范围\n", width, height, frames);
+    for (size_t s = 0; s < FF_ARRAY_ELEMS(src_fmts); s++) {
+        for (size_t d = 0; d < FF_ARRAY_ELEMS(dst_fmts); d++) {
+            bench_format(width, height, frames, nb_threads, src_fmts[s], dst_fmts[d]);
+        }
+    }
+    return 0;
+}
@@ -4,8 +4,11 @@
 echo "=== 编译ffmpeg_demo01 ==="
 
 # 方法1: 直接指定所有库，确保正确的链接顺序
-gcc -o ffmpeg_demo01 ffmpeg_demo01.c \
-    -lavformat -lavcodec -lswscale -lavutil -lswresample -lz -lm  `sdl2-config --cflags --libs`
+gcc -o ffmpeg_demo01 ffmpeg_demo01.c ../libplayer/audio_output.c ../libplayer/frame_writer.c \
+    ../libplayer/packet_queue.c ../libplayer/pcm_ring.c ../libplayer/stage_stats.c ../libplayer/sync_clock.c \
+    ../libplayer/yuv2rgb.c \
+    -I../libplayer \
+    -lavformat -lavfilter -lavcodec -lswscale -lavutil -lswresample -lz -lm -lpthread `sdl2-config --cflags --libs`
 
 
 # 如果编译成功，显示测试命令
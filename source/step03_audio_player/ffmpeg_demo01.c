@@ -6,30 +6,17 @@
 #include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_thread.h>
+#include "audio_output.h"
+#include "frame_writer.h"
+#include "packet_queue.h"
+#include "yuv2rgb.h"
 
-// 音频回调结构体
-typedef struct AudioState {
-    AVFormatContext *format_ctx;
-    AVCodecContext *audio_ctx;
-    SwrContext *swr_ctx;        // 重采样上下文
-    uint8_t *audio_buf;         // 音频缓冲区
-    unsigned int audio_buf_size; // 缓冲区大小
-    unsigned int audio_buf_index;// 当前播放位置
-    AVFrame *audio_frame;       // 音频帧
-    AVPacket audio_pkt;         // 音频包
-    SDL_AudioSpec wanted_spec;  // SDL音频参数
-    int audio_stream_idx;       // 添加音频流索引
-} AudioState;
-
-// 声明函数
-void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame, const char *outdir);
-int init_audio(AudioState *audio);
-void audio_callback(void *userdata, Uint8 *stream, int len);
-int audio_decode_frame(AudioState *audio);
+#define SAVE_FRAMES 6               // 保存前几帧为PPM
 
 int main(int argc, char *argv[])
 {
@@ -40,13 +27,19 @@ int main(int argc, char *argv[])
     printf("FFmpeg版本: %s\n", av_version_info());
 
     // 检查命令行参数
-    if (argc != 3) {
-        printf("用法: %s <视频文件路径> <输出文件夹>\n", argv[0]);
+    if (argc != 3 && argc != 4) {
+        printf("用法: %s <视频文件路径> <输出文件夹> [音频设备缓冲采样数]\n", argv[0]);
         return -1;
     }
 
     const char *input_file = argv[1];
     const char *output_dir = argv[2];
+    // 设备缓冲越小延迟越低，回调越频繁
+    int audio_samples = argc == 4 ? atoi(argv[3]) : AUDIO_OUTPUT_SAMPLES;
+    if (audio_samples < AUDIO_OUTPUT_SAMPLES_MIN || audio_samples > AUDIO_OUTPUT_SAMPLES_MAX) {
+        printf("音频设备缓冲应在%d~%d个采样之间\n", AUDIO_OUTPUT_SAMPLES_MIN, AUDIO_OUTPUT_SAMPLES_MAX);
+        return -1;
+    }
 
     // 检查输出目录
     struct stat st = {0};
@@ -158,45 +151,18 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    // 创建音频状态结构体
-    AudioState *audio_state = (AudioState *)malloc(sizeof(AudioState));
-    if (!audio_state) {
-        printf("无法分配音频状态内存\n");
-        return -1;
-    }
-
-    // 初始化音频状态
-    memset(audio_state, 0, sizeof(AudioState));
-    audio_state->format_ctx = pFormatCtx;
-    audio_state->audio_ctx = aCodecCtx;
-    audio_state->audio_stream_idx = audioStream;
-    audio_state->audio_frame = av_frame_alloc();
-
-    // 初始化重采样上下文
-    audio_state->swr_ctx = swr_alloc();
-    if (!audio_state->swr_ctx) {
-        printf("无法创建重采样上下文\n");
-        return -1;
-    }
-
-    // 设置重采样参数
-    av_opt_set_int(audio_state->swr_ctx, "in_channel_layout", aCodecCtx->channel_layout, 0);
-    av_opt_set_int(audio_state->swr_ctx, "out_channel_layout", aCodecCtx->channel_layout, 0);
-    av_opt_set_int(audio_state->swr_ctx, "in_sample_rate", aCodecCtx->sample_rate, 0);
-    av_opt_set_int(audio_state->swr_ctx, "out_sample_rate", aCodecCtx->sample_rate, 0);
-    av_opt_set_sample_fmt(audio_state->swr_ctx, "in_sample_fmt", aCodecCtx->sample_fmt, 0);
-    av_opt_set_sample_fmt(audio_state->swr_ctx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-
-    if (swr_init(audio_state->swr_ctx) < 0) {
-        printf("无法初始化重采样上下文\n");
+    // 音频包队列，主循环放入，音频线程取出解码
+    PacketQueue audioq;
+    if (packet_queue_init(&audioq) < 0) {
+        printf("无法创建音频包队列\n");
         return -1;
     }
 
-    // 分配音频缓冲区
-    audio_state->audio_buf = (uint8_t *)av_malloc(192000); // 足够大的缓冲区
-
-    // 初始化音频
-    if(init_audio(audio_state) < 0){
+    // 打开音频设备，重采样和PCM环形缓冲区按设备实际参数配置
+    AudioOutput audio;
+    if (audio_output_open(&audio, aCodecCtx, pFormatCtx->streams[audioStream], &audioq, NULL,
+                          audio_samples) < 0 ||
+        audio_output_start(&audio) < 0) {
         printf("初始化音频失败\n");
         return -1;
     }
@@ -226,6 +192,13 @@ int main(int argc, char *argv[])
     numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height, 1);
     buffer = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
 
+    // 前几帧交给写线程保存为PPM
+    FrameWriter *writer = frame_writer_create(output_dir, FRAME_FORMAT_PPM, 1, 2);
+    if (!writer) {
+        printf("无法创建写线程\n");
+        return -1;
+    }
+
     // 帧和内存组合
     av_image_fill_arrays(pFrameRGB->data, pFrameRGB->linesize, buffer, AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height, 1);
 
@@ -277,6 +250,12 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    // YUV420P/NV12用同尺寸的SIMD转换，其余格式用swscale
+    Yuv2Rgb *yuv2rgb = NULL;
+    if (yuv2rgb_supported(pCodecCtx->pix_fmt, AV_PIX_FMT_RGB24)) {
+        yuv2rgb = yuv2rgb_create(1, YUV2RGB_ISA_AUTO);
+    }
+
     // 创建转换上下文
     struct SwsContext *sws_ctx = sws_getContext(
         pCodecCtx->width, pCodecCtx->height, pCodecCtx->pix_fmt,
@@ -308,6 +287,14 @@ int main(int argc, char *argv[])
             }
         }
 
+        // 音频包交给音频线程解码
+        if(packet.stream_index == audioStream){
+            if (packet_queue_put(&audioq, &packet) < 0) {
+                av_packet_unref(&packet);
+            }
+            continue;
+        }
+
         // 是视频流
         if(packet.stream_index == videoStream){
             // 解码视频帧
@@ -326,8 +313,13 @@ int main(int argc, char *argv[])
             }
 
             // 转换像素格式
-            sws_scale(sws_ctx, (const uint8_t * const*)pFrame->data, pFrame->linesize, 0,
-                      pCodecCtx->height, pFrameRGB->data, pFrameRGB->linesize);
+            if (yuv2rgb && pFrame->format == pCodecCtx->pix_fmt &&
+                pFrame->width == pCodecCtx->width && pFrame->height == pCodecCtx->height) {
+                yuv2rgb_frame(yuv2rgb, pFrame, pFrameRGB->data, pFrameRGB->linesize, AV_PIX_FMT_RGB24);
+            } else {
+                sws_scale(sws_ctx, (const uint8_t * const*)pFrame->data, pFrame->linesize, 0,
+                          pCodecCtx->height, pFrameRGB->data, pFrameRGB->linesize);
+            }
 
             // 更新纹理
             SDL_UpdateTexture(texture, NULL, pFrameRGB->data[0], pFrameRGB->linesize[0]);
@@ -335,9 +327,15 @@ int main(int argc, char *argv[])
             SDL_RenderCopy(renderer, texture, NULL, &rect);
             SDL_RenderPresent(renderer);
 
-            // 保存帧
-            if(i++ <= 5) {
-                SaveFrame(pFrameRGB, pCodecCtx->width, pCodecCtx->height, i, output_dir);
+            // 保存帧，写盘在写线程上进行
+            if(i < SAVE_FRAMES) {
+                WriteJob *job = frame_writer_acquire(writer, pCodecCtx->width, pCodecCtx->height);
+                if (job) {
+                    av_image_copy(job->data, job->linesize,
+                                  (const uint8_t **)pFrameRGB->data, pFrameRGB->linesize,
+                                  AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
+                    frame_writer_submit(writer, job, ++i);
+                }
             }
 
             // 控制帧率
@@ -348,8 +346,18 @@ int main(int argc, char *argv[])
         av_packet_unref(&packet);
     }
 
+    // 停止音频线程，关闭设备后回调不再访问环形缓冲区
+    audio_output_set_eof(&audio, 1);
+    printf("音频欠载次数: %d\n", atomic_load(&audio.underruns));
+    audio_output_close(&audio);
+    packet_queue_destroy(&audioq);
+
+    // 等待保存的帧写完
+    frame_writer_close(writer, NULL, NULL);
+
     // 释放 SDL 资源
     sws_freeContext(sws_ctx);
+    yuv2rgb_free(&yuv2rgb);
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -365,20 +373,6 @@ int main(int argc, char *argv[])
     avcodec_free_context(&pCodecCtx);
     avcodec_free_context(&aCodecCtx);
 
-    // 清理音频资源
-    if (audio_state) {
-        if (audio_state->audio_frame) {
-            av_frame_free(&audio_state->audio_frame);
-        }
-        if (audio_state->swr_ctx) {
-            swr_free(&audio_state->swr_ctx);
-        }
-        if (audio_state->audio_buf) {
-            av_free(audio_state->audio_buf);
-        }
-        free(audio_state);
-    }
-
     // 关闭文件
     avformat_close_input(&pFormatCtx);
 
@@ -387,172 +381,3 @@ int main(int argc, char *argv[])
 
     return 0;
 }
-
-// 把RGB信息定稿到PPM格式的文件
-void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame, const char *outdir)
-{
-    FILE *pFile;
-    char szFilename[512];  // 增加缓冲区大小以适应路径
-    int  y;
-
-    // 构建完整的文件路径
-    #ifdef _WIN32
-        snprintf(szFilename, sizeof(szFilename), "%s\\frame%d.ppm", outdir, iFrame);
-    #else
-        snprintf(szFilename, sizeof(szFilename), "%s/frame%d.ppm", outdir, iFrame);
-    #endif
-
-    pFile = fopen(szFilename, "wb");
-    if(pFile == NULL) {
-        printf("错误：无法创建文件 '%s'\n", szFilename);
-        return;
-    }
-
-    // Write header
-    fprintf(pFile, "P6\n%d %d\n255\n", width, height);
-
-    // 一次向文件写入一行数据
-    // PPM格式：包含一长串RGB数据的文件
-    for(y=0; y<height; y++)
-        fwrite(pFrame->data[0]+y*pFrame->linesize[0], 1, width*3, pFile);
-
-    // Close file
-    fclose(pFile);
-    printf("已保存帧 %d 到 %s\n", iFrame, szFilename);
-}
-// 初始化音频
-int init_audio(AudioState *audio) {
-    // 设置音频参数
-    audio->wanted_spec.freq = audio->audio_ctx->sample_rate;
-    audio->wanted_spec.format = AUDIO_S16SYS;
-    audio->wanted_spec.channels = audio->audio_ctx->channels;
-    audio->wanted_spec.silence = 0;
-    audio->wanted_spec.samples = 1024;
-    audio->wanted_spec.callback = audio_callback;
-    audio->wanted_spec.userdata = audio;
-
-    // 打开音频设备
-    SDL_AudioSpec obtained_spec;
-    int audio_device_id = SDL_OpenAudioDevice(NULL, 0, &audio->wanted_spec, &obtained_spec, 0);
-    if (audio_device_id <= 0) {
-        fprintf(stderr, "SDL_OpenAudioDevice: %s\n", SDL_GetError());
-        return -1;
-    }
-
-    // 开始播放音频
-    SDL_PauseAudioDevice(audio_device_id, 0);
-
-    // 初始化音频缓冲区索引
-    audio->audio_buf_index = 0;
-    audio->audio_buf_size = 0;
-
-    // 初始化音频包
-    av_init_packet(&audio->audio_pkt);
-
-    return 0;
-}
-// 音频回调函数
-void audio_callback(void *userdata, Uint8 *stream, int len) {
-    AudioState *audio = (AudioState *)userdata;
-    int len1, audio_size;
-
-    // 首先清空流
-    memset(stream, 0, len);
-
-    while (len > 0) {
-        if (audio->audio_buf_index >= audio->audio_buf_size) {
-            // 需要更多数据
-            audio_size = audio_decode_frame(audio);
-            if (audio_size < 0) {
-                // 错误处理，这里填充静音
-                audio->audio_buf_size = 0;
-                break;
-            }
-            audio->audio_buf_index = 0;
-        }
-        len1 = audio->audio_buf_size - audio->audio_buf_index;
-        if (len1 > len)
-            len1 = len;
-
-        // 混合音频数据到输出流（而不是直接覆盖）
-        SDL_MixAudioFormat(stream, audio->audio_buf + audio->audio_buf_index, AUDIO_S16SYS, len1, SDL_MIX_MAXVOLUME);
-
-        len -= len1;
-        stream += len1;
-        audio->audio_buf_index += len1;
-    }
-}
-// 解码音频
-int audio_decode_frame(AudioState *audio) {
-    int data_size = 0;
-    int ret = 0;
-
-    while (1) {
-        // 如果没有包，读取新的音频包
-        if (audio->audio_pkt.size <= 0) {
-            ret = av_read_frame(audio->format_ctx, &audio->audio_pkt);
-            if (ret < 0) {
-                // 文件结尾或错误
-                return -1;
-            }
-
-            // 确保是音频包
-            if (audio->audio_pkt.stream_index != audio->audio_stream_idx) {
-                av_packet_unref(&audio->audio_pkt);
-                continue;
-            }
-        }
-
-        // 发送包到解码器
-        ret = avcodec_send_packet(audio->audio_ctx, &audio->audio_pkt);
-        if (ret < 0) {
-            if (ret == AVERROR(EAGAIN)) {
-                // 解码器需要更多数据
-                continue;
-            }
-            av_packet_unref(&audio->audio_pkt);
-            return -1;
-        }
-
-        // 包已经被解码器接收，可以释放了
-        av_packet_unref(&audio->audio_pkt);
-        audio->audio_pkt.size = 0;
-
-        // 接收解码后的帧
-        ret = avcodec_receive_frame(audio->audio_ctx, audio->audio_frame);
-        if (ret < 0) {
-            if (ret == AVERROR(EAGAIN)) {
-                // 需要更多数据
-                continue;
-            }
-            return -1;
-        }
-
-        // 成功获取到帧，进行重采样
-        // 计算输出样本数
-        int out_samples = av_rescale_rnd(
-            swr_get_delay(audio->swr_ctx, audio->audio_ctx->sample_rate) + audio->audio_frame->nb_samples,
-            audio->wanted_spec.freq,
-            audio->audio_ctx->sample_rate,
-            AV_ROUND_UP);
-
-        // 重采样转换
-        uint8_t **out_buffer = &audio->audio_buf;
-        ret = swr_convert(audio->swr_ctx,
-            out_buffer,
-            out_samples,
-            (const uint8_t **)audio->audio_frame->data,
-            audio->audio_frame->nb_samples);
-
-        if (ret < 0) {
-            fprintf(stderr, "Error while converting\n");
-            return -1;
-        }
-
-        // 计算实际数据大小
-        data_size = ret * audio->wanted_spec.channels * 2; // 2 for 16 bit samples
-        audio->audio_buf_size = data_size;
-
-        return data_size;
-    }
-}
@@ -4,12 +4,14 @@
 echo "=== 编译ffmpeg_demo01 ==="
 
 # 方法1: 直接指定所有库，确保正确的链接顺序
-gcc -o ffmpeg_demo01 ffmpeg_demo01.c \
-    -lavformat -lavcodec -lswscale -lavutil -lswresample -lz -lm \
+gcc -o ffmpeg_demo01 ffmpeg_demo01.c ../libplayer/player.c ../libplayer/audio_output.c ../libplayer/frame_pool.c \
+    ../libplayer/keyframe_index.c ../libplayer/packet_queue.c ../libplayer/pcm_ring.c \
+    ../libplayer/read_ahead.c ../libplayer/stage_stats.c ../libplayer/sync_clock.c \
+    -lavformat -lavfilter -lavcodec -lswscale -lavutil -lswresample -lz -lm -ldl \
     -lSDL2 -lSDL2main \
-    -I/usr/include/SDL2 \
+    -I/usr/include/SDL2 -I../libplayer \
     -D_REENTRANT \
-    -Wall -g
+    -Wall -O2 -g
 
 
 # 如果编译成功，显示测试命令
@@ -18,3 +20,17 @@ if [ $? -eq 0 ]; then
     echo "使用以下命令测试:"
     echo "./ffmpeg_demo01 ../../input/test_176x144.264 ../../output"
 fi
+
+# 编译包队列微基准
+echo "=== 编译packet_queue_bench ==="
+gcc -O2 -o packet_queue_bench packet_queue_bench.c ../libplayer/packet_queue.c \
+    -lavcodec -lavutil -lm \
+    -lSDL2 \
+    -I/usr/include/SDL2 -I../libplayer \
+    -D_REENTRANT \
+    -Wall
+
+if [ $? -eq 0 ]; then
+    echo "=== 编译成功! ==="
+    echo "./packet_queue_bench [包数量]"
+fi
@@ -1,947 +1,630 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
-#include <libavutil/imgutils.h>
-#include <libavutil/opt.h>
-#include <libswscale/swscale.h>
-#include <libswresample/swresample.h>
+#include <libavutil/time.h>
+#include <math.h>
 #include <stdio.h>
-#include <sys/stat.h>
+#include <stdlib.h>
 #include <string.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_thread.h>
-#include <SDL2/SDL_audio.h>
 #include <SDL2/SDL_video.h>
+#include "audio_output.h"
+#include "player.h"
+#include "sync_clock.h"
 
 // 定义常量
-#define VIDEO_PICTURE_QUEUE_SIZE 10
-#define MAX_AUDIOQ_SIZE (5 * 16 * 1024)
-#define MAX_VIDEOQ_SIZE (5 * 256 * 1024)
-#define PIX_FMT_YUV420P AV_PIX_FMT_YUV420P
+#define SEEK_SHORT_STEP 10.0                  // 左右方向键seek的步长(秒)
+#define SEEK_LONG_STEP 60.0                   // 上下方向键seek的步长(秒)
+#define PRECISE_SLEEP_SPIN 0.0002             // 精确睡眠最后自旋等待的时间(秒)
+#define PRECISE_SLEEP_MARGIN 0.001            // 离帧的显示时间不到这么久时才精确睡眠(秒)
+#define AUTOEXIT_CHECK_INTERVAL 0.1           // --autoexit时没有排定的帧期间检查播放结束的间隔(秒)
+#define DEFAULT_REFRESH_RATE 60               // 取不到显示器刷新率时假设的值(Hz)
+#define PRESENT_JITTER_MAX_GAP 0.5            // 相邻两次显示的pts差超过此值(seek/暂停)时不统计抖动
+
+// [和]键依次切换的播放速度
+static const double speed_steps[] = { 0.25, 0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 4.0 };
 
 // 自定义事件类型
-#define FF_REFRESH_EVENT (SDL_USEREVENT + 1)
 #define FF_QUIT_EVENT (SDL_USEREVENT + 2)
-#define FF_ALLOC_EVENT (SDL_USEREVENT + 3)
-
-// 前向声明
-typedef struct VideoState VideoState;
-
-// 图像队列结构体
-typedef struct VideoPicture {
-    SDL_Texture *texture;  // 替换SDL_Overlay为SDL_Texture
-    int width, height;
-    int allocated;
-} VideoPicture;
-
-// 包队列结构体
-typedef struct PacketQueue {
-    AVPacketList *first_pkt, *last_pkt;
-    int nb_packets;
-    int size;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
-    int quit;  // 添加quit字段
-} PacketQueue;
-
-// 音频回调结构体
-typedef struct AudioState {
-    AVFormatContext *format_ctx;
-    AVCodecContext *audio_ctx;
-    SwrContext *swr_ctx;        // 重采样上下文
-    uint8_t *audio_buf;         // 音频缓冲区
-    unsigned int audio_buf_size; // 缓冲区大小
-    unsigned int audio_buf_index;// 当前播放位置
-    AVFrame *audio_frame;       // 音频帧
-    AVPacket audio_pkt;         // 音频包
-    SDL_AudioSpec wanted_spec;  // SDL音频参数
-    int audio_stream_idx;       // 添加音频流索引
-} AudioState;
-
-// 视频结构体
-struct VideoState {
-    AVFormatContext *pFormatCtx;
-    int videoStream, audioStream;
-    AVStream *audio_st;
-    PacketQueue audioq;
-    uint8_t *buffer;
-    unsigned int audio_buf_size; // 缓冲区大小
-    unsigned int audio_buf_index;// 当前播放位置
-    AVPacket audio_pkt;
-    uint8_t *audio_pkt_data;
-    int audio_pkt_size;
-    AVStream *video_st;
-    PacketQueue videoq;
-    VideoPicture pictq[VIDEO_PICTURE_QUEUE_SIZE];
-    int pictq_size, pictq_rindex, pictq_windex;
-    SDL_mutex *pictq_mutex;
-    SDL_cond *pictq_cond;
-    SDL_Thread *parse_tid;
-    SDL_Thread *video_tid;
+#define FF_WAKE_EVENT (SDL_USEREVENT + 3)     // 图像队列有了新帧，渲染循环重新调用player_refresh
+
+// 视频结构体：窗口和显示状态，解复用/解码/同步都在libplayer里
+typedef struct VideoState {
+    Player *player;
     char filename[1024];
     int quit;
-    
+
+    // 插桩统计
+    double stats_interval;      // 周期打印的间隔(秒)，0表示不打印
+    double stats_next;          // 下一次打印的时间
+    const char *stats_json;     // 退出时写JSON的文件，NULL表示不写
+    int autoexit;               // 播放完自动退出(基准测试用)
+    int no_vsync;               // 不使用垂直同步，由精确睡眠控制显示时间
+    double speed;               // 启动时的播放速度(--speed)
+
     // SDL2相关
     SDL_Window *window;
     SDL_Renderer *renderer;
-    SDL_Texture *texture;
-    SDL_Rect screen_rect;
-    SDL_TimerID refresh_timer;
-};
+    SDL_Texture *texture;       // 唯一的视频纹理，只在渲染线程创建和更新
+    int texture_width, texture_height;
+    int window_width, window_height; // 渲染器输出的像素尺寸
+    SDL_Rect display_rect;      // 保持宽高比、居中的显示区域，窗口大小或帧格式变化时才重新计算
+    int rect_valid;
+    int rect_frame_width, rect_frame_height; // display_rect对应的帧尺寸和像素宽高比
+    AVRational rect_sar;
+    int vsync;                  // SDL_RenderPresent阻塞到垂直同步
+    double refresh_period;      // 显示器刷新间隔(秒)
+
+    // 显示抖动
+    double last_present;        // 上一次显示完成的时间
+    double last_present_pts;    // 上一次显示的帧的pts，NAN表示不统计下一次间隔
+} VideoState;
 
 // 函数前向声明
-static Uint32 sdl_refresh_timer_cb(Uint32 interval, void *opaque);
-static void schedule_refresh(VideoState *is, int delay);
-void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame, const char *outdir);
-int init_audio(AudioState *audio);
-void audio_callback(void *userdata, Uint8 *stream, int len);
-int audio_decode_frame(AudioState *audio);
-int decode_thread(void *arg);
-int video_thread(void *arg);
-static int queue_picture(VideoState *is, AVFrame *pFrame);
-void packet_queue_init(PacketQueue *q);
-int packet_queue_put(PacketQueue *q, AVPacket *pkt);
-int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block);
-static void alloc_picture(void *userdata);
-static void video_refresh_timer(void *userdata);
-void packet_queue_quit(PacketQueue *q);
-
-// 声明变量
-VideoState *global_video_state;
-SDL_Window *screen;
+static int display_frame(void *opaque, AVFrame *frame, double pts, double duration);
+static void wake_render_loop(void *opaque);
+static void handle_event(VideoState *is, SDL_Event *event);
+static void wait_until(VideoState *is, double deadline, int frame);
+static void window_size(VideoState *is, int *w, int *h);
+static void update_display_rect(VideoState *is, AVFrame *frame);
+static void video_display(VideoState *is);
 
 int main(int argc, char *argv[])
 {
     VideoState *is;
-    AVPacket packet;
-    
+    PlayerOptions opt;
+
     // 初始化FFmpeg
     av_register_all();
     avformat_network_init();
-    
+
     printf("FFmpeg initialized\n");
-    
+
     is = (VideoState *)av_mallocz(sizeof(VideoState));
     if (!is) {
         fprintf(stderr, "Could not allocate VideoState\n");
         return -1;
     }
-    
+
     // 安全处理命令行参数
-    if (argc < 2) {
+    const char *input = NULL;
+    player_default_options(&opt);
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--sync") && i + 1 < argc) {
+            const char *type = argv[++i];
+            if (!strcmp(type, "audio")) {
+                opt.sync_type = AV_SYNC_AUDIO_MASTER;
+            } else if (!strcmp(type, "video")) {
+                opt.sync_type = AV_SYNC_VIDEO_MASTER;
+            } else if (!strcmp(type, "ext")) {
+                opt.sync_type = AV_SYNC_EXTERNAL_CLOCK;
+            } else {
+                fprintf(stderr, "Unknown sync type %s (audio|video|ext)\n", type);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--decode-threads") && i + 1 < argc) {
+            const char *count = argv[++i];
+            opt.decode_threads = strcmp(count, "auto") ? atoi(count) : 0;
+            if (opt.decode_threads < 0) {
+                fprintf(stderr, "Invalid decode thread count %s\n", count);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--thread-type") && i + 1 < argc) {
+            const char *type = argv[++i];
+            if (!strcmp(type, "frame")) {
+                opt.thread_type = FF_THREAD_FRAME;
+            } else if (!strcmp(type, "slice")) {
+                opt.thread_type = FF_THREAD_SLICE;
+            } else if (!strcmp(type, "auto")) {
+                opt.thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            } else {
+                fprintf(stderr, "Unknown thread type %s (frame|slice|auto)\n", type);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--io") && i + 1 < argc) {
+            const char *mode = argv[++i];
+            opt.io_mode = read_ahead_parse_mode(mode);
+            if (opt.io_mode < 0) {
+                fprintf(stderr, "Unknown I/O mode %s (off|thread|mmap)\n", mode);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--io-buffer") && i + 1 < argc) {
+            const char *size = argv[++i];
+            if (atoi(size) < 1) {
+                fprintf(stderr, "Invalid read-ahead buffer size %s (MB)\n", size);
+                return -1;
+            }
+            opt.io_buffer_size = (size_t)atoi(size) * 1024 * 1024;
+        } else if (!strcmp(argv[i], "--fast-start")) {
+            opt.fast_start = 1;
+        } else if (!strcmp(argv[i], "--probesize") && i + 1 < argc) {
+            const char *size = argv[++i];
+            opt.probesize = strtoll(size, NULL, 10);
+            if (opt.probesize < 32) {
+                fprintf(stderr, "Invalid probe size %s (bytes, at least 32)\n", size);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--analyzeduration") && i + 1 < argc) {
+            const char *duration = argv[++i];
+            opt.analyzeduration = strtoll(duration, NULL, 10);
+            if (opt.analyzeduration < 1) {
+                fprintf(stderr, "Invalid analyze duration %s (microseconds)\n", duration);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+            const char *speed = argv[++i];
+            is->speed = atof(speed);
+            if (is->speed < PLAYER_SPEED_MIN || is->speed > PLAYER_SPEED_MAX) {
+                fprintf(stderr, "Invalid speed %s (%.2f-%.2f)\n", speed, PLAYER_SPEED_MIN, PLAYER_SPEED_MAX);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--audio-buffer") && i + 1 < argc) {
+            const char *samples = argv[++i];
+            opt.audio_samples = atoi(samples);
+            if (opt.audio_samples < AUDIO_OUTPUT_SAMPLES_MIN || opt.audio_samples > AUDIO_OUTPUT_SAMPLES_MAX) {
+                fprintf(stderr, "Invalid audio buffer size %s (%d-%d samples)\n", samples,
+                        AUDIO_OUTPUT_SAMPLES_MIN, AUDIO_OUTPUT_SAMPLES_MAX);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--stream")) {
+            opt.streaming = 1;
+        } else if (!strcmp(argv[i], "--mem-cap") && i + 1 < argc) {
+            const char *size = argv[++i];
+            if (atoi(size) < 4) {
+                fprintf(stderr, "Invalid memory cap %s (MB, at least 4)\n", size);
+                return -1;
+            }
+            opt.memory_cap = (size_t)atoi(size) * 1024 * 1024;
+        } else if (!strcmp(argv[i], "--downscale")) {
+            opt.downscale = 1;
+        } else if (!strcmp(argv[i], "--stats") && i + 1 < argc) {
+            is->stats_interval = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--stats-json") && i + 1 < argc) {
+            is->stats_json = argv[++i];
+        } else if (!strcmp(argv[i], "--no-framedrop")) {
+            opt.framedrop = 0;
+        } else if (!strcmp(argv[i], "--no-vsync")) {
+            is->no_vsync = 1;
+        } else if (!strcmp(argv[i], "--autoexit")) {
+            is->autoexit = 1;
+        } else if (!input) {
+            input = argv[i];
+        }
+    }
+    if (!input) {
         // 使用默认文件路径
         strncpy(is->filename, "input.mp4", sizeof(is->filename) - 1);
         fprintf(stderr, "No input file specified, using default: %s\n", is->filename);
     } else {
-        strncpy(is->filename, argv[1], sizeof(is->filename) - 1);
+        strncpy(is->filename, input, sizeof(is->filename) - 1);
     }
     is->filename[sizeof(is->filename) - 1] = '\0';
-
-    is->pictq_mutex = SDL_CreateMutex();
-    is->pictq_cond = SDL_CreateCond();
+    is->stats_next = clock_now() + is->stats_interval;
 
     // 初始化SDL2
-    if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER)) {
+    if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
         fprintf(stderr, "Could not initialize SDL - %s\n", SDL_GetError());
         return -1;
     }
 
-    // 创建窗口
+    // 先打开文件并启动解码线程，创建窗口和渲染器的同时第一帧已经在解码；
+    // 帧到显示时间时由display_frame上传并显示
+    opt.frame_cb = display_frame;
+    opt.wake_cb = wake_render_loop;
+    opt.opaque = is;
+    is->player = player_open(is->filename, &opt);
+    if (!is->player || player_start(is->player) < 0) {
+        fprintf(stderr, "Could not start player\n");
+        player_close(is->player);
+        return -1;
+    }
+    if (is->speed > 0) {
+        player_set_speed(is->player, is->speed);
+    }
+
+    // 创建窗口，大小按视频尺寸和像素宽高比，超出屏幕时等比缩小；可以调整大小
+    int window_w = 640, window_h = 480;
+    window_size(is, &window_w, &window_h);
     is->window = SDL_CreateWindow("FFmpeg Player",
                                 SDL_WINDOWPOS_UNDEFINED,
                                 SDL_WINDOWPOS_UNDEFINED,
-                                640, 480,
-                                SDL_WINDOW_SHOWN);
+                                window_w, window_h,
+                                SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
     if(!is->window) {
         fprintf(stderr, "SDL: could not create window - exiting\n");
+        player_close(is->player);
         return -1;
     }
 
-    // 创建渲染器
-    is->renderer = SDL_CreateRenderer(is->window, -1, SDL_RENDERER_ACCELERATED);
+    // 渲染器缩放纹理时用线性插值
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+
+    // 创建渲染器，优先使用垂直同步；不支持时退回普通渲染器
+    if (!is->no_vsync) {
+        is->renderer = SDL_CreateRenderer(is->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    }
+    if(!is->renderer) {
+        is->renderer = SDL_CreateRenderer(is->window, -1, 0);
+    }
     if(!is->renderer) {
         fprintf(stderr, "SDL: could not create renderer - exiting\n");
+        player_close(is->player);
         return -1;
     }
 
+    // dummy/offscreen驱动和软件渲染器上没有真正的垂直同步，改用精确睡眠
+    SDL_RendererInfo info;
+    SDL_DisplayMode mode;
+    const char *driver = SDL_GetCurrentVideoDriver();
+    SDL_GetRendererInfo(is->renderer, &info);
+    is->vsync = (info.flags & SDL_RENDERER_PRESENTVSYNC) && !(info.flags & SDL_RENDERER_SOFTWARE) &&
+                driver && strcmp(driver, "dummy") && strcmp(driver, "offscreen");
+    is->refresh_period = 1.0 / DEFAULT_REFRESH_RATE;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(is->window), &mode) == 0 && mode.refresh_rate > 0) {
+        is->refresh_period = 1.0 / mode.refresh_rate;
+    }
+    fprintf(stderr, "renderer: %s on %s, %s, refresh %.2f Hz\n", info.name, driver ? driver : "?",
+            is->vsync ? "vsync" : "precise sleep", 1.0 / is->refresh_period);
+    is->last_present_pts = NAN;
+
     // 设置渲染器背景色(黑色)
     SDL_SetRenderDrawColor(is->renderer, 0, 0, 0, 255);
     SDL_RenderClear(is->renderer);
     SDL_RenderPresent(is->renderer);
 
-    // 获取窗口尺寸
-    SDL_GetWindowSize(is->window, &is->screen_rect.w, &is->screen_rect.h);
-    
-    // 初始化队列
-    packet_queue_init(&is->videoq);
-    packet_queue_init(&is->audioq);
-    
-    is->videoStream = -1;
-    is->audioStream = -1;
-    is->pictq_size = 0;
-    is->pictq_rindex = 0;
-    is->pictq_windex = 0;
-    is->quit = 0; // 确保初始化为0
-    
-    global_video_state = is;
-    
-    // 设置第一次刷新
-    schedule_refresh(is, 40);
-    
-    is->parse_tid = SDL_CreateThread(decode_thread, "decode_thread", is);
-    if (!is->parse_tid) {
-        fprintf(stderr, "Could not create decode thread\n");
-        av_free(is);
-        return -1;
-    }
-  
-    // 等待解码线程完成初始化
-    while (!is->pFormatCtx && !is->quit) {
-        SDL_Delay(10);
-    }
-    
-    if (is->quit) {
-        fprintf(stderr, "Decode thread failed to initialize\n");
-        return -1;
-    }
-    
-    // 添加事件处理循环
+    // 获取渲染器输出尺寸，显示区域在第一帧到来时计算
+    SDL_GetRendererOutputSize(is->renderer, &is->window_width, &is->window_height);
+
+    // 垂直同步时SDL_RenderPresent平均要等半个刷新间隔，提前这么多把帧交给显示
+    player_set_present_lead(is->player, is->vsync ? is->refresh_period / 2 : 0);
+
+    // 渲染循环：没有定时器，按player_refresh给出的下一帧时间等待，期间处理输入事件。
+    // 没有排定的帧(队列空、暂停)时deadline为INFINITY，新帧入队时FF_WAKE_EVENT唤醒
+    double deadline = clock_now();
     while (!is->quit) {
         SDL_Event event;
-        
-        // 使用超时来避免无限等待
-        if (SDL_WaitEventTimeout(&event, 100)) {
-            switch (event.type) {
-                case FF_REFRESH_EVENT:
-                    video_refresh_timer(event.user.data1);
-                    break;
-                case SDL_KEYDOWN:
-                    if (event.key.keysym.sym == SDLK_ESCAPE || 
-                        event.key.keysym.sym == SDLK_q) {
-                        is->quit = 1;
-                    }
-                    break;
-                case SDL_QUIT:
-                    is->quit = 1;
-                    break;
-                case FF_QUIT_EVENT:
-                    is->quit = 1;
-                    break;
-                case FF_ALLOC_EVENT:
-                    alloc_picture(event.user.data1);
-                    break;
-                default:
-                    break;
-            }
+
+        // 暂停、seek、新帧入队之后立即重新计算下一帧的时间
+        while (SDL_PollEvent(&event)) {
+            handle_event(is, &event);
+            deadline = clock_now();
         }
-        
+
+        // 显示到期的帧，得到下一帧的时间
+        if (!is->quit && clock_now() >= deadline) {
+            deadline = clock_now() + player_refresh(is->player);
+        }
+
+        // 读到结尾且所有队列都已播放完
+        if (is->autoexit && player_finished(is->player)) {
+            is->quit = 1;
+        }
+
+        // 周期打印各阶段统计
+        if (is->stats_interval > 0 && clock_now() >= is->stats_next) {
+            player_print_stats(is->player, stderr);
+            is->stats_next = clock_now() + is->stats_interval;
+        }
+
         // 添加手动检查退出条件
-        if (SDL_GetKeyboardState(NULL)[SDL_SCANCODE_ESCAPE] || 
+        if (SDL_GetKeyboardState(NULL)[SDL_SCANCODE_ESCAPE] ||
             SDL_GetKeyboardState(NULL)[SDL_SCANCODE_Q]) {
             fprintf(stderr, "Quit requested via keyboard check\n");
             is->quit = 1;
         }
-    }  
-    
-    fprintf(stderr, "Exiting event loop, cleaning up...\n");
-    
-    // 设置队列退出标志
-    packet_queue_quit(&is->audioq);
-    packet_queue_quit(&is->videoq);
-    
-    // 通过SDL事件机制通知子线程退出
-    SDL_Event event;
-    event.type = FF_QUIT_EVENT;
-    event.user.data1 = is;
-    SDL_PushEvent(&event);
-    
-    // 清理资源
-    if (is->parse_tid) {
-        SDL_WaitThread(is->parse_tid, NULL);
-    }
-    
-    if (is->video_tid) {
-        SDL_WaitThread(is->video_tid, NULL);
-    }
-    
-    // 销毁队列
-    if (is->pictq_mutex) {
-        SDL_DestroyMutex(is->pictq_mutex);
-    }
-    
-    if (is->pictq_cond) {
-        SDL_DestroyCond(is->pictq_cond);
-    }
-    
-    // 销毁视频资源
-    for (int i = 0; i < VIDEO_PICTURE_QUEUE_SIZE; i++) {
-        if (is->pictq[i].texture) {
-            SDL_DestroyTexture(is->pictq[i].texture);
+
+        // 周期统计和--autoexit的结束检查也要按时醒来，但不需要精确到帧
+        double wake = deadline;
+        if (is->stats_interval > 0) {
+            wake = FFMIN(wake, is->stats_next);
         }
+        if (is->autoexit && isinf(deadline) && !player_is_paused(is->player)) {
+            wake = FFMIN(wake, clock_now() + AUTOEXIT_CHECK_INTERVAL);
+        }
+        if (!is->quit) {
+            wait_until(is, wake, wake == deadline);
+        }
+    }
+
+    fprintf(stderr, "Exiting event loop, cleaning up...\n");
+
+    // 停止解码线程并关闭音频设备
+    player_stop(is->player);
+
+    if (is->texture) {
+        SDL_DestroyTexture(is->texture);
     }
-    
+
     // 销毁SDL资源
     if (is->renderer) {
         SDL_DestroyRenderer(is->renderer);
     }
-    
+
     if (is->window) {
         SDL_DestroyWindow(is->window);
     }
-    
+
     SDL_Quit();
-    
-    // 释放VideoState
-    if (is) {
-        if (is->pFormatCtx) {
-            avformat_close_input(&is->pFormatCtx);
-        }
-        av_free(is);
-    }
-    
-    return 0;
-}
 
-// 解码线程函数
-int decode_thread(void *arg) {
-    VideoState *is = (VideoState *)arg;
-    
-    // 打开输入文件
-    if(avformat_open_input(&is->pFormatCtx, is->filename, NULL, NULL) != 0) {
-        fprintf(stderr, "Could not open file %s\n", is->filename);
-        is->quit = 1;
-        return -1;
-    }
-    
-    // 获取流信息
-    if(avformat_find_stream_info(is->pFormatCtx, NULL) < 0) {
-        fprintf(stderr, "Could not find stream information\n");
-        is->quit = 1;
-        return -1;
+    player_print_summary(is->player, stderr);
+    stage_hist_print(player_stage(is->player, PLAYER_STAGE_PRESENT_JITTER), stderr);
+    if (is->stats_interval > 0) {
+        player_print_stats(is->player, stderr);
     }
-    
-    // 输出视频信息
-    av_dump_format(is->pFormatCtx, 0, is->filename, 0);
-    
-    // 初始化视频和音频流索引
-    is->videoStream = -1;
-    is->audioStream = -1;
-    
-    // 查找视频流和音频流
-    for(unsigned int i = 0; i < is->pFormatCtx->nb_streams; i++) {
-        if(is->pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && 
-           is->videoStream < 0) {
-            is->videoStream = i;
-        }
-        if(is->pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && 
-           is->audioStream < 0) {
-            is->audioStream = i;
-        }
-    }
-    
-    // 打开视频流
-    if(is->videoStream >= 0) {
-        if (stream_component_open(is, is->videoStream) < 0) {
-            fprintf(stderr, "Could not open video stream\n");
-            is->videoStream = -1;
-        } else {
-            // 创建视频线程
-            is->video_tid = SDL_CreateThread(video_thread, "video_thread", is);
-            if (!is->video_tid) {
-                fprintf(stderr, "Could not create video thread\n");
-                is->quit = 1;
-                return -1;
-            }
-        }
-    }
-    
-    // 打开音频流
-    if(is->audioStream >= 0) {
-        if (stream_component_open(is, is->audioStream) < 0) {
-            fprintf(stderr, "Could not open audio stream\n");
-            is->audioStream = -1;
-        }
-    }
-    
-    if(is->videoStream < 0 && is->audioStream < 0) {
-        fprintf(stderr, "Could not open any streams\n");
-        is->quit = 1;
-        return -1;
-    }
-    
-    // 开始读取包
-    AVPacket packet;
-    while(!is->quit) {
-        if(is->audioq.size > MAX_AUDIOQ_SIZE || is->videoq.size > MAX_VIDEOQ_SIZE) {
-            SDL_Delay(10);
-            continue;
-        }
-        
-        if(av_read_frame(is->pFormatCtx, &packet) < 0) {
-            if(avio_feof(is->pFormatCtx->pb) == 0) {
-                SDL_Delay(100);
-                continue;
-            } else {
-                break;
-            }
-        }
-        
-        // 分发包到相应队列
-        if(packet.stream_index == is->videoStream) {
-            packet_queue_put(&is->videoq, &packet);
-        } else if(packet.stream_index == is->audioStream) {
-            packet_queue_put(&is->audioq, &packet);
-        } else {
-            av_packet_unref(&packet);
-        }
+    if (is->stats_json) {
+        player_write_stats_json(is->player, is->stats_json);
     }
-    
-    return 0;
-}
 
-// 包队列初始化
-void packet_queue_init(PacketQueue *q) {
-    memset(q, 0, sizeof(PacketQueue));
-    q->mutex = SDL_CreateMutex();
-    q->cond = SDL_CreateCond();
-    q->quit = 0; // 初始化为0
-}
+    // 释放VideoState
+    player_close(is->player);
+    av_free(is);
 
-// 包队列放入
-int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
-    AVPacketList *pkt_list;
-    
-    pkt_list = av_malloc(sizeof(AVPacketList));
-    if(!pkt_list)
-        return -1;
-    pkt_list->pkt = *pkt;
-    pkt_list->next = NULL;
-    
-    SDL_LockMutex(q->mutex);
-    
-    if(!q->last_pkt)
-        q->first_pkt = pkt_list;
-    else
-        q->last_pkt->next = pkt_list;
-    q->last_pkt = pkt_list;
-    q->nb_packets++;
-    q->size += pkt_list->pkt.size;
-    SDL_CondSignal(q->cond);
-    
-    SDL_UnlockMutex(q->mutex);
     return 0;
 }
 
-// 包队列取出
-int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block) {
-    AVPacketList *pkt_list;
-    int ret;
-    
-    SDL_LockMutex(q->mutex);
-    
-    for(;;) {
-        if(q->quit) {
-            ret = -1;
-            break;
+// 在渲染线程上把帧上传到纹理，尺寸变化时重建纹理
+static int upload_picture(VideoState *is, AVFrame *frame) {
+    if(!is->texture || is->texture_width != frame->width || is->texture_height != frame->height) {
+        if(is->texture) {
+            SDL_DestroyTexture(is->texture);
         }
-        
-        pkt_list = q->first_pkt;
-        if(pkt_list) {
-            q->first_pkt = pkt_list->next;
-            if(!q->first_pkt)
-                q->last_pkt = NULL;
-            q->nb_packets--;
-            q->size -= pkt_list->pkt.size;
-            *pkt = pkt_list->pkt;
-            av_free(pkt_list);
-            ret = 1;
-            break;
-        } else if(!block) {
-            ret = 0;
-            break;
-        } else {
-            SDL_CondWaitTimeout(q->cond, q->mutex, 100); // 添加超时时间
+        is->texture = SDL_CreateTexture(is->renderer,
+                                        SDL_PIXELFORMAT_IYUV,
+                                        SDL_TEXTUREACCESS_STREAMING,
+                                        frame->width,
+                                        frame->height);
+        if(!is->texture) {
+            fprintf(stderr, "SDL: could not create texture - %s\n", SDL_GetError());
+            return -1;
         }
+        is->texture_width = frame->width;
+        is->texture_height = frame->height;
     }
-    SDL_UnlockMutex(q->mutex);
-    return ret;
-}
 
-// 添加一个函数来设置队列退出标志
-void packet_queue_quit(PacketQueue *q) {
-    SDL_LockMutex(q->mutex);
-    q->quit = 1;
-    SDL_CondSignal(q->cond);
-    SDL_UnlockMutex(q->mutex);
+    // 更新YUV平面
+    return SDL_UpdateYUVTexture(is->texture, NULL,
+                                frame->data[0], frame->linesize[0],
+                                frame->data[1], frame->linesize[1],
+                                frame->data[2], frame->linesize[2]);
 }
 
-// 初始化音频
-int init_audio(AudioState *audio) {
-    // 设置音频参数
-    audio->wanted_spec.freq = audio->audio_ctx->sample_rate;
-    audio->wanted_spec.format = AUDIO_S16SYS;
-    audio->wanted_spec.channels = audio->audio_ctx->channels;
-    audio->wanted_spec.silence = 0;
-    audio->wanted_spec.samples = 1024;
-    audio->wanted_spec.callback = audio_callback;
-    audio->wanted_spec.userdata = audio;
-
-    // 打开音频设备
-    SDL_AudioSpec obtained_spec;
-    int audio_device_id = SDL_OpenAudioDevice(NULL, 0, &audio->wanted_spec, &obtained_spec, 0);
-    if (audio_device_id <= 0) {
-        fprintf(stderr, "SDL_OpenAudioDevice: %s\n", SDL_GetError());
-        return -1;
-    }
-
-    // 开始播放音频
-    SDL_PauseAudioDevice(audio_device_id, 0);
-
-    // 初始化音频缓冲区索引
-    audio->audio_buf_index = 0;
-    audio->audio_buf_size = 0;
-
-    // 初始化音频包
-    av_init_packet(&audio->audio_pkt);
+// 唤醒回调：在视频线程上调用，SDL_PushEvent可以跨线程使用
+static void wake_render_loop(void *opaque) {
+    SDL_Event event;
 
-    return 0;
+    (void)opaque;
+    memset(&event, 0, sizeof(event));
+    event.type = FF_WAKE_EVENT;
+    SDL_PushEvent(&event);
 }
-// 音频回调函数
-void audio_callback(void *userdata, Uint8 *stream, int len) {
-    AudioState *audio = (AudioState *)userdata;
-    int len1, audio_size;
-
-    // 首先清空流
-    memset(stream, 0, len);
-
-    while (len > 0) {
-        if (audio->audio_buf_index >= audio->audio_buf_size) {
-            // 需要更多数据
-            audio_size = audio_decode_frame(audio);
-            if (audio_size < 0) {
-                // 错误处理，这里填充静音
-                audio->audio_buf_size = 0;
-                break;
-            }
-            audio->audio_buf_index = 0;
-        }
-        len1 = audio->audio_buf_size - audio->audio_buf_index;
-        if (len1 > len)
-            len1 = len;
-
-        // 混合音频数据到输出流（而不是直接覆盖）
-        SDL_MixAudioFormat(stream, audio->audio_buf + audio->audio_buf_index, AUDIO_S16SYS, len1, SDL_MIX_MAXVOLUME);
 
-        len -= len1;
-        stream += len1;
-        audio->audio_buf_index += len1;
+// 帧回调：上传并显示图像，由player_refresh在渲染线程上调用
+static int display_frame(void *opaque, AVFrame *frame, double pts, double duration) {
+    VideoState *is = (VideoState *)opaque;
+
+    int64_t t0 = av_gettime_relative();
+    int ret = upload_picture(is, frame);
+    int64_t t1 = av_gettime_relative();
+    stage_hist_add_at(player_stage(is->player, PLAYER_STAGE_UPLOAD), t1 - t0, t1);
+    if(ret == 0) {
+        update_display_rect(is, frame);
+        video_display(is);
+        int64_t t2 = av_gettime_relative();
+        stage_hist_add(player_stage(is->player, PLAYER_STAGE_PRESENT), t2 - t1);
+
+        // 抖动：两次显示的实际间隔和两帧pts差之差
+        double now = t2 / 1000000.0;
+        double expected = (pts - is->last_present_pts) / player_get_speed(is->player);
+        if (!isnan(expected) && expected > 0 && expected < PRESENT_JITTER_MAX_GAP) {
+            stage_hist_add(player_stage(is->player, PLAYER_STAGE_PRESENT_JITTER),
+                           (int64_t)(fabs(now - is->last_present - expected) * 1000000));
+        }
+        is->last_present = now;
+        is->last_present_pts = pts;
     }
+    return 0;
 }
-// 解码音频
-int audio_decode_frame(AudioState *audio) {
-    int data_size = 0;
-    int ret = 0;
-
-    while (1) {
-        // 如果没有包，读取新的音频包
-        if (audio->audio_pkt.size <= 0) {
-            ret = av_read_frame(audio->format_ctx, &audio->audio_pkt);
-            if (ret < 0) {
-                // 文件结尾或错误
-                return -1;
-            }
-
-            // 确保是音频包
-            if (audio->audio_pkt.stream_index != audio->audio_stream_idx) {
-                av_packet_unref(&audio->audio_pkt);
-                continue;
-            }
-        }
 
-        // 发送包到解码器
-        ret = avcodec_send_packet(audio->audio_ctx, &audio->audio_pkt);
-        if (ret < 0) {
-            if (ret == AVERROR(EAGAIN)) {
-                // 解码器需要更多数据
-                continue;
-            }
-            av_packet_unref(&audio->audio_pkt);
-            return -1;
-        }
-
-        // 包已经被解码器接收，可以释放了
-        av_packet_unref(&audio->audio_pkt);
-        audio->audio_pkt.size = 0;
-
-        // 接收解码后的帧
-        ret = avcodec_receive_frame(audio->audio_ctx, audio->audio_frame);
-        if (ret < 0) {
-            if (ret == AVERROR(EAGAIN)) {
-                // 需要更多数据
-                continue;
-            }
-            return -1;
+// 切换到上一档/下一档速度，dir为0时恢复原速
+static void change_speed(VideoState *is, int dir) {
+    double speed = player_get_speed(is->player);
+    int n = FF_ARRAY_ELEMS(speed_steps);
+    int i;
+
+    if (dir == 0) {
+        speed = 1.0;
+    } else if (dir > 0) {
+        i = 0;
+        while (i < n - 1 && speed_steps[i] <= speed) {
+            i++;
         }
-
-        // 成功获取到帧，进行重采样
-        // 计算输出样本数
-        int out_samples = av_rescale_rnd(
-            swr_get_delay(audio->swr_ctx, audio->audio_ctx->sample_rate) + audio->audio_frame->nb_samples,
-            audio->wanted_spec.freq,
-            audio->audio_ctx->sample_rate,
-            AV_ROUND_UP);
-
-        // 重采样转换
-        uint8_t **out_buffer = &audio->audio_buf;
-        ret = swr_convert(audio->swr_ctx,
-            out_buffer,
-            out_samples,
-            (const uint8_t **)audio->audio_frame->data,
-            audio->audio_frame->nb_samples);
-
-        if (ret < 0) {
-            fprintf(stderr, "Error while converting\n");
-            return -1;
+        speed = FFMAX(speed, speed_steps[i]);
+    } else {
+        i = n - 1;
+        while (i > 0 && speed_steps[i] >= speed) {
+            i--;
         }
-
-        // 计算实际数据大小
-        data_size = ret * audio->wanted_spec.channels * 2; // 2 for 16 bit samples
-        audio->audio_buf_size = data_size;
-
-        return data_size;
+        speed = FFMIN(speed, speed_steps[i]);
     }
+    player_set_speed(is->player, speed);
+    is->last_present_pts = NAN;
+    fprintf(stderr, "speed %.2fx\n", player_get_speed(is->player));
 }
 
-int stream_component_open(VideoState *is, int stream_index) {
-    AVFormatContext *pFormatCtx = is->pFormatCtx;
-    AVCodecContext *codecCtx;
-    AVCodec *codec;
-    SDL_AudioSpec wanted_spec, spec;
-
-    if(stream_index < 0 || stream_index >= pFormatCtx->nb_streams){
-        return -1;
-    }
-    // 使用codecpar替代codec
-    codecCtx = avcodec_alloc_context3(NULL);
-    if (!codecCtx) {
-        return -1;
-    }
-    if (avcodec_parameters_to_context(codecCtx, pFormatCtx->streams[stream_index]->codecpar) < 0) {
-        avcodec_free_context(&codecCtx);
-        return -1;
-    }
-
-    if(codecCtx->codec_type == AVMEDIA_TYPE_AUDIO){
-        // 从编解码信息设置音频设置
-        wanted_spec.freq = codecCtx->sample_rate;
-        wanted_spec.callback = audio_callback;
-        wanted_spec.userdata = is;
-
-        if(SDL_OpenAudio(&wanted_spec, &spec) < 0){
-            fprintf(stderr, "SDL_OpenAudio: %s\n", SDL_GetError());
-            return -1;
-        }
-    }
-    codec = avcodec_find_decoder(codecCtx->codec_id);
-    if(!codec || avcodec_open2(codecCtx, codec, NULL) < 0){
-        fprintf(stderr, "Unsupported codec!\n");
-        avcodec_free_context(&codecCtx);
-        return -1;
-    }
-
-    switch(codecCtx->codec_type){
-        case AVMEDIA_TYPE_AUDIO:
-            is->audioStream = stream_index;
-            is->audio_st = pFormatCtx->streams[stream_index];
-            is->audio_buf_size = 0;
-            is->audio_buf_index = 0;
-            memset(&is->audio_pkt, 0, sizeof(is->audio_pkt));
-            packet_queue_init(&is->audioq);
-            SDL_PauseAudio(0);
+// 处理一个输入事件
+static void handle_event(VideoState *is, SDL_Event *event) {
+    switch (event->type) {
+        case SDL_KEYDOWN:
+            switch (event->key.keysym.sym) {
+                case SDLK_ESCAPE:
+                case SDLK_q:
+                    is->quit = 1;
+                    break;
+                case SDLK_SPACE:
+                    player_pause(is->player, !player_is_paused(is->player));
+                    is->last_present_pts = NAN;
+                    break;
+                case SDLK_s:
+                    // 单帧步进，之后保持暂停
+                    player_step(is->player);
+                    is->last_present_pts = NAN;
+                    break;
+                case SDLK_LEFTBRACKET:
+                case SDLK_RIGHTBRACKET:
+                case SDLK_BACKSPACE:
+                    change_speed(is, event->key.keysym.sym == SDLK_BACKSPACE ? 0 :
+                                     event->key.keysym.sym == SDLK_RIGHTBRACKET ? 1 : -1);
+                    break;
+                case SDLK_LEFT:
+                    player_seek_relative(is->player, -SEEK_SHORT_STEP);
+                    break;
+                case SDLK_RIGHT:
+                    player_seek_relative(is->player, SEEK_SHORT_STEP);
+                    break;
+                case SDLK_UP:
+                    player_seek_relative(is->player, SEEK_LONG_STEP);
+                    break;
+                case SDLK_DOWN:
+                    player_seek_relative(is->player, -SEEK_LONG_STEP);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case SDL_WINDOWEVENT:
+            switch (event->window.event) {
+                case SDL_WINDOWEVENT_SIZE_CHANGED:
+                    // 只在这里重新计算显示区域，暂停时也立即用最后一帧重画
+                    SDL_GetRendererOutputSize(is->renderer, &is->window_width, &is->window_height);
+                    is->rect_valid = 0;
+                    update_display_rect(is, NULL);
+                    video_display(is);
+                    break;
+                case SDL_WINDOWEVENT_EXPOSED:
+                    video_display(is);
+                    break;
+                default:
+                    break;
+            }
             break;
-        case AVMEDIA_TYPE_VIDEO:
-            is->videoStream = stream_index;
-            is->video_st = pFormatCtx->streams[stream_index];
-            packet_queue_init(&is->videoq);
-            is->pictq_mutex = SDL_CreateMutex();
-            is->pictq_cond = SDL_CreateCond();
+        case SDL_QUIT:
+            is->quit = 1;
+            break;
+        case FF_QUIT_EVENT:
+            is->quit = 1;
             break;
         default:
             break;
     }
-
-    return 0;
 }
 
-// 修改video_thread函数
-int video_thread(void *arg) {
-    VideoState *is = (VideoState *)arg;
-    AVPacket pkt1, *packet = &pkt1;
-    AVFrame *pFrame;
-    AVCodecContext *codecCtx;
-    
-    pFrame = av_frame_alloc();
-    if (!pFrame) {
-        fprintf(stderr, "Could not allocate video frame\n");
-        return -1;
-    }
-    
-    // 获取解码器上下文
-    codecCtx = avcodec_alloc_context3(NULL);
-    if (!codecCtx) {
-        fprintf(stderr, "Could not allocate codec context\n");
-        return -1;
-    }
-    
-    if (avcodec_parameters_to_context(codecCtx, is->video_st->codecpar) < 0) {
-        fprintf(stderr, "Could not copy codec parameters\n");
-        return -1;
+/**
+ * ! 显示视频
+ */
+// 等到deadline，有事件(输入、新帧入队)时提前返回。frame为1表示deadline是帧的显示时间：
+// 没有垂直同步时整毫秒的部分在SDL_WaitEventTimeout里等，离显示时间不到PRECISE_SLEEP_MARGIN时
+// 才精确睡眠，最后PRECISE_SLEEP_SPIN自旋，避免睡眠粒度带来的抖动。
+// 垂直同步时和其他deadline(统计、检查结束)只在SDL_WaitEventTimeout里等，毫秒向上取整，不会提前醒来空转
+static void wait_until(VideoState *is, double deadline, int frame) {
+    if (isinf(deadline)) {
+        SDL_WaitEvent(NULL);
+        return;
+    }
+
+    double remaining = deadline - clock_now();
+    int ms;
+
+    if (is->vsync || !frame) {
+        ms = (int)ceil(remaining * 1000);
+        if (ms > 0) {
+            SDL_WaitEventTimeout(NULL, ms);
+        }
+        return;
     }
-    
-    AVCodec *codec = avcodec_find_decoder(codecCtx->codec_id);
-    if (!codec) {
-        fprintf(stderr, "Unsupported codec\n");
-        return -1;
+    ms = (int)((remaining - PRECISE_SLEEP_MARGIN) * 1000);
+    if (ms > 0 && SDL_WaitEventTimeout(NULL, ms)) {
+        return;
     }
-    
-    if (avcodec_open2(codecCtx, codec, NULL) < 0) {
-        fprintf(stderr, "Could not open codec\n");
-        return -1;
+    remaining = deadline - clock_now() - PRECISE_SLEEP_SPIN;
+    if (remaining > 0) {
+        av_usleep((unsigned)(remaining * 1000000));
     }
-
-    for(;;) {
-        if(is->quit) {
-            break;
-        }
-        
-        if(packet_queue_get(&is->videoq, packet, 1) < 0) {
-            break;
-        }
-        
-        // 发送包到解码器
-        int ret = avcodec_send_packet(codecCtx, packet);
-        if (ret < 0) {
-            fprintf(stderr, "Error sending packet for decoding\n");
-            av_packet_unref(packet);
-            continue;
-        }
-        
-        // 接收解码后的帧
-        while (ret >= 0) {
-            ret = avcodec_receive_frame(codecCtx, pFrame);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            } else if (ret < 0) {
-                fprintf(stderr, "Error during decoding\n");
-                break;
-            }
-            
-            if(queue_picture(is, pFrame) < 0) {
-                break;
-            }
-        }
-        
-        av_packet_unref(packet);
+    while (clock_now() < deadline) {
+        // 自旋到deadline
     }
-    
-    avcodec_free_context(&codecCtx);
-    av_frame_free(&pFrame);
-    return 0;
 }
 
-// 修改queue_picture函数
-int queue_picture(VideoState *is, AVFrame *pFrame) {
-    VideoPicture *vp;
-    
-    // 等待空闲的图像队列
-    SDL_LockMutex(is->pictq_mutex);
-    while(is->pictq_size >= VIDEO_PICTURE_QUEUE_SIZE && !is->quit) {
-        SDL_CondWait(is->pictq_cond, is->pictq_mutex);
-    }
-    SDL_UnlockMutex(is->pictq_mutex);
-    
-    if(is->quit) {
-        return -1;
+// 窗口大小取视频的尺寸，超出屏幕可用区域时等比缩小；没有视频流时保持默认值
+static void window_size(VideoState *is, int *w, int *h) {
+    AVStream *video_st = player_video_stream(is->player);
+    SDL_Rect bounds;
+
+    if (!video_st || video_st->codecpar->width <= 0 || video_st->codecpar->height <= 0) {
+        return;
     }
-    
-    // 获取写入位置
-    vp = &is->pictq[is->pictq_windex];
-    
-    // 检查是否需要分配或重新分配纹理
-    if(!vp->texture || vp->width != is->video_st->codecpar->width || 
-       vp->height != is->video_st->codecpar->height) {
-        
-        // 已经有纹理，销毁它
-        if(vp->texture) {
-            SDL_DestroyTexture(vp->texture);
-            vp->texture = NULL;
-        }
-        
-        // 创建新纹理
-        vp->texture = SDL_CreateTexture(
-            is->renderer,
-            SDL_PIXELFORMAT_IYUV,
-            SDL_TEXTUREACCESS_STREAMING,
-            is->video_st->codecpar->width,
-            is->video_st->codecpar->height
-        );
-        
-        if (!vp->texture) {
-            fprintf(stderr, "SDL: could not create texture - %s\n", SDL_GetError());
-            return -1;
-        }
-        
-        vp->width = is->video_st->codecpar->width;
-        vp->height = is->video_st->codecpar->height;
-        vp->allocated = 1;
-    }
-    
-    // 更新纹理
-    if(vp->texture) {
-        // 更新YUV平面
-        SDL_UpdateYUVTexture(vp->texture, NULL,
-                           pFrame->data[0], pFrame->linesize[0],
-                           pFrame->data[1], pFrame->linesize[1],
-                           pFrame->data[2], pFrame->linesize[2]);
-        
-        // 更新队列
-        if(++is->pictq_windex == VIDEO_PICTURE_QUEUE_SIZE) {
-            is->pictq_windex = 0;
-        }
-        
-        SDL_LockMutex(is->pictq_mutex);
-        is->pictq_size++;
-        SDL_UnlockMutex(is->pictq_mutex);
+    *w = video_st->codecpar->width;
+    *h = video_st->codecpar->height;
+    AVRational sar = video_st->codecpar->sample_aspect_ratio;
+    if (sar.num > 0 && sar.den > 0 && av_cmp_q(sar, (AVRational){1, 1})) {
+        *w = FFMAX(1, (int)lrint(*w * av_q2d(sar)));
     }
-    
-    return 0;
-}
-
-void alloc_picture(void *userdata) {
-    VideoState *is = (VideoState *)userdata;
-    VideoPicture *vp;
-
-    vp = &is->pictq[is->pictq_windex];
-    if(vp->texture){
-        SDL_DestroyTexture(vp->texture);
-    }
-
-    vp->texture = SDL_CreateTexture(is->renderer,
-                                  SDL_PIXELFORMAT_IYUV,
-                                  SDL_TEXTUREACCESS_STREAMING,
-                                  is->video_st->codecpar->width,
-                                  is->video_st->codecpar->height);
-    
-    vp->width = is->video_st->codecpar->width;
-    vp->height = is->video_st->codecpar->height;
-    vp->allocated = 1;
-
-    // 通知视频线程图像已分配
-    SDL_LockMutex(is->pictq_mutex);
-    SDL_CondSignal(is->pictq_cond);
-    SDL_UnlockMutex(is->pictq_mutex);
-}
-
-/**
- * ! 显示视频
- */
-static void schedule_refresh(VideoState *is, int delay) {
-    SDL_Event event;
-    event.type = FF_REFRESH_EVENT;
-    event.user.data1 = is;
-    
-    SDL_RemoveTimer(is->refresh_timer);
-    is->refresh_timer = SDL_AddTimer(delay, sdl_refresh_timer_cb, is);
-    
-    // 如果定时器创建失败，直接推送事件
-    if (!is->refresh_timer) {
-        SDL_PushEvent(&event);
+    if (SDL_GetDisplayUsableBounds(0, &bounds) == 0 && bounds.w > 0 && bounds.h > 0 &&
+        (*w > bounds.w || *h > bounds.h)) {
+        double scale = FFMIN((double)bounds.w / *w, (double)bounds.h / *h);
+        *w = FFMAX(1, (int)(*w * scale));
+        *h = FFMAX(1, (int)(*h * scale));
     }
 }
 
-static Uint32 sdl_refresh_timer_cb(Uint32 interval, void *opaque) {
-    SDL_Event event;
-    event.type = FF_REFRESH_EVENT;
-    event.user.data1 = opaque;
-    SDL_PushEvent(&event);
-    return 0;
-}
-
-void video_refresh_timer(void *userdata) {
-    VideoState *is = (VideoState *)userdata;
-    VideoPicture *vp;
-    
-    if(is->video_st) {
-        if(is->pictq_size == 0) {
-            schedule_refresh(is, 1);
-        } else {
-            vp = &is->pictq[is->pictq_rindex];
-            
-            // 显示图像
-            SDL_RenderClear(is->renderer);
-            SDL_RenderCopy(is->renderer, vp->texture, NULL, &is->screen_rect);
-            SDL_RenderPresent(is->renderer);
-            
-            // 计算下一帧延迟
-            schedule_refresh(is, 40);
-            
-            // 更新队列
-            if(++is->pictq_rindex == VIDEO_PICTURE_QUEUE_SIZE) {
-                is->pictq_rindex = 0;
-            }
-            
-            SDL_LockMutex(is->pictq_mutex);
-            is->pictq_size--;
-            SDL_CondSignal(is->pictq_cond);
-            SDL_UnlockMutex(is->pictq_mutex);
-        }
-    } else {
-        schedule_refresh(is, 100);
-    }
+// 由帧尺寸和像素宽高比计算居中的显示区域，两侧或上下留黑边
+// frame为NULL时沿用上一次的帧格式(窗口大小变化)；格式和窗口都没变时不重新计算
+static void update_display_rect(VideoState *is, AVFrame *frame) {
+    AVStream *video_st = player_video_stream(is->player);
+    int frame_width = frame ? frame->width : is->rect_frame_width;
+    int frame_height = frame ? frame->height : is->rect_frame_height;
+    AVRational sar = frame ? frame->sample_aspect_ratio : is->rect_sar;
+    double aspect_ratio;
+    int w, h;
+
+    if (frame && !sar.num && video_st) {
+        sar = video_st->codecpar->sample_aspect_ratio;
+    }
+    if (is->rect_valid && frame_width == is->rect_frame_width && frame_height == is->rect_frame_height &&
+        !av_cmp_q(sar, is->rect_sar)) {
+        return;
+    }
+    if (frame_width <= 0 || frame_height <= 0 || is->window_width <= 0 || is->window_height <= 0) {
+        return;
+    }
+
+    aspect_ratio = sar.num > 0 && sar.den > 0 ? av_q2d(sar) : 1.0;
+    aspect_ratio *= (double)frame_width / frame_height;
+
+    h = is->window_height;
+    w = (int)lrint(h * aspect_ratio) & ~1;
+    if (w > is->window_width) {
+        w = is->window_width;
+        h = (int)lrint(w / aspect_ratio) & ~1;
+    }
+    is->display_rect.x = (is->window_width - w) / 2;
+    is->display_rect.y = (is->window_height - h) / 2;
+    is->display_rect.w = FFMAX(w, 1);
+    is->display_rect.h = FFMAX(h, 1);
+    is->rect_frame_width = frame_width;
+    is->rect_frame_height = frame_height;
+    is->rect_sar = sar;
+    is->rect_valid = 1;
+
+    // 视频线程按显示区域缩小远大于它的帧(--downscale)
+    player_set_display_size(is->player, is->display_rect.w, is->display_rect.h);
 }
 
-// 显示视频
-void video_display(VideoState *is) {
-    SDL_Rect rect;
-    VideoPicture *vp;
-    float aspect_ratio;
-    int w, h, x, y;
-
-    vp = &is->pictq[is->pictq_rindex];
-    if(vp->texture){
-        if(is->video_st->codecpar->sample_aspect_ratio.num == 0){
-            aspect_ratio = 0;
-        }
-        else{
-            aspect_ratio = av_q2d(is->video_st->codecpar->sample_aspect_ratio) * 
-                          is->video_st->codecpar->width / is->video_st->codecpar->height;
-        }
-
-        if(aspect_ratio <= 0.0){
-            aspect_ratio = (float)is->video_st->codecpar->width / 
-                          (float)is->video_st->codecpar->height;
-        }
-
-        h = is->screen_rect.h;
-        w = ((int)rint(h * aspect_ratio)) & -3;
-        if(w > is->screen_rect.w){
-            w = is->screen_rect.w;
-            h = ((int)rint(w / aspect_ratio)) & -3;
-        }
-        x = (is->screen_rect.w - w) / 2;
-        y = (is->screen_rect.h - h) / 2;
-
-        rect.x = x;
-        rect.y = y;
-        rect.w = w;
-        rect.h = h;
-        
-        SDL_RenderClear(is->renderer);
-        SDL_RenderCopy(is->renderer, vp->texture, NULL, &rect);
-        SDL_RenderPresent(is->renderer);
+// 把当前纹理画到显示区域
+static void video_display(VideoState *is) {
+    SDL_RenderClear(is->renderer);
+    if (is->texture && is->rect_valid) {
+        SDL_RenderCopy(is->renderer, is->texture, NULL, &is->display_rect);
     }
+    SDL_RenderPresent(is->renderer);
 }
-
-int decode_interrupt_cb(void *ctx) {
-    return (global_video_state && global_video_state->quit);
-}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include <libavcodec/avcodec.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include "packet_queue.h"
+
+/**
+ * ! 包队列微基准
+ * 对比原来的链表队列(每包av_malloc + 两端加锁)和无锁环形队列
+ * 一个生产者线程放入N个包，一个消费者线程取出
+ */
+
+#define DEFAULT_PACKETS 2000000
+#define BENCH_PKT_SIZE 4096
+
+// 原来的链表队列，作为基准
+typedef struct ListQueue {
+    AVPacketList *first_pkt, *last_pkt;
+    int nb_packets;
+    int size;
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    int quit;
+} ListQueue;
+
+static void list_queue_init(ListQueue *q) {
+    memset(q, 0, sizeof(ListQueue));
+    q->mutex = SDL_CreateMutex();
+    q->cond = SDL_CreateCond();
+}
+
+static int list_queue_put(ListQueue *q, AVPacket *pkt) {
+    AVPacketList *pkt_list;
+
+    pkt_list = av_malloc(sizeof(AVPacketList));
+    if(!pkt_list)
+        return -1;
+    pkt_list->pkt = *pkt;
+    pkt_list->next = NULL;
+
+    SDL_LockMutex(q->mutex);
+
+    if(!q->last_pkt)
+        q->first_pkt = pkt_list;
+    else
+        q->last_pkt->next = pkt_list;
+    q->last_pkt = pkt_list;
+    q->nb_packets++;
+    q->size += pkt_list->pkt.size;
+    SDL_CondSignal(q->cond);
+
+    SDL_UnlockMutex(q->mutex);
+    return 0;
+}
+
+static int list_queue_get(ListQueue *q, AVPacket *pkt, int block) {
+    AVPacketList *pkt_list;
+    int ret;
+
+    SDL_LockMutex(q->mutex);
+
+    for(;;) {
+        if(q->quit) {
+            ret = -1;
+            break;
+        }
+
+        pkt_list = q->first_pkt;
+        if(pkt_list) {
+            q->first_pkt = pkt_list->next;
+            if(!q->first_pkt)
+                q->last_pkt = NULL;
+            q->nb_packets--;
+            q->size -= pkt_list->pkt.size;
+            *pkt = pkt_list->pkt;
+            av_free(pkt_list);
+            ret = 1;
+            break;
+        } else if(!block) {
+            ret = 0;
+            break;
+        } else {
+            SDL_CondWaitTimeout(q->cond, q->mutex, 100);
+        }
+    }
+    SDL_UnlockMutex(q->mutex);
+    return ret;
+}
+
+static void list_queue_destroy(ListQueue *q) {
+    AVPacketList *pkt_list = q->first_pkt;
+    while (pkt_list) {
+        AVPacketList *next = pkt_list->next;
+        av_packet_unref(&pkt_list->pkt);
+        av_free(pkt_list);
+        pkt_list = next;
+    }
+    SDL_DestroyMutex(q->mutex);
+    SDL_DestroyCond(q->cond);
+}
+
+typedef struct BenchArgs {
+    void *queue;
+    int count;
+} BenchArgs;
+
+// 生产者只填写size/stream_index，不带数据，测的是队列本身的开销
+static void make_packet(AVPacket *pkt, int i) {
+    av_init_packet(pkt);
+    pkt->data = NULL;
+    pkt->size = BENCH_PKT_SIZE;
+    pkt->stream_index = i & 1;
+}
+
+static int list_producer(void *arg) {
+    BenchArgs *args = (BenchArgs *)arg;
+    AVPacket pkt;
+    for (int i = 0; i < args->count; i++) {
+        make_packet(&pkt, i);
+        if (list_queue_put((ListQueue *)args->queue, &pkt) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int list_consumer(void *arg) {
+    BenchArgs *args = (BenchArgs *)arg;
+    AVPacket pkt;
+    for (int i = 0; i < args->count; i++) {
+        if (list_queue_get((ListQueue *)args->queue, &pkt, 1) < 0)
+            return -1;
+        av_packet_unref(&pkt);
+    }
+    return 0;
+}
+
+static int ring_producer(void *arg) {
+    BenchArgs *args = (BenchArgs *)arg;
+    AVPacket pkt;
+    for (int i = 0; i < args->count; i++) {
+        make_packet(&pkt, i);
+        if (packet_queue_put((PacketQueue *)args->queue, &pkt) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int ring_consumer(void *arg) {
+    BenchArgs *args = (BenchArgs *)arg;
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    for (int i = 0; i < args->count; i++) {
+        if (packet_queue_get((PacketQueue *)args->queue, &pkt, 1) < 0)
+            return -1;
+        av_packet_unref(&pkt);
+    }
+    return 0;
+}
+
+// 跑一轮生产者/消费者，返回耗时(秒)
+static double run_bench(SDL_ThreadFunction producer, SDL_ThreadFunction consumer, void *queue, int count) {
+    BenchArgs args = { queue, count };
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    SDL_Thread *cons = SDL_CreateThread(consumer, "bench_consumer", &args);
+    SDL_Thread *prod = SDL_CreateThread(producer, "bench_producer", &args);
+    SDL_WaitThread(prod, NULL);
+    SDL_WaitThread(cons, NULL);
+
+    Uint64 end = SDL_GetPerformanceCounter();
+    return (double)(end - start) / SDL_GetPerformanceFrequency();
+}
+
+int main(int argc, char *argv[])
+{
+    int count = DEFAULT_PACKETS;
+    if (argc > 1) {
+        count = atoi(argv[1]);
+        if (count <= 0) {
+            printf("用法: %s [包数量]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    if (SDL_Init(SDL_INIT_TIMER) < 0) {
+        fprintf(stderr, "Could not initialize SDL - %s\n", SDL_GetError());
+        return -1;
+    }
+
+    ListQueue list_q;
+    list_queue_init(&list_q);
+    double list_sec = run_bench(list_producer, list_consumer, &list_q, count);
+    list_queue_destroy(&list_q);
+
+    PacketQueue ring_q;
+    if (packet_queue_init(&ring_q) < 0) {
+        fprintf(stderr, "Could not allocate packet queue\n");
+        return -1;
+    }
+    double ring_sec = run_bench(ring_producer, ring_consumer, &ring_q, count);
+    packet_queue_destroy(&ring_q);
+
+    printf("packets: %d, ring capacity: %d\n", count, PACKET_QUEUE_CAPACITY);
+    printf("list queue: %8.3f s  %12.0f pkt/s\n", list_sec, count / list_sec);
+    printf("ring queue: %8.3f s  %12.0f pkt/s\n", ring_sec, count / ring_sec);
+    printf("speedup:    %8.2fx\n", list_sec / ring_sec);
+
+    SDL_Quit();
+    return 0;
+}